@@ -30,6 +30,7 @@
 #include "ltb/sdf/sdf.hpp"
 #include "ltb/util/container_utils.hpp"
 #include "ltb/util/result.hpp"
+#include "ltb/util/thread_pool.hpp"
 #include "ltb/util/timer.hpp"
 #include "obj_io.hpp"
 #include "scene_helpers.hpp"
@@ -38,6 +39,8 @@
 #include <Magnum/GL/Context.h>
 
 // standard
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <utility>
 
@@ -219,13 +222,20 @@ namespace {
         color = {0.0f, 0.6f, 0.6f}; // blue if the volume is inside or on the part
     }
 
-    if (level != dvh::DistanceVolumeHierarchy<3>::base_level) {
+    if (level != dvh::DistanceVolumeHierarchyCpu<3, float>::base_level) {
         color *= std::pow<float>(0.8f, level);
     }
 
     colors->insert(colors->end(), 36, color);
 }
 
+struct LevelMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> colors;
+    std::vector<glm::vec3> border_positions;
+};
+
 } // namespace
 
 DvhView3d::DvhView3d(gvs::ErrorAlertRecorder error_recorder)
@@ -272,12 +282,46 @@ DvhView3d::DvhView3d(gvs::ErrorAlertRecorder error_recorder)
     };
 
     reset_volumes();
-    reset_scene();
 }
 
-DvhView3d::~DvhView3d() = default;
+DvhView3d::~DvhView3d() {
+    cancel_builds();
+}
+
+void DvhView3d::update() {
+    if (!dvh_.is_refined()) {
+        if (dvh_.refine(std::chrono::milliseconds(16))) {
+            std::stringstream ss;
+            ss << "Refinement time: " << build_timer_.millis_since_start() << "ms";
+            computation_time_message_ = ss.str();
+        }
+        reset_scene();
+        return;
+    }
+
+    if (builds_.empty()
+        || !std::all_of(builds_.begin(), builds_.end(), [](auto const& build) { return build.is_ready(); })) {
+        return;
+    }
+
+    auto status = dvh::BuildStatus::Completed;
+    for (auto const& build : builds_) {
+        if (build.get() == dvh::BuildStatus::Cancelled) {
+            status = dvh::BuildStatus::Cancelled;
+        }
+    }
+    builds_.clear();
+
+    std::stringstream ss;
+    if (status == dvh::BuildStatus::Completed) {
+        ss << "Build time: " << build_timer_.millis_since_start() << "ms";
+    } else {
+        ss << "Build cancelled";
+    }
+    computation_time_message_ = ss.str();
 
-void DvhView3d::update() {}
+    reset_scene();
+}
 
 void DvhView3d::render(const gvs::CameraPackage& camera_package) const {
     scene_->render(camera_package);
@@ -293,11 +337,37 @@ void DvhView3d::configure_gui() {
                           ImGuiInputTextFlags_EnterReturnsTrue)) {
         if (base_resolution_ > 0.f) {
             reset_volumes();
-            reset_scene();
         }
     }
 
-    if (!computation_time_message_.empty()) {
+    if (ImGui::Checkbox("Progressive Refinement", &progressive_)) {
+        reset_volumes();
+    }
+
+#ifndef MESH_ONLY
+    for (auto i = 0ul; i < additive_boxes_.size(); ++i) {
+        auto translation = additive_boxes_[i].translation;
+        auto label       = "Box " + std::to_string(i) + " Translation";
+
+        if (ImGui::DragFloat3(label.c_str(), &translation[0], 0.01f)) {
+            move_additive_box(i, translation);
+        }
+    }
+#endif
+
+    if (!dvh_.is_refined()) {
+        ImGui::Text("Refining...");
+
+    } else if (!builds_.empty()) {
+        ImGui::Text("Building level %d (%zu cells processed)", build_level_.load(), build_cells_processed_.load());
+
+        if (ImGui::Button("Cancel")) {
+            for (auto& build : builds_) {
+                build.cancel();
+            }
+        }
+
+    } else if (!computation_time_message_.empty()) {
         ImGui::Text("%s", computation_time_message_.c_str());
     }
 
@@ -321,29 +391,64 @@ auto DvhView3d::handleMouseReleaseEvent(Application::MouseEvent & /*event*/) ->
 auto DvhView3d::handleMouseMoveEvent(Application::MouseMoveEvent & /*event*/) -> void {}
 
 void DvhView3d::reset_volumes() {
-    dvh_ = dvh::DistanceVolumeHierarchy<3>{base_resolution_};
+    // Replacing the hierarchy waits for its builds, so they are cancelled instead of completed
+    cancel_builds();
 
-    std::stringstream ss;
-#ifndef MESH_ONLY
-    {
-        util::ScopedTimer timer("Additive box time", ss);
+    dvh_ = dvh::DistanceVolumeHierarchyCpu<3, float>{base_resolution_};
 
+    additive_box_volumes_.clear();
+    additive_box_build_translations_.clear();
+    for (auto const& box : additive_boxes_) {
+        additive_box_build_translations_.emplace_back(box.translation);
+    }
+
+    build_level_           = 0;
+    build_cells_processed_ = 0;
+    build_timer_.start();
+
+    if (progressive_) {
+#ifndef MESH_ONLY
         for (auto const& box : additive_boxes_) {
-            dvh_.add_volume(decltype(additive_boxes_){box});
+            additive_box_volumes_.emplace_back(dvh_.queue_add_volume(decltype(additive_boxes_){box}));
         }
-    }
 #else
-    {
-        util::ScopedTimer timer("Additive mesh time", ss);
-        dvh_.add_volume(additive_mesh_);
+        dvh_.queue_add_volume(additive_mesh_);
+#endif
+        dvh_.queue_subtract_volumes(subtractive_lines_);
+        return;
+    }
+
+    auto on_progress = [this](dvh::BuildProgress const& progress) {
+        build_level_           = progress.level;
+        build_cells_processed_ = progress.total_cells_processed;
+    };
+
+#ifndef MESH_ONLY
+    for (auto const& box : additive_boxes_) {
+        builds_.emplace_back(dvh_.add_volume_async(decltype(additive_boxes_){box}, on_progress));
+        additive_box_volumes_.emplace_back(builds_.back().volume());
     }
+#else
+    builds_.emplace_back(dvh_.add_volume_async(additive_mesh_, on_progress));
 #endif
 
+    builds_.emplace_back(dvh_.subtract_volumes_async(subtractive_lines_, on_progress));
+}
+
+void DvhView3d::move_additive_box(std::size_t index, glm::vec3 const& translation) {
+    additive_boxes_.at(index).translation = translation;
+
+    // Only the cells near the old and new positions of the box are recomputed
     {
-        util::ScopedTimer timer("Subtractive computation time", ss);
-        dvh_.subtract_volumes(subtractive_lines_);
+        std::stringstream ss;
+        {
+            util::ScopedTimer timer("Box move time", ss);
+            dvh_.move_volume(additive_box_volumes_.at(index), translation - additive_box_build_translations_.at(index));
+        }
+        computation_time_message_ = ss.str();
     }
-    computation_time_message_ = ss.str();
+
+    reset_scene();
 }
 
 void DvhView3d::reset_scene() {
@@ -372,7 +477,34 @@ void DvhView3d::reset_scene() {
                         gvs::SetShading(gvs::Shading::UniformColor),
                         gvs::SetUniformColor({0.95f, 0.5f, 0.5f}));
 
-    for (auto const& [level_index, sparse_distance_field] : dvh_.levels()) {
+    // Meshing is independent per level so it is done on the shared pool (the same one used by
+    // the DVH build) before the results are handed to the scene on this thread.
+    std::vector<int> level_indices;
+    for (auto const& level : dvh_.levels()) {
+        level_indices.emplace_back(level.first);
+    }
+
+    std::vector<LevelMesh> level_meshes(level_indices.size());
+    util::ThreadPool::shared().parallel_for(0, level_indices.size(), [&](std::size_t i) {
+        auto const  level_index           = level_indices[i];
+        auto const& sparse_distance_field = dvh_.levels().at(level_index);
+        auto const  resolution            = dvh_.resolution(level_index);
+        auto&       mesh                  = level_meshes[i];
+
+        for (auto const& [cell, dir_and_dist] : sparse_distance_field) {
+            mesh_cell(&mesh.positions, &mesh.normals, &mesh.colors, cell, resolution, dir_and_dist[3], level_index);
+        }
+#ifdef SHOW_BORDERS
+        for (auto const& [cell, dir_and_dist] : sparse_distance_field) {
+            util::ignore(dir_and_dist);
+            mesh_cell_border(&mesh.border_positions, cell, resolution);
+        }
+#endif
+    });
+
+    for (auto i = 0ul; i < level_indices.size(); ++i) {
+        auto const level_index = level_indices[i];
+        auto&      mesh        = level_meshes[i];
 
         if (!util::has_key(index_scene_ids_, level_index)) {
             index_scene_ids_.emplace(level_index,
@@ -401,34 +533,30 @@ void DvhView3d::reset_scene() {
 #endif
         }
 
-        auto resolution = dvh_.resolution(level_index);
-
         auto const& scene_id = index_scene_ids_.at(level_index);
 
         std::vector<gvs::SceneId> children;
         scene_->get_item_info(scene_id, gvs::GetChildren(&children));
         assert(children.size() == 2ul);
 
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec3> normals;
-        std::vector<glm::vec3> colors;
-
-        for (auto const& [cell, dir_and_dist] : sparse_distance_field) {
-            mesh_cell(&positions, &normals, &colors, cell, resolution, dir_and_dist[3], level_index);
-        }
         scene_->update_item(children[0],
-                            gvs::SetPositions3d(positions),
-                            gvs::SetNormals3d(normals),
-                            gvs::SetVertexColors3d(colors));
+                            gvs::SetPositions3d(std::move(mesh.positions)),
+                            gvs::SetNormals3d(std::move(mesh.normals)),
+                            gvs::SetVertexColors3d(std::move(mesh.colors)));
 #ifdef SHOW_BORDERS
-        positions.clear();
-        for (auto const& [cell, dir_and_dist] : sparse_distance_field) {
-            util::ignore(dir_and_dist);
-            mesh_cell_border(&positions, cell, resolution);
-        }
-        scene_->update_item(children[1], gvs::SetPositions3d(positions), gvs::SetLines());
+        scene_->update_item(children[1], gvs::SetPositions3d(std::move(mesh.border_positions)), gvs::SetLines());
 #endif
     }
 }
 
+void DvhView3d::cancel_builds() {
+    for (auto& build : builds_) {
+        build.cancel();
+    }
+    for (auto& build : builds_) {
+        build.wait();
+    }
+    builds_.clear();
+}
+
 } // namespace ltb::example
@@ -23,13 +23,17 @@
 #pragma once
 
 // project
-#include "ltb/dvh/distance_volume_hierarchy.hpp"
+#include "ltb/dvh/impl/distance_volume_hierarchy_cpu.hpp"
 #include "ltb/gvs/display/gui/error_alert_recorder.hpp"
 #include "ltb/gvs/display/local_scene.hpp"
 #include "ltb/sdf/sdf.hpp"
+#include "ltb/util/timer.hpp"
 #include "mesh.hpp"
 #include "view.hpp"
 
+// standard
+#include <atomic>
+
 namespace ltb::example {
 
 class DvhView3d : public View {
@@ -54,13 +58,24 @@ private:
     // Errors
     gvs::ErrorAlertRecorder error_recorder_;
 
-    // DVH
-    float                           base_resolution_ = 2.f;
-    dvh::DistanceVolumeHierarchy<3> dvh_;
+    // DVH (the CPU implementation is used since it supports asynchronous builds)
+    float                                     base_resolution_ = 2.f;
+    dvh::DistanceVolumeHierarchyCpu<3, float> dvh_;
+
+    // Refine a little every frame instead of building in the background
+    bool progressive_ = true;
+
+    // Asynchronous builds
+    std::vector<dvh::BuildHandle> builds_;
+    std::atomic<int>              build_level_           = {0};
+    std::atomic<std::size_t>      build_cells_processed_ = {0};
+    util::Timer                   build_timer_;
 
     // Additive Volumes
     std::vector<sdf::OrientedTriangle<>>               additive_mesh_;
     std::vector<sdf::TransformedGeometry<sdf::Box, 3>> additive_boxes_;
+    std::vector<dvh::VolumeHandle>                     additive_box_volumes_;
+    std::vector<glm::vec3>                             additive_box_build_translations_;
 
     // Subtractive Volumes
     std::vector<sdf::OffsetLine<3>> subtractive_lines_;
@@ -75,6 +90,9 @@ private:
 
     void reset_volumes();
     void reset_scene();
+    void cancel_builds();
+
+    void move_additive_box(std::size_t index, glm::vec3 const& translation);
 };
 
 } // namespace ltb::example
@@ -0,0 +1,284 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Utilities
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "thread_pool.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <chrono>
+#include <numeric>
+#include <set>
+
+namespace ltb::util {
+namespace {
+
+// Used to push tasks created by a worker onto that worker's own queue
+thread_local ThreadPool const* current_pool         = nullptr;
+thread_local std::size_t       current_worker_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t num_threads) {
+    num_threads = std::max(num_threads, std::size_t(1));
+
+    for (auto i = 0ul; i < num_threads; ++i) {
+        queues_.emplace_back(std::make_unique<WorkQueue>());
+    }
+    for (auto i = 0ul; i < num_threads; ++i) {
+        threads_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_condition_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+auto ThreadPool::shared() -> ThreadPool& {
+    static ThreadPool pool;
+    return pool;
+}
+
+auto ThreadPool::default_thread_count() -> std::size_t {
+    auto const hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads > 1u ? hardware_threads - 1u : 1u;
+}
+
+auto ThreadPool::size() const -> std::size_t {
+    return threads_.size();
+}
+
+auto ThreadPool::execute(Task task) -> void {
+    auto queue_index = (current_pool == this ? current_worker_index : next_queue_++ % queues_.size());
+
+    {
+        // Counted before the task is visible so a sleeping worker can never miss it
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++num_pending_tasks_;
+    }
+    {
+        auto&                       queue = *queues_[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.emplace_back(std::move(task));
+    }
+    sleep_condition_.notify_one();
+}
+
+auto ThreadPool::run_pending_task() -> bool {
+    auto preferred_queue = (current_pool == this ? current_worker_index : next_queue_.load() % queues_.size());
+
+    Task task;
+    if (pop_task(preferred_queue, &task)) {
+        task();
+        return true;
+    }
+    return false;
+}
+
+auto ThreadPool::worker_loop(std::size_t worker_index) -> void {
+    current_pool         = this;
+    current_worker_index = worker_index;
+
+    while (true) {
+        Task task;
+        if (pop_task(worker_index, &task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_condition_.wait(lock, [this] { return stopping_ || num_pending_tasks_ > 0; });
+
+        if (stopping_ && num_pending_tasks_ == 0) {
+            return;
+        }
+    }
+}
+
+auto ThreadPool::pop_task(std::size_t preferred_queue, Task* task) -> bool {
+    {
+        // Newest task from the preferred queue keeps recently created work hot in cache
+        auto&                       queue = *queues_[preferred_queue];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            *task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --num_pending_tasks_;
+            return true;
+        }
+    }
+
+    // Steal the oldest task from another queue since it is most likely to spawn more work
+    for (auto offset = 1ul; offset < queues_.size(); ++offset) {
+        auto&                       queue = *queues_[(preferred_queue + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            *task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --num_pending_tasks_;
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool_(pool), state_(std::make_shared<State>()) {}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+        // Exceptions should be handled by calling 'wait' explicitly
+    }
+}
+
+auto TaskGroup::run(ThreadPool::Task task) -> void {
+    ++state_->num_running;
+
+    pool_.execute([state = state_, task = std::move(task)] {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->exception) {
+                state->exception = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (--state->num_running == 0) {
+            state->condition.notify_all();
+        }
+    });
+}
+
+auto TaskGroup::wait() -> void {
+    using namespace std::chrono_literals;
+
+    while (state_->num_running > 0) {
+        // Help instead of blocking so tasks waiting on nested tasks always make progress
+        if (!pool_.run_pending_task()) {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            state_->condition.wait_for(lock, 1ms, [this] { return state_->num_running == 0; });
+        }
+    }
+
+    std::exception_ptr exception = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        std::swap(exception, state_->exception);
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+TEST_CASE("[thread_pool] submit returns results") {
+    ThreadPool pool(4);
+
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 100; ++i) {
+        futures.emplace_back(pool.submit([i] { return i * i; }));
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        CHECK(futures[static_cast<std::size_t>(i)].get() == i * i);
+    }
+}
+
+TEST_CASE("[thread_pool] parallel_for visits every index once") {
+    ThreadPool pool(4);
+
+    std::vector<std::atomic<int>> counts(1013);
+
+    pool.parallel_for(
+        0, counts.size(), [&](std::size_t i) { ++counts[i]; }, 7);
+
+    CHECK(std::all_of(counts.begin(), counts.end(), [](auto const& count) { return count == 1; }));
+}
+
+TEST_CASE("[thread_pool] parallel_for respects max_concurrency") {
+    ThreadPool pool(4);
+
+    std::mutex                 mutex;
+    std::set<std::thread::id> thread_ids;
+
+    pool.parallel_for(
+        0,
+        1000,
+        [&](std::size_t) {
+            std::lock_guard<std::mutex> lock(mutex);
+            thread_ids.emplace(std::this_thread::get_id());
+        },
+        1,
+        1);
+
+    CHECK(thread_ids == std::set<std::thread::id>{std::this_thread::get_id()});
+}
+
+TEST_CASE("[thread_pool] nested parallelism does not deadlock") {
+    ThreadPool pool(2);
+
+    std::atomic<int> total = {0};
+
+    pool.parallel_for(0, 8, [&](std::size_t) {
+        pool.parallel_for(0, 100, [&](std::size_t) { ++total; });
+    });
+
+    CHECK(total == 800);
+}
+
+TEST_CASE("[thread_pool] task groups join and propagate exceptions") {
+    ThreadPool pool(3);
+
+    std::vector<int> results(3, 0);
+    {
+        TaskGroup group(pool);
+        for (auto i = 0ul; i < results.size(); ++i) {
+            group.run([&results, i] { results[i] = static_cast<int>(i) + 1; });
+        }
+        group.wait();
+    }
+    CHECK(results == std::vector<int>{1, 2, 3});
+
+    TaskGroup group(pool);
+    group.run([] { throw std::runtime_error("task failed"); });
+    CHECK_THROWS_AS(group.wait(), std::runtime_error);
+
+    CHECK_THROWS_AS(pool.parallel_for(0, 10, [](std::size_t i) {
+        if (i == 5) {
+            throw std::runtime_error("index failed");
+        }
+    }),
+                    std::runtime_error);
+}
+
+} // namespace ltb::util
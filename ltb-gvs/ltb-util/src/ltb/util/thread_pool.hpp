@@ -0,0 +1,246 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Utilities
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// standard
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ltb::util {
+
+/**
+ * @brief A fixed set of worker threads that share work by stealing from each other.
+ *
+ * Every worker owns a deque of tasks. Workers pop their own newest task first and steal the
+ * oldest task from another worker when their own deque is empty. Threads that block on work
+ * submitted to the pool (TaskGroup::wait, parallel_for) execute pending tasks while they wait
+ * so nested parallelism can not deadlock the pool.
+ *
+ * Example:
+ *
+ *     auto& pool = ltb::util::ThreadPool::shared();
+ *
+ *     auto future = pool.submit([] { return compute_thing(); });
+ *
+ *     // Process 'values' in chunks of 64 indices using at most 4 threads
+ *     pool.parallel_for(0, values.size(), [&](std::size_t i) { values[i] *= 2; }, 64, 4);
+ *
+ *     auto thing = future.get();
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(std::size_t num_threads = default_thread_count());
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool(ThreadPool&&)      = delete;
+    auto operator=(ThreadPool const&) -> ThreadPool& = delete;
+    auto operator=(ThreadPool&&) -> ThreadPool& = delete;
+
+    /**
+     * @brief The process wide pool. Use this instead of creating new pools so
+     *        independent features do not oversubscribe the machine.
+     */
+    static auto shared() -> ThreadPool&;
+
+    /**
+     * @brief One thread per hardware thread minus the one that is submitting work.
+     */
+    static auto default_thread_count() -> std::size_t;
+
+    /**
+     * @brief The number of worker threads.
+     */
+    auto size() const -> std::size_t;
+
+    /**
+     * @brief Queue a task without waiting for its result.
+     */
+    auto execute(Task task) -> void;
+
+    /**
+     * @brief Queue a task and return a future that holds its result (or exception).
+     */
+    template <typename Func>
+    auto submit(Func func) -> std::future<std::invoke_result_t<Func>>;
+
+    /**
+     * @brief Calls 'func(i)' for every index in [begin, end) and waits for all calls to finish.
+     *
+     * @param grain_size - The number of consecutive indices processed by one task.
+     * @param max_concurrency - The maximum number of threads (including the calling thread)
+     *                          used by this call. Zero means no limit.
+     *
+     * The first exception thrown by 'func' stops the remaining chunks and is rethrown here.
+     */
+    template <typename Func>
+    auto parallel_for(std::size_t begin,
+                      std::size_t end,
+                      Func const& func,
+                      std::size_t grain_size      = 1,
+                      std::size_t max_concurrency = 0) -> void;
+
+    /**
+     * @brief Runs one queued task on the calling thread if one is available.
+     * @return true if a task was run.
+     */
+    auto run_pending_task() -> bool;
+
+private:
+    struct WorkQueue {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread>                threads_;
+
+    std::mutex               sleep_mutex_;
+    std::condition_variable  sleep_condition_;
+    std::atomic<std::size_t> num_pending_tasks_ = {0};
+    std::atomic<std::size_t> next_queue_        = {0};
+    bool                     stopping_          = false;
+
+    auto worker_loop(std::size_t worker_index) -> void;
+    auto pop_task(std::size_t preferred_queue, Task* task) -> bool;
+};
+
+/**
+ * @brief Fork/join helper. Tasks run on the pool and 'wait' blocks until all of them
+ *        have finished, helping with queued work in the meantime.
+ *
+ *     ltb::util::TaskGroup group(ltb::util::ThreadPool::shared());
+ *     group.run([&] { left = build(left_half); });
+ *     group.run([&] { right = build(right_half); });
+ *     group.wait(); // rethrows the first exception thrown by a task
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool);
+    ~TaskGroup();
+
+    TaskGroup(TaskGroup const&) = delete;
+    TaskGroup(TaskGroup&&)      = delete;
+    auto operator=(TaskGroup const&) -> TaskGroup& = delete;
+    auto operator=(TaskGroup&&) -> TaskGroup& = delete;
+
+    auto run(ThreadPool::Task task) -> void;
+    auto wait() -> void;
+
+private:
+    struct State {
+        std::mutex               mutex;
+        std::condition_variable  condition;
+        std::atomic<std::size_t> num_running = {0};
+        std::exception_ptr       exception   = nullptr;
+    };
+
+    ThreadPool&            pool_;
+    std::shared_ptr<State> state_;
+};
+
+template <typename Func>
+auto ThreadPool::submit(Func func) -> std::future<std::invoke_result_t<Func>> {
+    using Result = std::invoke_result_t<Func>;
+
+    // std::function requires copyable callables so the packaged_task is shared
+    auto task   = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+    auto future = task->get_future();
+    execute([task] { (*task)(); });
+    return future;
+}
+
+template <typename Func>
+auto ThreadPool::parallel_for(std::size_t begin,
+                              std::size_t end,
+                              Func const& func,
+                              std::size_t grain_size,
+                              std::size_t max_concurrency) -> void {
+    if (begin >= end) {
+        return;
+    }
+
+    grain_size = std::max(grain_size, std::size_t(1));
+
+    auto const num_chunks = (end - begin + grain_size - 1) / grain_size;
+
+    auto concurrency = size() + 1; // workers + the calling thread
+    if (max_concurrency > 0) {
+        concurrency = std::min(concurrency, max_concurrency);
+    }
+    concurrency = std::min(concurrency, num_chunks);
+
+    std::atomic<std::size_t> next_chunk = {0};
+    std::mutex               exception_mutex;
+    std::exception_ptr       exception = nullptr;
+
+    // Each runner keeps pulling chunks so uneven chunk costs are balanced automatically
+    auto run_chunks = [&] {
+        for (auto chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++) {
+            auto const chunk_begin = begin + chunk * grain_size;
+            auto const chunk_end   = std::min(chunk_begin + grain_size, end);
+
+            try {
+                for (auto i = chunk_begin; i < chunk_end; ++i) {
+                    func(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+                next_chunk = num_chunks;
+            }
+        }
+    };
+
+    if (concurrency == 1) {
+        run_chunks();
+    } else {
+        TaskGroup group(*this);
+        for (auto runner = std::size_t(1); runner < concurrency; ++runner) {
+            group.run(run_chunks);
+        }
+        run_chunks();
+        group.wait();
+    }
+
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+} // namespace ltb::util
@@ -0,0 +1,58 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "build_handle.hpp"
+
+namespace ltb::dvh {
+
+BuildHandle::BuildHandle(std::shared_future<BuildStatus> future,
+                         std::shared_ptr<BuildControl>   control,
+                         VolumeHandle                    volume)
+    : future_(std::move(future)), control_(std::move(control)), volume_(volume) {}
+
+auto BuildHandle::valid() const -> bool {
+    return future_.valid();
+}
+
+auto BuildHandle::cancel() const -> void {
+    if (control_) {
+        control_->cancel_requested = true;
+    }
+}
+
+auto BuildHandle::volume() const -> VolumeHandle {
+    return volume_;
+}
+
+auto BuildHandle::is_ready() const -> bool {
+    return wait_for(std::chrono::seconds(0));
+}
+
+auto BuildHandle::wait() const -> void {
+    future_.wait();
+}
+
+auto BuildHandle::get() const -> BuildStatus {
+    return future_.get();
+}
+
+} // namespace ltb::dvh
@@ -0,0 +1,121 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "ltb/dvh/volume_handle.hpp"
+
+// standard
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace ltb::dvh {
+
+enum class BuildStatus {
+    Completed,
+    Cancelled,
+};
+
+struct BuildProgress {
+    int         level                 = 0; ///< The level currently being refined
+    std::size_t level_cells_processed = 0; ///< Cells processed so far on 'level'
+    std::size_t level_cell_count      = 0; ///< Cells in the frontier of 'level'
+    std::size_t total_cells_processed = 0; ///< Cells processed on all levels so far
+};
+
+/**
+ * @brief Called from the build thread after every processed frontier chunk.
+ */
+using ProgressCallback = std::function<void(BuildProgress const&)>;
+
+/**
+ * @brief Shared between a build and the handles that refer to it.
+ */
+struct BuildControl {
+    std::atomic<bool> cancel_requested = {false};
+    std::atomic<bool> rolled_back      = {false}; ///< Set by the build once a cancelled build is undone
+    ProgressCallback  on_progress      = nullptr;
+};
+
+/**
+ * @brief A future-like handle to an asynchronous hierarchy build.
+ *
+ * Example (enforcing a time limit):
+ *
+ *     auto handle = dvh.add_volume_async(geometries);
+ *
+ *     if (!handle.wait_for(std::chrono::seconds(30))) {
+ *         handle.cancel(); // the hierarchy is restored to its state before 'add_volume_async'
+ *     }
+ *
+ *     if (handle.get() == ltb::dvh::BuildStatus::Completed) {
+ *         ...
+ *     }
+ */
+class BuildHandle {
+public:
+    BuildHandle() = default;
+    BuildHandle(std::shared_future<BuildStatus> future, std::shared_ptr<BuildControl> control, VolumeHandle volume);
+
+    /**
+     * @brief False for default constructed handles.
+     */
+    auto valid() const -> bool;
+
+    /**
+     * @brief Request cancellation. The build stops at the next frontier chunk and undoes its changes.
+     */
+    auto cancel() const -> void;
+
+    /**
+     * @brief The volume being built. It is removed from the hierarchy if the build is cancelled.
+     */
+    auto volume() const -> VolumeHandle;
+
+    auto is_ready() const -> bool;
+
+    auto wait() const -> void;
+
+    template <typename Rep, typename Period>
+    auto wait_for(std::chrono::duration<Rep, Period> const& duration) const -> bool;
+
+    /**
+     * @brief Waits for the build and returns how it finished. Exceptions thrown by the build are rethrown here.
+     */
+    auto get() const -> BuildStatus;
+
+private:
+    std::shared_future<BuildStatus> future_;
+    std::shared_ptr<BuildControl>   control_;
+    VolumeHandle                    volume_;
+};
+
+template <typename Rep, typename Period>
+auto BuildHandle::wait_for(std::chrono::duration<Rep, Period> const& duration) const -> bool {
+    return future_.wait_for(duration) == std::future_status::ready;
+}
+
+} // namespace ltb::dvh
@@ -53,6 +53,17 @@ auto children_cells(glm::ivec3 const& cell) -> std::vector<glm::ivec3> {
     };
 }
 
+TEST_CASE("child_index and child_cell match children_cells [dvh]") {
+    for (auto const& parent : {glm::ivec3(0, 0, 0), glm::ivec3(-1, 2, -3), glm::ivec3(-4, -5, 6)}) {
+        auto children = children_cells(parent);
+
+        for (auto i = 0ul; i < children.size(); ++i) {
+            CHECK(child_index(children[i]) == static_cast<int>(i));
+            CHECK(child_cell(parent, static_cast<int>(i)) == children[i]);
+        }
+    }
+}
+
 TEST_CASE("parent_cell 2d around origin [dvh]") {
     CHECK(parent_cell<2>({0, 0}) == glm::ivec2{0, 0});
     CHECK(parent_cell<2>({1, 0}) == glm::ivec2{0, 0});
@@ -43,6 +43,31 @@ auto parent_cell(glm::vec<L, int> const& cell) -> glm::vec<L, int> {
 template <int L>
 auto children_cells(glm::vec<L, int> const& cell) -> std::vector<glm::vec<L, int>>;
 
+/**
+ * @brief The index of 'cell' in 'children_cells(parent_cell(cell))'.
+ */
+template <int L>
+auto child_index(glm::vec<L, int> const& cell) -> int {
+    auto offset = cell - parent_cell(cell) * 2;
+    auto index  = 0;
+    for (int i = 0; i < L; ++i) {
+        index |= offset[i] << i;
+    }
+    return index;
+}
+
+/**
+ * @brief The same cell as 'children_cells(parent)[index]'.
+ */
+template <int L>
+auto child_cell(glm::vec<L, int> const& parent, int index) -> glm::vec<L, int> {
+    auto child = parent * 2;
+    for (int i = 0; i < L; ++i) {
+        child[i] += (index >> i) & 1;
+    }
+    return child;
+}
+
 template <int L, typename T>
 auto cell_center(glm::vec<L, int> const& cell, const T& resolution) -> glm::vec<L, T> {
     return (glm::vec<L, T>(cell) + glm::vec<L, T>(0.5)) * resolution;
@@ -0,0 +1,145 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "ltb/dvh/volume_operation.hpp"
+
+// standard
+#include <vector>
+
+namespace ltb::dvh {
+
+/**
+ * @brief An ordered list of additive and subtractive operations that are applied together.
+ *
+ * The whole batch is applied in one traversal of the hierarchy. Every visited cell applies the
+ * operations that reach it in order (with the same result as separate edits), and operations whose
+ * bounds don't overlap a subtree are dropped from it, so many small edits cost about one walk
+ * instead of one per edit.
+ *
+ * Example:
+ *
+ *     ltb::dvh::EditBatch<3> batch;
+ *     for (auto const& box : boxes) {
+ *         batch.add_volume(std::vector{box});
+ *     }
+ *     batch.subtract_volumes(lines);
+ *
+ *     auto volumes = dvh.apply(std::move(batch)); // one traversal for all operations
+ */
+template <int L, typename T = float>
+class EditBatch {
+public:
+    /**
+     * @tparam Geometry - Must be derived from sdf::Geometry<L, T>.
+     */
+    template <typename Geometry>
+    auto add_volume(std::vector<Geometry> geometries) -> EditBatch&;
+
+    template <typename Geometry>
+    auto subtract_volumes(std::vector<Geometry> geometries) -> EditBatch&;
+
+    template <typename Geometry>
+    auto intersect_volumes(std::vector<Geometry> geometries) -> EditBatch&;
+
+    auto add_volume(sdf::csg::Expression<L, T> expression) -> EditBatch&;
+    auto subtract_volumes(sdf::csg::Expression<L, T> expression) -> EditBatch&;
+    auto intersect_volumes(sdf::csg::Expression<L, T> expression) -> EditBatch&;
+
+    auto add_operation(VolumeOperation<L, T> operation) -> EditBatch&;
+
+    auto operations() const -> std::vector<VolumeOperation<L, T>> const&;
+
+    /**
+     * @brief Moves the operations out of the batch.
+     */
+    auto release() && -> std::vector<VolumeOperation<L, T>>;
+
+    auto size() const -> std::size_t;
+    auto empty() const -> bool;
+
+private:
+    std::vector<VolumeOperation<L, T>> operations_;
+};
+
+template <int L, typename T>
+template <typename Geometry>
+auto EditBatch<L, T>::add_volume(std::vector<Geometry> geometries) -> EditBatch& {
+    return add_operation(make_volume_operation<L, T>(VolumeOperationType::Add, std::move(geometries)));
+}
+
+template <int L, typename T>
+template <typename Geometry>
+auto EditBatch<L, T>::subtract_volumes(std::vector<Geometry> geometries) -> EditBatch& {
+    return add_operation(make_volume_operation<L, T>(VolumeOperationType::Subtract, std::move(geometries)));
+}
+
+template <int L, typename T>
+template <typename Geometry>
+auto EditBatch<L, T>::intersect_volumes(std::vector<Geometry> geometries) -> EditBatch& {
+    return add_operation(make_volume_operation<L, T>(VolumeOperationType::Intersect, std::move(geometries)));
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::add_volume(sdf::csg::Expression<L, T> expression) -> EditBatch& {
+    return add_operation(make_volume_operation<L, T>(VolumeOperationType::Add, std::move(expression)));
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::subtract_volumes(sdf::csg::Expression<L, T> expression) -> EditBatch& {
+    return add_operation(make_volume_operation<L, T>(VolumeOperationType::Subtract, std::move(expression)));
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::intersect_volumes(sdf::csg::Expression<L, T> expression) -> EditBatch& {
+    return add_operation(make_volume_operation<L, T>(VolumeOperationType::Intersect, std::move(expression)));
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::add_operation(VolumeOperation<L, T> operation) -> EditBatch& {
+    operations_.emplace_back(std::move(operation));
+    return *this;
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::operations() const -> std::vector<VolumeOperation<L, T>> const& {
+    return operations_;
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::release() && -> std::vector<VolumeOperation<L, T>> {
+    return std::move(operations_);
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::size() const -> std::size_t {
+    return operations_.size();
+}
+
+template <int L, typename T>
+auto EditBatch<L, T>::empty() const -> bool {
+    return operations_.empty();
+}
+
+} // namespace ltb::dvh
@@ -0,0 +1,875 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "frozen_hierarchy.hpp"
+
+// project
+#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+#include "ltb/dvh/impl/distance_volume_hierarchy_cpu.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ltb::dvh {
+
+template <int L, typename T>
+struct FrozenHierarchy<L, T>::Header {
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t dimensions;
+    std::uint32_t scalar_size;
+    std::uint32_t reserved;
+    double        base_resolution;
+    std::uint64_t num_cells;
+    std::uint64_t num_roots;
+    std::uint64_t num_nodes;
+    std::uint64_t num_children;
+    std::uint64_t roots_offset;
+    std::uint64_t nodes_offset;
+    std::uint64_t children_offset;
+};
+
+namespace {
+
+constexpr char frozen_magic[8] = {'L', 'T', 'B', 'F', 'D', 'V', 'H', '\0'};
+
+// Every section starts on an 8 byte boundary
+auto aligned(std::uint64_t offset) -> std::uint64_t {
+    return (offset + 7u) / 8u * 8u;
+}
+
+template <int L>
+auto cell_less(glm::vec<L, int> const& lhs, glm::vec<L, int> const& rhs) -> bool {
+    for (int i = 0; i < L; ++i) {
+        if (lhs[i] != rhs[i]) {
+            return lhs[i] < rhs[i];
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief The 'child_index' of the ancestor of 'cell' that is 'levels_up' levels above it.
+ *
+ * Dividing by two (rounding down) is a shift of the two's complement value so the index is made
+ * from bit 'levels_up' of every coordinate. This avoids computing the ancestors themselves.
+ */
+template <int L>
+auto ancestor_child_index(glm::vec<L, int> const& cell, int levels_up) -> int {
+    auto index = 0;
+    for (int i = 0; i < L; ++i) {
+        auto const bits = static_cast<std::uint32_t>(cell[i]);
+        auto const bit  = (levels_up < 32 ? (bits >> levels_up) & 1u : bits >> 31u);
+        index |= static_cast<int>(bit) << i;
+    }
+    return index;
+}
+
+/// 'value / 2' rounded down and up (bounds of a child in units of its parent's width)
+auto half_down(int value) -> int {
+    return value >= 0 ? value / 2 : -((1 - value) / 2);
+}
+
+auto half_up(int value) -> int {
+    return -half_down(-value);
+}
+
+/// A node's distance, child mask and child node indices
+using NodeKey = std::vector<std::uint32_t>;
+
+struct NodeKeyHash {
+    auto operator()(NodeKey const& key) const -> std::size_t {
+        auto hash = std::size_t(0);
+        for (auto const& value : key) {
+            hash ^= std::hash<std::uint32_t>{}(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+};
+
+} // namespace
+
+template <int L, typename T>
+FrozenHierarchy<L, T>::FrozenHierarchy(DistanceVolumeHierarchyCpu<L, T> const& hierarchy) {
+    static_assert(L <= 3, "Child masks only have room for eight children");
+
+    auto const& levels = hierarchy.levels();
+
+    std::vector<Node>          nodes;
+    std::vector<std::uint32_t> children;
+    std::vector<Root>          roots;
+    auto                       num_cells = std::uint64_t(0);
+
+    std::unordered_map<NodeKey, std::uint32_t, NodeKeyHash> unique_nodes;
+
+    // The node of every cell on the previous (finer) level and on the current level
+    std::unordered_map<Cell, std::uint32_t> child_nodes;
+    std::unordered_map<Cell, std::uint32_t> level_nodes;
+
+    // Half a cell diagonal in quantization steps, plus one step since distances are rounded
+    auto const half_diagonal = static_cast<int>(std::ceil(std::sqrt(T(L)) * T(quantization_steps) * T(0.5))) + 1;
+    auto const bound_limit   = int(not_fully_inside) - 1;
+
+    // Bounds only depend on the distance and the children (in units of the cell width), so nodes
+    // that are merged always have the same bounds
+    auto subtree_bounds = [&](std::int16_t distance, std::uint8_t mask, NodeKey const& node_key) {
+        auto min_distance = 0;
+        auto max_distance = 0;
+
+        if (distance != not_fully_inside) {
+            min_distance = distance - half_diagonal;
+            max_distance = distance + half_diagonal;
+
+        } else if (mask == 0u) {
+            min_distance = -2 * half_diagonal;
+            max_distance = int(not_fully_inside);
+
+        } else {
+            auto const all_children = (mask == (1u << (1 << L)) - 1u);
+
+            // Missing children are outside
+            min_distance = (all_children ? std::numeric_limits<int>::max() : 0);
+            max_distance = (all_children ? std::numeric_limits<int>::lowest() : int(not_fully_inside));
+
+            for (auto i = 2ul; i < node_key.size(); ++i) {
+                auto const& child = nodes[node_key[i]];
+
+                min_distance = std::min(min_distance,
+                                        child.min_distance == no_lower_bound ? int(no_lower_bound)
+                                                                             : half_down(child.min_distance));
+                max_distance = std::max(max_distance,
+                                        child.max_distance == not_fully_inside ? int(not_fully_inside)
+                                                                               : half_up(child.max_distance));
+            }
+        }
+
+        return std::pair(static_cast<std::int16_t>(min_distance < -bound_limit ? no_lower_bound : min_distance),
+                         static_cast<std::int16_t>(max_distance > bound_limit ? not_fully_inside : max_distance));
+    };
+
+    NodeKey key;
+
+    // Finest level first so identical children are already merged when their parents are compared
+    for (auto iter = levels.rbegin(); iter != levels.rend(); ++iter) {
+        auto const  level            = iter->first;
+        auto const& distance_field   = iter->second;
+        auto const  level_resolution = hierarchy.resolution(level);
+        auto const  parents          = levels.find(level + 1);
+
+        level_nodes.clear();
+        level_nodes.reserve(distance_field.size());
+
+        for (auto const& [cell, value] : distance_field) {
+            auto const distance = quantize(value[L], level_resolution);
+            auto const mask     = hierarchy.child_mask(level, cell);
+
+            key.clear();
+            key.emplace_back(static_cast<std::uint16_t>(distance));
+            key.emplace_back(mask);
+            for (auto i = 0; i < (1 << L); ++i) {
+                if (mask & (1u << i)) {
+                    key.emplace_back(child_nodes.at(child_cell(cell, i)));
+                }
+            }
+
+            auto [unique, inserted] = unique_nodes.try_emplace(key, static_cast<std::uint32_t>(nodes.size()));
+            if (inserted) {
+                auto const [min_distance, max_distance] = subtree_bounds(distance, mask, key);
+                nodes.push_back({distance,
+                                 min_distance,
+                                 max_distance,
+                                 mask,
+                                 static_cast<std::uint32_t>(children.size())});
+                children.insert(children.end(), key.begin() + 2, key.end());
+            }
+            level_nodes.emplace(cell, unique->second);
+
+            if (parents == levels.end() || parents->second.find(parent_cell(cell)) == parents->second.end()) {
+                roots.push_back({level, cell, unique->second});
+            }
+        }
+
+        num_cells += distance_field.size();
+        std::swap(child_nodes, level_nodes);
+    }
+
+    std::sort(roots.begin(), roots.end(), [](Root const& lhs, Root const& rhs) {
+        return lhs.level != rhs.level ? lhs.level < rhs.level : cell_less(lhs.cell, rhs.cell);
+    });
+
+    // Renumber the nodes breadth-first from the roots so the children of a node are next to each
+    // other and nodes of the same level are close together
+    constexpr auto unassigned = std::numeric_limits<std::uint32_t>::max();
+
+    std::vector<std::uint32_t> new_indices(nodes.size(), unassigned);
+    std::vector<std::uint32_t> order;
+    order.reserve(nodes.size());
+
+    auto visit = [&](std::uint32_t node) {
+        if (new_indices[node] == unassigned) {
+            new_indices[node] = static_cast<std::uint32_t>(order.size());
+            order.emplace_back(node);
+        }
+    };
+
+    for (auto const& root : roots) {
+        visit(root.node);
+    }
+    for (auto i = 0ul; i < order.size(); ++i) {
+        auto const& node        = nodes[order[i]];
+        auto const  num_visited = std::bitset<8>(node.child_mask).count();
+
+        for (auto c = 0ul; c < num_visited; ++c) {
+            visit(children[node.first_child + c]);
+        }
+    }
+
+    Header header          = {};
+    header.version         = format_version;
+    header.dimensions      = L;
+    header.scalar_size     = sizeof(T);
+    header.base_resolution = double(hierarchy.base_resolution());
+    header.num_cells       = num_cells;
+    header.num_roots       = roots.size();
+    header.num_nodes       = order.size();
+    header.num_children    = children.size();
+    header.roots_offset    = aligned(sizeof(Header));
+    header.nodes_offset    = aligned(header.roots_offset + header.num_roots * sizeof(Root));
+    header.children_offset = aligned(header.nodes_offset + header.num_nodes * sizeof(Node));
+    std::copy(std::begin(frozen_magic), std::end(frozen_magic), header.magic);
+
+    auto const size = aligned(header.children_offset + header.num_children * sizeof(std::uint32_t));
+
+    // Zero initialized so the padding is deterministic when the buffer is saved
+    auto  storage = std::make_shared<std::vector<std::uint64_t>>(size / sizeof(std::uint64_t));
+    auto* bytes   = reinterpret_cast<char*>(storage->data());
+
+    std::memcpy(bytes, &header, sizeof(Header));
+
+    auto* out_roots = reinterpret_cast<Root*>(bytes + header.roots_offset);
+    for (auto i = 0ul; i < roots.size(); ++i) {
+        out_roots[i].level = roots[i].level;
+        out_roots[i].cell  = roots[i].cell;
+        out_roots[i].node  = new_indices[roots[i].node];
+    }
+
+    auto* out_nodes    = reinterpret_cast<Node*>(bytes + header.nodes_offset);
+    auto* out_children = reinterpret_cast<std::uint32_t*>(bytes + header.children_offset);
+    auto  next_child   = std::uint32_t(0);
+
+    for (auto i = 0ul; i < order.size(); ++i) {
+        auto const& node         = nodes[order[i]];
+        auto const  num_children = std::bitset<8>(node.child_mask).count();
+
+        out_nodes[i].distance     = node.distance;
+        out_nodes[i].min_distance = node.min_distance;
+        out_nodes[i].max_distance = node.max_distance;
+        out_nodes[i].child_mask   = node.child_mask;
+        out_nodes[i].first_child  = next_child;
+
+        for (auto c = 0ul; c < num_children; ++c) {
+            out_children[next_child++] = new_indices[children[node.first_child + c]];
+        }
+    }
+
+    use_buffer(std::shared_ptr<void const>(storage, storage->data()), size);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::from_buffer(std::shared_ptr<void const> buffer, std::size_t size)
+    -> util::Result<FrozenHierarchy> {
+    if (auto valid = validate(buffer.get(), size); !valid) {
+        return tl::make_unexpected(valid.error());
+    }
+
+    FrozenHierarchy frozen;
+    frozen.use_buffer(std::move(buffer), size);
+    return frozen;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::map_file(std::string const& filename) -> util::Result<FrozenHierarchy> {
+#if defined(__unix__) || defined(__APPLE__)
+    auto file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to open: '" + filename + "'"));
+    }
+
+    struct stat file_info = {};
+    if (::fstat(file, &file_info) != 0 || file_info.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(file);
+        return tl::make_unexpected(LTB_MAKE_ERROR("Not a frozen hierarchy: '" + filename + "'"));
+    }
+
+    auto const size   = static_cast<std::size_t>(file_info.st_size);
+    auto*      memory = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file); // The mapping keeps the file open
+
+    if (memory == MAP_FAILED) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to map: '" + filename + "'"));
+    }
+
+    auto buffer = std::shared_ptr<void const>(memory, [size](void const* mapped) {
+        ::munmap(const_cast<void*>(mapped), size);
+    });
+    return from_buffer(std::move(buffer), size);
+#else
+    // No memory mapping so the file is read into an aligned buffer instead
+    std::ifstream input_stream(filename, std::ios::binary | std::ios::ate);
+    if (!input_stream.is_open()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to open: '" + filename + "'"));
+    }
+
+    auto const size    = static_cast<std::size_t>(input_stream.tellg());
+    auto       storage = std::make_shared<std::vector<std::uint64_t>>(aligned(size) / sizeof(std::uint64_t));
+    input_stream.seekg(0);
+    input_stream.read(reinterpret_cast<char*>(storage->data()), static_cast<std::streamsize>(size));
+
+    return from_buffer(std::shared_ptr<void const>(storage, storage->data()), size);
+#endif
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::save(std::string const& filename) const -> util::Result<void> {
+    std::ofstream output_stream(filename, std::ios::binary);
+    if (!output_stream.is_open()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to open: '" + filename + "'"));
+    }
+
+    output_stream.write(static_cast<char const*>(data()), static_cast<std::streamsize>(size_));
+    if (!output_stream) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to write: '" + filename + "'"));
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::find(int level, Cell const& cell) const -> std::optional<T> {
+    auto const [node, node_level] = find_deepest(level, cell);
+
+    if (!node || node_level != level) {
+        return std::nullopt;
+    }
+    return dequantize(node->distance, level);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::distance_at(glm::vec<L, T> const& point) const -> T {
+    auto const level = DistanceVolumeHierarchyCpu<L, T>::base_level;
+
+    auto const [node, node_level] = find_deepest(level, get_cell(point, resolution(level)));
+
+    if (!node) {
+        return std::numeric_limits<T>::infinity();
+    }
+    return dequantize(node->distance, node_level);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::bounds(int level, Cell const& cell) const -> std::optional<DistanceBounds> {
+    auto const [node, node_level] = find_deepest(level, cell);
+
+    if (!node || node_level != level) {
+        return std::nullopt;
+    }
+    return dequantize_bounds(*node, level);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::cells_in_range(T min_distance, T max_distance) const -> std::vector<std::pair<int, Cell>> {
+    struct Visit {
+        std::uint32_t node;
+        int           level;
+        Cell          cell;
+    };
+
+    std::vector<std::pair<int, Cell>> cells;
+    std::vector<Visit>                to_visit;
+
+    for (auto const& root : roots_) {
+        to_visit.push_back({root.node, root.level, root.cell});
+    }
+
+    while (!to_visit.empty()) {
+        auto const visit = to_visit.back();
+        to_visit.pop_back();
+
+        auto const& node   = nodes_[visit.node];
+        auto const  bounds = dequantize_bounds(node, visit.level);
+
+        if (bounds.max < min_distance || bounds.min > max_distance) {
+            continue;
+        }
+
+        if (node.child_mask == 0u) {
+            cells.emplace_back(visit.level, visit.cell);
+            continue;
+        }
+
+        auto next_child = node.first_child;
+        for (auto i = 0; i < (1 << L); ++i) {
+            if (node.child_mask & (1u << i)) {
+                to_visit.push_back({children_[next_child++], visit.level - 1, child_cell(visit.cell, i)});
+            }
+        }
+    }
+
+    return cells;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::nodes() const -> Section<Node> {
+    return nodes_;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::children() const -> Section<std::uint32_t> {
+    return children_;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::roots() const -> Section<Root> {
+    return roots_;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::base_resolution() const -> T {
+    return T(header_->base_resolution);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::resolution(int level_index) const -> T {
+    return base_resolution() * std::pow<T>(2, level_index);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::num_cells() const -> std::size_t {
+    return header_->num_cells;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::data() const -> void const* {
+    return buffer_.get();
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::memory_size() const -> std::size_t {
+    return size_;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::validate(void const* buffer, std::size_t size) -> util::Result<void> {
+    if (reinterpret_cast<std::uintptr_t>(buffer) % alignof(std::uint64_t) != 0u) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Frozen hierarchy buffers must be aligned to 8 bytes"));
+    }
+    if (size < sizeof(Header)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Buffer is too small for a frozen hierarchy"));
+    }
+
+    Header header;
+    std::memcpy(&header, buffer, sizeof(Header));
+
+    if (!std::equal(std::begin(frozen_magic), std::end(frozen_magic), header.magic)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Buffer does not contain a frozen hierarchy"));
+    }
+    if (header.version != format_version) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Unsupported frozen hierarchy version: "
+                                                  + std::to_string(header.version)));
+    }
+    if (header.dimensions != L || header.scalar_size != sizeof(T)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Frozen hierarchy has a different dimension or scalar type"));
+    }
+
+    auto fits = [size](std::uint64_t offset, std::uint64_t count, std::size_t element_size) {
+        return offset % alignof(std::uint64_t) == 0u && offset <= size && count <= (size - offset) / element_size;
+    };
+
+    if (!fits(header.roots_offset, header.num_roots, sizeof(Root))
+        || !fits(header.nodes_offset, header.num_nodes, sizeof(Node))
+        || !fits(header.children_offset, header.num_children, sizeof(std::uint32_t))) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Frozen hierarchy sections don't fit in the buffer"));
+    }
+
+    // Queries index the sections with these without checking them again
+    auto const* bytes    = static_cast<char const*>(buffer);
+    auto const* roots    = reinterpret_cast<Root const*>(bytes + header.roots_offset);
+    auto const* nodes    = reinterpret_cast<Node const*>(bytes + header.nodes_offset);
+    auto const* children = reinterpret_cast<std::uint32_t const*>(bytes + header.children_offset);
+
+    auto invalid_index = [] { return tl::make_unexpected(LTB_MAKE_ERROR("Frozen hierarchy has invalid indices")); };
+
+    for (auto i = 0ul; i < header.num_roots; ++i) {
+        if (roots[i].node >= header.num_nodes) {
+            return invalid_index();
+        }
+    }
+
+    constexpr auto valid_children = std::uint32_t((1u << (1u << L)) - 1u);
+
+    for (auto i = 0ul; i < header.num_nodes; ++i) {
+        auto const& node         = nodes[i];
+        auto const  num_children = std::bitset<8>(node.child_mask).count();
+
+        if ((node.child_mask & ~valid_children) != 0u || node.first_child > header.num_children
+            || num_children > header.num_children - node.first_child) {
+            return invalid_index();
+        }
+    }
+    for (auto i = 0ul; i < header.num_children; ++i) {
+        if (children[i] >= header.num_nodes) {
+            return invalid_index();
+        }
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::use_buffer(std::shared_ptr<void const> buffer, std::size_t size) -> void {
+    buffer_ = std::move(buffer);
+    size_   = size;
+
+    auto const* bytes = static_cast<char const*>(buffer_.get());
+
+    header_   = reinterpret_cast<Header const*>(bytes);
+    roots_    = {reinterpret_cast<Root const*>(bytes + header_->roots_offset), header_->num_roots};
+    nodes_    = {reinterpret_cast<Node const*>(bytes + header_->nodes_offset), header_->num_nodes};
+    children_ = {reinterpret_cast<std::uint32_t const*>(bytes + header_->children_offset), header_->num_children};
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::find_root(int level, Cell const& cell) const -> Root const* {
+    auto is_before = [level, &cell](Root const& root, int) {
+        return root.level != level ? root.level < level : cell_less(root.cell, cell);
+    };
+    auto iter = std::lower_bound(roots_.begin(), roots_.end(), level, is_before);
+
+    if (iter == roots_.end() || iter->level != level || iter->cell != cell) {
+        return nullptr;
+    }
+    return iter;
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::child(Node const& node, int index) const -> Node const* {
+    if (!(node.child_mask & (1u << index))) {
+        return nullptr;
+    }
+    // Only existing children are stored so the offset is the number of existing children before it
+    auto const offset = std::bitset<8>(node.child_mask & ((1u << index) - 1u)).count();
+    return &nodes_[children_[node.first_child + offset]];
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::find_deepest(int level, Cell const& cell) const -> std::pair<Node const*, int> {
+    if (roots_.size() == 0u) {
+        return {nullptr, level};
+    }
+
+    auto const top_level = roots_[roots_.size() - 1u].level;
+    auto       ancestor  = cell;
+
+    // Roots don't have parents so the first root found on the way up is the only one above 'cell'
+    for (auto root_level = level; root_level <= top_level; ++root_level) {
+        if (auto const* root = find_root(root_level, ancestor)) {
+            auto const* node       = &nodes_[root->node];
+            auto        node_level = root_level;
+
+            while (node_level > level) {
+                auto const* next = child(*node, ancestor_child_index(cell, node_level - level - 1));
+                if (!next) {
+                    break;
+                }
+                node = next;
+                --node_level;
+            }
+            return {node, node_level};
+        }
+        ancestor = parent_cell(ancestor);
+    }
+    return {nullptr, level};
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::quantize(T distance, T resolution) -> std::int16_t {
+    if (distance == DistanceVolumeHierarchyCpu<L, T>::not_fully_inside) {
+        return not_fully_inside;
+    }
+    // Anything further than ~128 cells away is clamped, which is far more than any cell stores
+    auto const limit = T(not_fully_inside - 1);
+    auto const steps = std::round(distance / resolution * T(quantization_steps));
+    return static_cast<std::int16_t>(std::clamp(steps, -limit, limit));
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::dequantize(std::int16_t distance, int level) const -> T {
+    if (distance == not_fully_inside) {
+        return DistanceVolumeHierarchyCpu<L, T>::not_fully_inside;
+    }
+    return T(distance) * resolution(level) / T(quantization_steps);
+}
+
+template <int L, typename T>
+auto FrozenHierarchy<L, T>::dequantize_bounds(Node const& node, int level) const -> DistanceBounds {
+    auto const min_distance = (node.min_distance == no_lower_bound ? -std::numeric_limits<T>::infinity()
+                                                                    : dequantize(node.min_distance, level));
+    return {min_distance, dequantize(node.max_distance, level)};
+}
+
+template class FrozenHierarchy<2, float>;
+template class FrozenHierarchy<3, float>;
+template class FrozenHierarchy<2, double>;
+template class FrozenHierarchy<3, double>;
+
+namespace {
+
+// A plate with a regular pattern of identical holes that are aligned with the cells
+auto make_drilled_plate(DistanceVolumeHierarchyCpu<3, float>* dvh) -> void {
+    auto const spacing = dvh->resolution(3);
+
+    dvh->add_volume(std::vector{sdf::make_box<3>({spacing * 8.f, spacing * 8.f, spacing})});
+
+    std::vector<sdf::OffsetLine<3>> holes;
+    for (int x = -3; x < 4; ++x) {
+        for (int y = -3; y < 4; ++y) {
+            auto const center = glm::vec3(x, y, 0.f) * spacing;
+            holes.emplace_back(sdf::make_offset_line<3>(center - glm::vec3(0.f, 0.f, spacing * 2.f),
+                                                        center + glm::vec3(0.f, 0.f, spacing * 2.f),
+                                                        spacing * 0.3f));
+        }
+    }
+    dvh->subtract_volumes(holes);
+}
+
+} // namespace
+
+TEST_CASE("[dvh] frozen hierarchies share identical subtrees") {
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.05f);
+    make_drilled_plate(&dvh);
+
+    FrozenHierarchy<3, float> frozen(dvh);
+
+    auto num_cells = 0ul;
+    for (auto const& [level, cells] : dvh.levels()) {
+        num_cells += cells.size();
+    }
+    CHECK(frozen.num_cells() == num_cells);
+    CHECK(frozen.nodes().size() * 10ul < num_cells);
+}
+
+TEST_CASE("[dvh] frozen hierarchy queries match the hierarchy") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.05f);
+    make_drilled_plate(&dvh);
+    dvh.subtract_volumes(std::vector{sdf::make_offset_line<3>({-1.f, -2.f, 0.3f}, {2.f, 1.f, 0.f}, 0.17f)});
+
+    auto const& levels = dvh.levels();
+
+    auto check_queries = [&](FrozenHierarchy<3, float> const& frozen) {
+        for (auto const& [level, cells] : levels) {
+            auto const tolerance = dvh.resolution(level) / float(FrozenHierarchy<3, float>::quantization_steps);
+
+            for (auto const& [cell, value] : cells) {
+                auto const distance = frozen.find(level, cell);
+                REQUIRE(distance);
+
+                if (value[3] == Dvh::not_fully_inside) {
+                    CHECK(*distance == Dvh::not_fully_inside);
+                } else {
+                    CHECK(std::abs(*distance - value[3]) <= tolerance);
+                }
+            }
+        }
+        CHECK_FALSE(frozen.find(Dvh::base_level, {1000, 0, 0}));
+
+        // The finest cell containing the center of every finest cell
+        for (auto const& [cell, value] : levels.at(Dvh::base_level)) {
+            auto const point = cell_center(cell, dvh.base_resolution());
+
+            auto expected = Dvh::not_fully_inside;
+            for (auto iter = levels.rbegin(); iter != levels.rend(); ++iter) {
+                auto const& level_cells = iter->second;
+                auto const  found       = level_cells.find(get_cell(point, dvh.resolution(iter->first)));
+
+                if (found != level_cells.end()) {
+                    expected = found->second[3];
+                    break;
+                }
+            }
+
+            auto const distance = frozen.distance_at(point);
+            if (expected == Dvh::not_fully_inside) {
+                CHECK(distance == Dvh::not_fully_inside);
+            } else {
+                CHECK(std::abs(distance - expected) <= dvh.base_resolution());
+            }
+        }
+    };
+
+    auto const frozen = dvh.freeze();
+    check_queries(frozen);
+
+    // Breadth-first order puts the children of consecutive nodes next to each other
+    auto expected_first_child = 0u;
+    for (auto const& node : frozen.nodes()) {
+        CHECK(node.first_child == expected_first_child);
+        expected_first_child += static_cast<unsigned>(std::bitset<8>(node.child_mask).count());
+    }
+    CHECK(expected_first_child == frozen.children().size());
+
+    SUBCASE("Saved hierarchies can be mapped back from disk") {
+        auto const filename = (std::filesystem::temp_directory_path() / "ltb_dvh_frozen_test.bin").string();
+        REQUIRE(frozen.save(filename));
+
+        auto mapped = FrozenHierarchy<3, float>::map_file(filename);
+        REQUIRE(mapped);
+        CHECK(mapped->memory_size() == frozen.memory_size());
+        CHECK(mapped->num_cells() == frozen.num_cells());
+        check_queries(*mapped);
+
+        std::filesystem::remove(filename);
+    }
+
+    SUBCASE("Buffers of other hierarchy types are rejected") {
+        auto const other  = DistanceVolumeHierarchyCpu<2, float>(0.05f).freeze();
+        auto const buffer = std::shared_ptr<void const>(other.data(), [](void const*) {});
+
+        CHECK_FALSE(FrozenHierarchy<3, float>::from_buffer(buffer, other.memory_size()));
+        CHECK(FrozenHierarchy<2, float>::from_buffer(buffer, other.memory_size()));
+        CHECK_FALSE(FrozenHierarchy<2, float>::from_buffer(buffer, 16u));
+    }
+
+    SUBCASE("Buffers with indices outside of their sections are rejected") {
+        auto const* bytes = static_cast<char const*>(frozen.data());
+
+        // Offsets of a value inside the buffer, so the copy can be corrupted in the same place
+        auto offset_of = [bytes](void const* value) {
+            return static_cast<std::size_t>(static_cast<char const*>(value) - bytes);
+        };
+        auto corrupt = [&](std::size_t offset, std::uint32_t value) {
+            auto storage = std::make_shared<std::vector<std::uint64_t>>(frozen.memory_size() / sizeof(std::uint64_t));
+            std::memcpy(storage->data(), bytes, frozen.memory_size());
+            std::memcpy(reinterpret_cast<char*>(storage->data()) + offset, &value, sizeof(value));
+            return FrozenHierarchy<3, float>::from_buffer(std::shared_ptr<void const>(storage, storage->data()),
+                                                          frozen.memory_size());
+        };
+
+        auto const num_nodes    = static_cast<std::uint32_t>(frozen.nodes().size());
+        auto const num_children = static_cast<std::uint32_t>(frozen.children().size());
+        REQUIRE(frozen.children().size() > 0u);
+
+        CHECK(corrupt(offset_of(&frozen.roots()[0].node), num_nodes - 1u));
+        CHECK_FALSE(corrupt(offset_of(&frozen.roots()[0].node), num_nodes));
+        CHECK_FALSE(corrupt(offset_of(&frozen.children()[0]), num_nodes));
+        CHECK_FALSE(corrupt(offset_of(&frozen.nodes()[0].first_child), num_children));
+        CHECK_FALSE(corrupt(offset_of(&frozen.nodes()[0].first_child), ~0u));
+    }
+}
+
+TEST_CASE("[dvh] frozen hierarchy bounds contain every distance below them") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.05f);
+    make_drilled_plate(&dvh);
+    dvh.subtract_volumes(std::vector{sdf::make_offset_line<3>({-1.f, -2.f, 0.3f}, {2.f, 1.f, 0.f}, 0.17f)});
+
+    auto const  frozen = dvh.freeze();
+    auto const& levels = dvh.levels();
+
+    // The bounds of a single cell, ignoring its children
+    auto cell_bounds = [&](int level, float distance) -> FrozenHierarchy<3, float>::DistanceBounds {
+        auto const half_diagonal = std::sqrt(3.f) * 0.5f * dvh.resolution(level);
+        if (distance == Dvh::not_fully_inside) {
+            return {-2.f * half_diagonal, Dvh::not_fully_inside};
+        }
+        return {distance - half_diagonal, distance + half_diagonal};
+    };
+
+    std::vector<std::pair<int, glm::ivec3>> expected_cells;
+    auto                                    num_leaves = 0ul;
+
+    auto const min_distance = -0.5f * dvh.base_resolution();
+    auto const max_distance = 0.5f * dvh.base_resolution();
+
+    for (auto const& [level, cells] : levels) {
+        for (auto const& [cell, value] : cells) {
+            auto const bounds = frozen.bounds(level, cell);
+            REQUIRE(bounds);
+
+            // Cells that are not fully inside get tighter bounds from their children
+            auto const own      = cell_bounds(level, value[3]);
+            auto const is_leaf  = (dvh.child_mask(level, cell) == 0u);
+            auto const is_known = (value[3] != Dvh::not_fully_inside || is_leaf);
+
+            if (is_known) {
+                CHECK(bounds->min <= own.min + 1e-5f);
+                CHECK(bounds->max >= own.max - 1e-5f);
+            }
+
+            if (auto const parent = frozen.bounds(level + 1, parent_cell(cell))) {
+                CHECK(parent->min <= bounds->min);
+                CHECK(parent->max >= bounds->max);
+            }
+
+            if (is_leaf) {
+                ++num_leaves;
+                if (own.max >= min_distance && own.min <= max_distance) {
+                    expected_cells.emplace_back(level, cell);
+                }
+            }
+        }
+    }
+    CHECK_FALSE(frozen.bounds(Dvh::base_level, {1000, 0, 0}));
+
+    // Only cells near the surface are returned, which includes every cell that reaches it
+    auto const cells = frozen.cells_in_range(min_distance, max_distance);
+    CHECK(cells.size() < num_leaves);
+
+    for (auto const& expected : expected_cells) {
+        CHECK(std::find(cells.begin(), cells.end(), expected) != cells.end());
+    }
+    for (auto const& [level, cell] : cells) {
+        auto const bounds = frozen.bounds(level, cell);
+        REQUIRE(bounds);
+        CHECK(bounds->max >= min_distance);
+        CHECK(bounds->min <= max_distance);
+    }
+}
+
+} // namespace ltb::dvh
@@ -0,0 +1,208 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "ltb/util/result.hpp"
+
+// external
+#include <glm/glm.hpp>
+
+// standard
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ltb::dvh {
+
+template <int L, typename T>
+class DistanceVolumeHierarchyCpu;
+
+/**
+ * @brief A read-only copy of a hierarchy where identical subtrees are stored once.
+ *
+ * Distances are quantized relative to the width of their cell so the same structure at different
+ * positions (hole patterns, pockets, large regions that are entirely inside) produces identical
+ * nodes. Identical nodes are merged ("hash-consed") from the finest level up, which turns the tree
+ * into a directed acyclic graph with shared subtrees.
+ *
+ * Every node only stores its quantized distance, which of its children exist and conservative
+ * bounds of the distance anywhere in its subtree. Nodes don't know their position, so queries
+ * descend from a root cell and track the cell on the way down. The bounds let range queries and
+ * ray casts reject whole subtrees at coarse levels, including the 'not_fully_inside' cells that
+ * have no usable distance of their own.
+ *
+ * Everything lives in one pointer-free buffer: a header followed by the roots, the nodes in
+ * breadth-first order and the child indices. The buffer can be saved and memory-mapped straight
+ * back (by several processes at once). It is never modified, so any number of threads can query
+ * the same hierarchy without synchronization.
+ */
+template <int L, typename T>
+class FrozenHierarchy {
+public:
+    using Cell = glm::vec<L, int>;
+
+    struct Node {
+        std::int16_t  distance;     ///< Distance in 1/quantization_steps of the cell width
+        std::int16_t  min_distance; ///< Lower bound anywhere in the subtree ('no_lower_bound' if unknown)
+        std::int16_t  max_distance; ///< Upper bound anywhere in the subtree ('not_fully_inside' if unknown)
+        std::uint8_t  child_mask;   ///< The existing children, indexed like 'children_cells'
+        std::uint32_t first_child;  ///< Index of the first child in 'children()'
+    };
+
+    /// The range of distances anywhere inside a cell
+    struct DistanceBounds {
+        T min;
+        T max;
+    };
+
+    /// A cell without a parent and the node at the top of its subtree
+    struct Root {
+        int           level;
+        Cell          cell;
+        std::uint32_t node;
+    };
+
+    /// A read-only array inside the buffer
+    template <typename V>
+    struct Section {
+        V const*    data  = nullptr;
+        std::size_t count = 0;
+
+        auto size() const -> std::size_t { return count; }
+        auto begin() const -> V const* { return data; }
+        auto end() const -> V const* { return data + count; }
+        auto operator[](std::size_t index) const -> V const& { return data[index]; }
+    };
+
+    /// Quantized distances are exact to half of a step (1/512 of the cell width)
+    constexpr static int          quantization_steps = 256;
+    constexpr static std::int16_t not_fully_inside   = std::numeric_limits<std::int16_t>::max();
+    constexpr static std::int16_t no_lower_bound     = std::numeric_limits<std::int16_t>::lowest();
+
+    /// Incremented whenever the buffer layout changes
+    constexpr static std::uint32_t format_version = 2u;
+
+    explicit FrozenHierarchy(DistanceVolumeHierarchyCpu<L, T> const& hierarchy);
+
+    /**
+     * @brief Uses a buffer created by another frozen hierarchy (see 'data()') without copying it.
+     *
+     * 'buffer' has to be aligned to 8 bytes and is kept alive by the hierarchy and its copies.
+     * Every root, node and child index is checked once here so queries never leave the buffer.
+     */
+    static auto from_buffer(std::shared_ptr<void const> buffer, std::size_t size) -> util::Result<FrozenHierarchy>;
+
+    /**
+     * @brief Memory-maps a file written by 'save'.
+     *
+     * Pages are shared with every other process mapping the same file. Apart from the index check
+     * of 'from_buffer', they are only read when they are queried.
+     */
+    static auto map_file(std::string const& filename) -> util::Result<FrozenHierarchy>;
+
+    auto save(std::string const& filename) const -> util::Result<void>;
+
+    /**
+     * @brief The (quantized) distance stored in 'cell' or std::nullopt if the cell doesn't exist.
+     */
+    auto find(int level, Cell const& cell) const -> std::optional<T>;
+
+    /**
+     * @brief The distance of the finest cell containing 'point'.
+     *
+     * @return 'not_fully_inside' (infinity) if the point is not entirely inside a cell.
+     */
+    auto distance_at(glm::vec<L, T> const& point) const -> T;
+
+    /**
+     * @brief Conservative bounds of the distance anywhere inside 'cell' and its descendants.
+     *
+     * Fully inside cells cover their distance plus or minus half a cell diagonal. Cells that are
+     * not fully inside have a surface within half a diagonal of their center, so their lower bound
+     * is one diagonal below zero and they have no upper bound. Missing children are outside (at
+     * least zero, no upper bound). Parents combine the bounds of their children, which makes the
+     * bounds of coarse cells usable even though they store 'not_fully_inside'.
+     *
+     * @return std::nullopt if the cell doesn't exist.
+     */
+    auto bounds(int level, Cell const& cell) const -> std::optional<DistanceBounds>;
+
+    /**
+     * @brief Every cell without children whose bounds overlap ['min_distance', 'max_distance'].
+     *
+     * Subtrees are skipped as soon as their bounds are outside of the range, so asking for the
+     * cells near the surface (for example [-d, d]) doesn't visit anything deep inside the volume.
+     * The bounds are conservative so a few returned cells may not reach the range themselves.
+     */
+    auto cells_in_range(T min_distance, T max_distance) const -> std::vector<std::pair<int, Cell>>;
+
+    auto nodes() const -> Section<Node>;
+    auto children() const -> Section<std::uint32_t>;
+    auto roots() const -> Section<Root>; ///< Sorted by level (finest first), then cell
+
+    auto base_resolution() const -> T;
+    auto resolution(int level_index) const -> T;
+
+    /**
+     * @brief The number of cells represented, which is the number of nodes without sharing.
+     */
+    auto num_cells() const -> std::size_t;
+
+    auto data() const -> void const*;
+    auto memory_size() const -> std::size_t; ///< The size of 'data()' in bytes
+
+private:
+    struct Header;
+
+    std::shared_ptr<void const> buffer_;
+    std::size_t                 size_   = 0;
+    Header const*               header_ = nullptr;
+
+    Section<Root>          roots_;
+    Section<Node>          nodes_;
+    Section<std::uint32_t> children_;
+
+    FrozenHierarchy() = default;
+
+    static auto validate(void const* buffer, std::size_t size) -> util::Result<void>;
+    auto        use_buffer(std::shared_ptr<void const> buffer, std::size_t size) -> void;
+
+    auto find_root(int level, Cell const& cell) const -> Root const*;
+    auto child(Node const& node, int index) const -> Node const*;
+
+    /**
+     * @brief The deepest existing node on the way from a root down to 'cell' and its level.
+     */
+    auto find_deepest(int level, Cell const& cell) const -> std::pair<Node const*, int>;
+
+    static auto quantize(T distance, T resolution) -> std::int16_t;
+    auto        dequantize(std::int16_t distance, int level) const -> T;
+    auto        dequantize_bounds(Node const& node, int level) const -> DistanceBounds;
+};
+
+} // namespace ltb::dvh
@@ -24,118 +24,34 @@
 
 // project
 #include "distance_volume_hierarchy_cpu.hpp"
-#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+#include "ltb/dvh/volume_operation.hpp"
 
 namespace ltb {
 namespace dvh {
 
 template <int L, typename T>
 template <typename Geometry>
-void DistanceVolumeHierarchyCpu<L, T>::add_volume(std::vector<Geometry> const& geometries) {
+auto DistanceVolumeHierarchyCpu<L, T>::queue_add_volume(std::vector<Geometry> geometries) -> VolumeHandle {
+    wait_for_builds();
 
-    if (geometries.empty()) {
-        return;
-    }
-
-    auto volume_bounds = sdf::AABB<L, T>();
-
-    for (auto const& geometry : geometries) {
-        auto aabb     = geometry.bounding_box();
-        volume_bounds = sdf::expand(volume_bounds, aabb.min_point);
-        volume_bounds = sdf::expand(volume_bounds, aabb.max_point);
-    }
-
-    add_roots_for_bounds(volume_bounds);
-
-    // ///////////////////////////////////////////////// //
-
-    CellSet to_visit;
-    CellSet cells;
-    CellSet children_to_remove;
-    CellSet to_remove;
-
-    for (int level = roots_.begin()->first; level >= lowest_level_; --level) {
-
-        auto& distance_field = levels_[level];
-
-        std::swap(to_remove, children_to_remove);
-
-        for (const auto& cell_to_remove : to_remove) {
-            distance_field.erase(cell_to_remove);
-
-            auto children = children_cells(cell_to_remove);
-            children_to_remove.insert(std::make_move_iterator(children.begin()),
-                                      std::make_move_iterator(children.end()));
-        }
-        to_remove.clear();
-
-        std::swap(cells, to_visit);
-
-        if (roots_.find(level) != roots_.end()) {
-            auto const& root_cells = roots_.at(level);
-            cells.insert(root_cells.begin(), root_cells.end());
-        }
-
-        auto level_resolution = resolution(level);
-        auto half_resolution  = level_resolution * T(0.5);
-        auto cell_corner_dist = glm::length(glm::vec<L, T>(half_resolution));
-
-        for (const auto& cell : cells) {
-            auto const p = dvh::cell_center(cell, level_resolution);
-
-            auto min_dist     = std::numeric_limits<T>::infinity();
-            auto min_abs_dist = min_dist;
-
-            for (auto const& geometry : geometries) {
-                auto const dist     = geometry.distance_from(p);
-                auto const abs_dist = std::abs(dist);
-
-                if (should_replace_with(min_abs_dist, abs_dist, dist)) {
-                    min_dist     = dist;
-                    min_abs_dist = abs_dist;
-                }
-            }
-
-            bool inside_volume = (min_dist < 0.f);
-
-            auto value_to_store
-                = (min_abs_dist <= cell_corner_dist ? DistanceVolumeHierarchyCpu<L, T>::not_fully_inside : min_dist);
-
-            if (value_to_store == DistanceVolumeHierarchyCpu<L, T>::not_fully_inside) {
-                // Cell may not be fully inside the volume, but it is close to the
-                // border so descendants might be inside the volume.
-
-                // Add if the cell does not already exist. If it does exist it is either an
-                // inside value we should not overwrite or it is already a 'not_fully_inside' value.
-                distance_field.emplace(cell, glm::vec<L + 1, T>(DistanceVolumeHierarchyCpu<L, T>::not_fully_inside));
-
-            } else if (inside_volume) {
-                // This is entirely contained by the volume
-
-                // Add/replace the cell if it doesn't exist or the current value contains a smaller distance
-                if (distance_field.find(cell) == distance_field.end()) {
-                    distance_field[cell] = glm::vec<L + 1, T>(p, value_to_store);
-                } else if (distance_field.at(cell)[L] > min_abs_dist) {
-                    auto old_dist        = distance_field.at(cell)[L];
-                    distance_field[cell] = glm::vec<L + 1, T>(p, value_to_store);
-
-                    if (old_dist == DistanceVolumeHierarchyCpu<L, T>::not_fully_inside) {
-                        auto children = children_cells(cell);
-                        children_to_remove.insert(std::make_move_iterator(children.begin()),
-                                                  std::make_move_iterator(children.end()));
-                    }
-                }
-            }
+    auto operation = make_volume_operation<L, T>(VolumeOperationType::Add, std::move(geometries));
+    auto volume    = record_volume(operation);
+    queued_operations_.emplace_back(volume.id(), std::move(operation));
+    return volume;
+}
 
-            if (distance_field.find(cell) != distance_field.end()
-                && distance_field.at(cell)[L] == DistanceVolumeHierarchyCpu<L, T>::not_fully_inside) {
+template <int L, typename T>
+template <typename Geometry>
+auto DistanceVolumeHierarchyCpu<L, T>::add_volume(std::vector<Geometry> const& geometries) -> VolumeHandle {
+    return apply_operation(make_volume_operation<L, T>(VolumeOperationType::Add, geometries));
+}
 
-                auto children = children_cells(cell);
-                to_visit.insert(std::make_move_iterator(children.begin()), std::make_move_iterator(children.end()));
-            }
-        }
-        cells.clear();
-    }
+template <int L, typename T>
+template <typename Geometry>
+auto DistanceVolumeHierarchyCpu<L, T>::add_volume_async(std::vector<Geometry> geometries, ProgressCallback on_progress)
+    -> BuildHandle {
+    return apply_operation_async(make_volume_operation<L, T>(VolumeOperationType::Add, std::move(geometries)),
+                                 std::move(on_progress));
 }
 
 } // namespace dvh
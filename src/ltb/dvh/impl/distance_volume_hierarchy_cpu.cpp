@@ -24,72 +24,4697 @@
 
 // project
 #include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+#include "ltb/dvh/snapshot.hpp"
+#include "ltb/sdf/sdf.hpp"
+#include "ltb/util/thread_pool.hpp"
 
 // external
 #include <doctest/doctest.h>
 
+// standard
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <utility>
+
 namespace ltb::dvh {
 
+namespace {
+
+/// Signed distances of the (translated) geometry of 'operation' at 'points'
+template <int L, typename T>
+auto evaluate_operation(VolumeOperation<L, T> const& operation,
+                        glm::vec<L, T> const*        points,
+                        std::size_t                  count,
+                        T*                           distances) -> void {
+    if (operation.translation == glm::vec<L, T>(0)) {
+        operation.evaluate(points, count, distances);
+        return;
+    }
+
+    std::vector<glm::vec<L, T>> geometry_points(count);
+    for (auto i = 0ul; i < count; ++i) {
+        geometry_points[i] = points[i] - operation.translation;
+    }
+    operation.evaluate(geometry_points.data(), count, distances);
+}
+
+} // namespace
+
 template <int L, typename T>
 DistanceVolumeHierarchyCpu<L, T>::DistanceVolumeHierarchyCpu(T base_resolution, int max_level)
     : base_resolution_(base_resolution), max_level_(max_level) {
     clear();
 }
 
+template <int L, typename T>
+DistanceVolumeHierarchyCpu<L, T>::~DistanceVolumeHierarchyCpu() {
+    last_build_.wait();
+}
+
 template <int L, typename T>
 void DistanceVolumeHierarchyCpu<L, T>::clear() {
+    if (changes_) {
+        for (auto const& [level, distance_field] : levels_) {
+            auto& original_cells = (*changes_)[level];
+            for (auto const& [cell, value] : distance_field) {
+                original_cells.try_emplace(cell, value);
+            }
+        }
+    }
     levels_.clear();
+    child_masks_.clear();
+    ++revision_;
+    if (narrow_band_) {
+        record_band_originals();
+        narrow_band_->cells.clear();
+    }
+    volumes_.clear();
+    unrecorded_bounds_ = {};
+    queued_operations_.clear();
+    active_operation_ = std::nullopt;
 }
 
 template <int L, typename T>
-auto DistanceVolumeHierarchyCpu<L, T>::levels() const -> LevelMap<SparseVolumeMap> const& {
-    return levels_;
+template <typename Func>
+auto DistanceVolumeHierarchyCpu<L, T>::for_each_child(int level, Cell const& cell, Func const& func) const -> void {
+    auto const mask = child_mask(level, cell);
+
+    for (auto i = 0; i < (1 << L); ++i) {
+        if (mask & (1u << i)) {
+            func(child_cell(cell, i));
+        }
+    }
 }
 
 template <int L, typename T>
-auto DistanceVolumeHierarchyCpu<L, T>::base_resolution() const -> T {
-    return base_resolution_;
+auto DistanceVolumeHierarchyCpu<L, T>::add_volume(sdf::csg::Expression<L, T> const& expression) -> VolumeHandle {
+    return apply_operation(make_volume_operation<L, T>(VolumeOperationType::Add, expression));
 }
 
 template <int L, typename T>
-auto DistanceVolumeHierarchyCpu<L, T>::resolution(int level_index) const -> T {
-    return base_resolution_ * std::pow<T>(2, level_index);
+auto DistanceVolumeHierarchyCpu<L, T>::subtract_volumes(sdf::csg::Expression<L, T> const& expression)
+    -> VolumeHandle {
+    return apply_operation(make_volume_operation<L, T>(VolumeOperationType::Subtract, expression));
 }
 
 template <int L, typename T>
-auto DistanceVolumeHierarchyCpu<L, T>::add_roots_for_bounds(const sdf::AABB<L, T>& aabb) -> void {
+auto DistanceVolumeHierarchyCpu<L, T>::intersect_volumes(sdf::csg::Expression<L, T> const& expression)
+    -> VolumeHandle {
+    return apply_operation(make_volume_operation<L, T>(VolumeOperationType::Intersect, expression));
+}
 
-    auto root_level = lowest_level_;
-    auto min_cell   = Cell();
-    auto max_cell   = Cell();
-    auto dimensions = Cell(std::numeric_limits<int>::max());
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::refine(std::chrono::steady_clock::duration budget) -> bool {
+    auto const deadline = std::chrono::steady_clock::now() + budget;
 
-    for (int level = root_level; level < max_level_; ++level) {
-        auto level_resolution = resolution(level);
+    wait_for_builds();
 
-        auto level_min_cell = get_cell(aabb.min_point, level_resolution);
-        auto level_max_cell = get_cell(aabb.max_point, level_resolution);
+    do {
+        if (!active_operation_) {
+            if (queued_operations_.empty()) {
+                break;
+            }
+            auto& [id, operation] = queued_operations_.front();
 
-        auto level_dimensions = level_max_cell - level_min_cell;
+            update_narrow_band(changed_region(operation), {{id, &operation}}, BandStart::Current);
+            active_operation_ = begin_operation(std::move(operation), false);
+            queued_operations_.pop_front();
+        }
 
-        if (level_dimensions == dimensions) {
-            break;
+        if (step(&*active_operation_, refine_chunk_size)) {
+            active_operation_ = std::nullopt;
         }
+    } while (std::chrono::steady_clock::now() < deadline);
 
-        root_level = level;
-        min_cell   = level_min_cell;
-        max_cell   = level_max_cell;
-        dimensions = level_dimensions;
+    return is_refined();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::remove_volume(VolumeHandle const& volume) -> bool {
+    wait_for_pending_work();
+
+    auto iter = volumes_.find(volume.id());
+    if (iter == volumes_.end()) {
+        return false;
+    }
+
+    auto const region = changed_region(iter->second.operation);
+    if (!can_replay(region)) {
+        return false;
     }
 
-    auto& roots = roots_[root_level];
+    auto removed = std::move(iter->second.operation);
+    volumes_.erase(iter);
 
-    iterate(min_cell, max_cell, [&roots](auto const& cell) { roots.emplace(cell); });
+    replay_region(region, {std::move(removed)});
+    return true;
 }
 
-template class DistanceVolumeHierarchyCpu<2, float>;
-template class DistanceVolumeHierarchyCpu<3, float>;
-template class DistanceVolumeHierarchyCpu<2, double>;
-template class DistanceVolumeHierarchyCpu<3, double>;
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::move_volume(VolumeHandle const& volume, glm::vec<L, T> const& translation)
+    -> bool {
+    wait_for_pending_work();
+
+    auto iter = volumes_.find(volume.id());
+    if (iter == volumes_.end()) {
+        return false;
+    }
+
+    auto moved        = iter->second.operation;
+    moved.translation = translation;
+
+    auto const region = sdf::expand(changed_region(iter->second.operation), changed_region(moved));
+    if (!can_replay(region)) {
+        return false;
+    }
+    auto previous = std::exchange(iter->second.operation, std::move(moved));
+
+    replay_region(region, {std::move(previous)});
+    return true;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::rebuild_region(sdf::AABB<L, T> const&             region,
+                                                      std::vector<VolumeOperation<L, T>> operations)
+    -> util::Result<std::vector<VolumeHandle>> {
+    wait_for_pending_work();
+
+    if (!can_replay(region)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Cells near the region weren't built by the recorded volumes"));
+    }
+
+    std::vector<VolumeHandle>          volumes;
+    std::vector<VolumeOperation<L, T>> replaced;
+
+    // Recorded volumes keep their handles and take the operation at the same position
+    auto record = volumes_.begin();
+    for (auto& operation : operations) {
+        if (record == volumes_.end()) {
+            volumes.emplace_back(record_volume(operation));
+        } else {
+            replaced.emplace_back(std::exchange(record->second, VolumeRecord{std::move(operation)}).operation);
+            volumes.emplace_back(record->first);
+            ++record;
+        }
+    }
+    for (; record != volumes_.end(); record = volumes_.erase(record)) {
+        replaced.emplace_back(std::move(record->second.operation));
+    }
+
+    replay_region(region, replaced);
+    return volumes;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::apply(EditBatch<L, T> batch) -> std::vector<VolumeHandle> {
+    wait_for_pending_work();
+
+    auto const operations = std::move(batch).release();
+
+    std::vector<VolumeHandle> volumes;
+
+    auto band_changes = sdf::AABB<L, T>{};
+    auto band_volumes = VolumeList{};
+
+    for (auto const& operation : operations) {
+        volumes.emplace_back(record_volume(operation));
+        band_volumes.emplace_back(volumes.back().id(), &operation);
+    }
+    for (auto const& operation : operations) {
+        band_changes = sdf::expand(band_changes, changed_region(operation));
+    }
+    update_narrow_band(band_changes, std::move(band_volumes), BandStart::Current);
+
+    // Separate edits add the roots of each volume right before applying it. The batch adds them all
+    // up front instead and hides the roots of later operations from earlier ones.
+    RootOwners       root_owners;
+    std::vector<int> top_levels;
+
+    auto top_level = lowest_level_ - 1;
+    for (auto i = 0ul; i < operations.size(); ++i) {
+        auto const& operation = operations[i];
+        auto const  bounds    = operation.world_bounds();
+
+        if (operation.type == VolumeOperationType::Add && !sdf::is_empty(bounds)) {
+            add_roots_for_bounds(bounds, &root_owners, i);
+        }
+
+        // The level 'begin_operation' would start the operation on
+        if (roots_.empty() || (sdf::is_empty(bounds) && operation.type != VolumeOperationType::Intersect)) {
+            top_levels.emplace_back(lowest_level_ - 1);
+        } else {
+            top_levels.emplace_back(roots_.begin()->first);
+        }
+        top_level = std::max(top_level, top_levels.back());
+    }
+
+    BatchFrontier frontier;
+    for (auto level = top_level; level >= lowest_level_; --level) {
+        apply_batch_level(operations, root_owners, top_levels, level, &frontier);
+    }
+    return volumes;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::apply_batch_level(std::vector<VolumeOperation<L, T>> const& operations,
+                                                         RootOwners const&                         root_owners,
+                                                         std::vector<int> const&                   top_levels,
+                                                         int                                       level,
+                                                         BatchFrontier*                            frontier) -> void {
+    // Make sure the level exists even if nothing is added to it
+    auto& distance_field = level_cells(level);
+
+    std::vector<sdf::AABB<L, T>> bounds;
+    std::vector<std::size_t>     intersections;
+
+    for (auto i = 0ul; i < operations.size(); ++i) {
+        bounds.emplace_back(operations[i].world_bounds());
+
+        if (operations[i].type == VolumeOperationType::Intersect && level <= top_levels[i]) {
+            intersections.emplace_back(i);
+        }
+    }
+
+    // Same as the pruning in 'gather_frontier'
+    auto reaches = [this, &bounds](std::size_t operation, int cell_level, Cell const& cell) {
+        return overlaps(bounds[operation], cell_level, cell) && (!domain_ || overlaps(*domain_, cell_level, cell));
+    };
+
+    // Every operation visits the roots it can see
+    if (auto roots = roots_.find(level); roots != roots_.end()) {
+        auto const level_resolution = resolution(level);
+        auto const parent_corner    = glm::length(glm::vec<L, T>(resolution(level + 1) * T(0.5)));
+
+        for (auto i = 0ul; i < operations.size(); ++i) {
+            if (level > top_levels[i] || sdf::is_empty(bounds[i])) {
+                continue;
+            }
+
+            auto visit_root = [&](Cell const& root) {
+                if (reaches(i, level, root) && is_root_visible(&root_owners, i, level, root)) {
+                    frontier->cells[root].push_back({i, VisitState::DoesNotMatter, true});
+                }
+            };
+
+            // Cells whose parent's bounding sphere touches the bounds are within its diameter of them
+            auto const min_cell = get_cell(bounds[i].min_point - T(2) * parent_corner, level_resolution);
+            auto const max_cell = get_cell(bounds[i].max_point + T(2) * parent_corner, level_resolution);
+
+            auto num_range_cells = 1.0;
+            for (auto d = 0; d < L; ++d) {
+                num_range_cells *= double(max_cell[d]) - double(min_cell[d]) + 1.0;
+            }
+
+            if (num_range_cells < double(roots->second.size())) {
+                iterate(min_cell, max_cell, [&](Cell const& cell) {
+                    if (roots->second.find(cell) != roots->second.end()) {
+                        visit_root(cell);
+                    }
+                });
+            } else {
+                for (auto const& root : roots->second) {
+                    visit_root(root);
+                }
+            }
+        }
+    }
+
+    // Cells that are removed without being visited: the children of cleared parents and, for
+    // intersections, every cell of the level
+    for (auto const& parent_and_operations : frontier->parents_to_clear) {
+        for_each_child(level + 1, parent_and_operations.first, [frontier](Cell const& child) {
+            frontier->cells.try_emplace(child);
+        });
+    }
+    if (!intersections.empty()) {
+        for (auto const& cell_and_value : distance_field) {
+            if (!domain_ || overlaps(*domain_, level, cell_and_value.first)) {
+                frontier->cells.try_emplace(cell_and_value.first);
+            }
+        }
+    }
+
+    std::vector<std::pair<Cell, std::vector<BatchVisit>>> cells;
+    cells.reserve(frontier->cells.size());
+
+    std::vector<std::size_t> offsets(operations.size() + 1u, 0u);
+
+    for (auto& [cell, visits] : frontier->cells) {
+        // A root the operation also reached through its parent is only visited once, with the
+        // parent's state (like 'gather_frontier')
+        std::stable_sort(visits.begin(), visits.end(), [](BatchVisit const& lhs, BatchVisit const& rhs) {
+            return lhs.operation < rhs.operation;
+        });
+        for (auto iter = visits.begin(); iter != visits.end() && std::next(iter) != visits.end();) {
+            if (iter->operation == std::next(iter)->operation) {
+                iter->root = true;
+                visits.erase(std::next(iter));
+            } else {
+                ++iter;
+            }
+        }
+
+        for (auto const& visit : visits) {
+            ++offsets[visit.operation + 1u];
+        }
+        cells.emplace_back(cell, std::move(visits));
+    }
+    frontier->cells.clear();
+
+    for (auto i = 0ul; i < operations.size(); ++i) {
+        offsets[i + 1u] += offsets[i];
+    }
+
+    // Each operation evaluates all of its cells together, in parallel
+    auto const level_resolution = resolution(level);
+
+    std::vector<glm::vec<L, T>> points(offsets.back());
+    std::vector<T>              distances(offsets.back());
+    std::vector<std::size_t>    slots;
+    slots.reserve(offsets.back());
+
+    auto next_slots = offsets;
+    for (auto const& [cell, visits] : cells) {
+        for (auto const& visit : visits) {
+            auto const slot = next_slots[visit.operation]++;
+            points[slot]    = dvh::cell_center(cell, level_resolution);
+            slots.emplace_back(slot);
+        }
+    }
+
+    // A flattened range of cells from one operation
+    struct CellRange {
+        std::size_t operation;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    std::vector<CellRange> ranges;
+    for (auto i = 0ul; i < operations.size(); ++i) {
+        for (auto begin = offsets[i]; begin < offsets[i + 1u]; begin += parallel_grain_size) {
+            ranges.push_back({i, begin, std::min(begin + parallel_grain_size, offsets[i + 1u])});
+        }
+    }
+
+    util::ThreadPool::shared().parallel_for(0, ranges.size(), [&](std::size_t r) {
+        auto const& range = ranges[r];
+        evaluate_operation(operations[range.operation],
+                           points.data() + range.begin,
+                           range.end - range.begin,
+                           distances.data() + range.begin);
+    });
+
+    // Then every cell applies the operations reaching it in order
+    auto const cell_corner_dist = glm::length(glm::vec<L, T>(level_resolution * T(0.5)));
+    auto const no_operation     = operations.size();
+
+    PendingOperation scratch;
+    scratch.level   = level;
+    scratch.batched = true;
+
+    BatchFrontier                  next;
+    std::vector<std::size_t> const no_clearing;
+
+    auto slot = slots.begin();
+    for (auto const& [cell, visits] : cells) {
+        auto const  cleared   = frontier->parents_to_clear.find(parent_cell(cell));
+        auto const& clearing  = (cleared != frontier->parents_to_clear.end() ? cleared->second : no_clearing);
+        auto const  in_domain = (!domain_ || overlaps(*domain_, level, cell));
+
+        auto visit        = visits.begin();
+        auto clear        = clearing.begin();
+        auto intersection = intersections.begin();
+
+        for (;;) {
+            auto const operation = std::min({visit != visits.end() ? visit->operation : no_operation,
+                                             clear != clearing.end() ? *clear : no_operation,
+                                             intersection != intersections.end() ? *intersection : no_operation});
+            if (operation == no_operation) {
+                break;
+            }
+
+            auto const existed = (distance_field.find(cell) != distance_field.end());
+
+            // 'remove_children'
+            if (clear != clearing.end() && *clear == operation) {
+                if (erase_cell(nullptr, level, cell)) {
+                    next.parents_to_clear[cell].push_back(operation);
+                }
+                ++clear;
+            }
+            if (intersection != intersections.end() && *intersection == operation) {
+                if (in_domain && !overlaps(bounds[operation], level, cell)) {
+                    erase_cell(nullptr, level, cell);
+                }
+                ++intersection;
+            }
+
+            if (visit == visits.end() || visit->operation != operation) {
+                continue;
+            }
+
+            // 'apply_cells'
+            auto state = visit->state;
+            if (state == VisitState::ExistingOnly) {
+                state = (existed || visit->root ? VisitState::DoesNotMatter : VisitState::ExistingOnly);
+            }
+
+            auto const& p        = points[*slot];
+            auto const  min_dist = distances[*slot];
+
+            if (state != VisitState::ExistingOnly) {
+                switch (operations[operation].type) {
+                case VolumeOperationType::Add:
+                    process_add(&scratch, distance_field, cell, p, min_dist, cell_corner_dist);
+                    break;
+                case VolumeOperationType::Subtract:
+                    process_subtract(&scratch, distance_field, cell, state, p, min_dist, cell_corner_dist);
+                    break;
+                case VolumeOperationType::Intersect:
+                    process_intersect(&scratch, distance_field, cell, state, p, min_dist, cell_corner_dist);
+                    break;
+                }
+            }
+            ++visit;
+            ++slot;
+
+            for (auto const& [child, child_state] : scratch.to_visit) {
+                if (level > lowest_level_ && reaches(operation, level - 1, child)) {
+                    next.cells[child].push_back({operation, child_state});
+                }
+            }
+            for (auto const& cleared_cell : scratch.parents_to_clear) {
+                next.parents_to_clear[cleared_cell].push_back(operation);
+            }
+            scratch.to_visit.clear();
+            scratch.parents_to_clear.clear();
+        }
+    }
+
+    *frontier = std::move(next);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::set_domain(std::optional<sdf::AABB<L, T>> domain) -> void {
+    wait_for_pending_work();
+    domain_ = std::move(domain);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::domain() const -> std::optional<sdf::AABB<L, T>> const& {
+    return domain_;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::compact() -> std::size_t {
+    wait_for_pending_work();
+
+    auto& thread_pool = util::ThreadPool::shared();
+    auto  reclaimed   = 0ul;
+
+    std::vector<Cell> cells;
+    std::vector<char> remove;
+
+    // Top-down so cells below a removed cell are removed in the same pass
+    for (auto& [level, distance_field] : levels_) {
+        auto parents_iter = levels_.find(level + 1);
+        if (parents_iter == levels_.end()) {
+            continue;
+        }
+        auto const& parents = parents_iter->second;
+
+        auto const  roots_iter = roots_.find(level);
+        auto const* roots      = (roots_iter == roots_.end() ? nullptr : &roots_iter->second);
+
+        cells.clear();
+        for (auto const& cell_and_value : distance_field) {
+            cells.emplace_back(cell_and_value.first);
+        }
+        remove.assign(cells.size(), false);
+
+        thread_pool.parallel_for(
+            0,
+            cells.size(),
+            [&](std::size_t i) {
+                if (roots && roots->find(cells[i]) != roots->end()) {
+                    return;
+                }
+                auto parent = parents.find(parent_cell(cells[i]));
+                remove[i]   = (parent == parents.end() || parent->second[L] != not_fully_inside);
+            },
+            parallel_grain_size);
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            if (remove[i]) {
+                erase_cell(nullptr, level, cells[i]);
+                ++reclaimed;
+            }
+        }
+    }
+
+    constexpr auto num_children = 1ul << L;
+
+    enum class Collapse : char {
+        Keep,
+        Outside,
+        Inside,
+    };
+
+    // Collapsed parents store the distance of the recorded volumes at their center. Averaging
+    // the children would drift from the real distance by up to the parent's half diagonal.
+    auto const operations = applied_volumes(volumes_);
+
+    std::vector<Collapse>       collapses;
+    std::vector<glm::vec<L, T>> centers;
+    std::vector<BandDistance>   inside_distances;
+
+    // Bottom-up so collapsed groups can be collapsed again on the next level
+    for (auto iter = levels_.rbegin(); iter != levels_.rend(); ++iter) {
+        auto const level        = iter->first;
+        auto&      parent_field = iter->second;
+
+        auto children_iter = levels_.find(level - 1);
+        if (level <= lowest_level_ || children_iter == levels_.end()) {
+            continue;
+        }
+        auto& child_field = children_iter->second;
+
+        cells.clear();
+        for (auto const& [cell, value] : parent_field) {
+            if (value[L] == not_fully_inside) {
+                cells.emplace_back(cell);
+            }
+        }
+        collapses.assign(cells.size(), Collapse::Keep);
+        inside_distances.resize(cells.size());
+
+        auto const level_resolution = resolution(level);
+        auto const cell_corner_dist = glm::length(glm::vec<L, T>(level_resolution * T(0.5)));
+
+        centers.resize(cells.size());
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            centers[i] = dvh::cell_center(cells[i], level_resolution);
+        }
+
+        thread_pool.parallel_for(
+            0,
+            cells.size(),
+            [&](std::size_t i) {
+                if (child_mask(level, cells[i]) == 0u) {
+                    // Cells on the edge of the domain were never refined, they aren't empty
+                    if (!domain_ || overlaps(*domain_, level - 1, child_cell(cells[i], 0))) {
+                        collapses[i] = Collapse::Outside;
+                    }
+                    return;
+                }
+
+                auto num_inside = 0ul;
+
+                for_each_child(level, cells[i], [&](Cell const& child) {
+                    if (child_field.at(child)[L] != not_fully_inside) {
+                        ++num_inside;
+                    }
+                });
+
+                if (num_inside != num_children || operations.empty()) {
+                    return;
+                }
+
+                // Children can all be inside while the parent still touches the surface
+                inside_distances[i] = {not_fully_inside, {}};
+                combine_volumes(operations, &centers[i], 1ul, &inside_distances[i]);
+                if (inside_distances[i].distance < -cell_corner_dist) {
+                    collapses[i] = Collapse::Inside;
+                }
+            },
+            parallel_grain_size);
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            switch (collapses[i]) {
+            case Collapse::Keep:
+                break;
+
+            case Collapse::Outside:
+                erase_cell(nullptr, level, cells[i]);
+                ++reclaimed;
+                break;
+
+            case Collapse::Inside:
+                for (auto const& child : children_cells(cells[i])) {
+                    erase_cell(nullptr, level - 1, child);
+                }
+                set_cell(nullptr, level, cells[i], VecDist(centers[i], inside_distances[i].distance));
+                reclaimed += num_children;
+                break;
+            }
+        }
+    }
+
+    return reclaimed;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::replay_reach(sdf::AABB<L, T> const& region) const -> T {
+    // Replays start on the coarsest root level, which new roots inside the region can't be above
+    auto top_level = (roots_.empty() ? lowest_level_ : roots_.begin()->first);
+    if (!sdf::is_empty(region)) {
+        top_level = std::max(top_level, root_range(region).level);
+    }
+
+    // A cell is visited when its parent's sphere touches both the region and a volume's bounds
+    return T(2) * glm::length(glm::vec<L, T>(resolution(top_level + 1) * T(0.5)));
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::can_replay(sdf::AABB<L, T> const& region) const -> bool {
+    if (sdf::is_empty(unrecorded_bounds_) || sdf::is_empty(region)) {
+        return true;
+    }
+
+    // The band is recomputed a little further out than the cells
+    auto reach = replay_reach(region);
+    if (narrow_band_) {
+        reach += narrow_band_->width + T(2) * glm::length(glm::vec<L, T>(resolution(lowest_level_) * T(0.5)));
+    }
+
+    auto const margin = glm::vec<L, T>(reach);
+    return !sdf::intersects(unrecorded_bounds_, {region.min_point - margin, region.max_point + margin});
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::release_roots(std::vector<VolumeOperation<L, T>> const& operations) -> void {
+    std::vector<RootRange> recorded_ranges;
+    for (auto const& [id, record] : volumes_) {
+        auto const bounds = record.operation.world_bounds();
+        if (record.operation.type == VolumeOperationType::Add && !sdf::is_empty(bounds)) {
+            recorded_ranges.emplace_back(root_range(bounds));
+        }
+    }
+
+    auto is_recorded = [&recorded_ranges](int level, Cell const& cell) {
+        return std::any_of(recorded_ranges.begin(), recorded_ranges.end(), [&](RootRange const& range) {
+            return range.level == level && glm::all(glm::lessThanEqual(range.min_cell, cell))
+                && glm::all(glm::lessThanEqual(cell, range.max_cell));
+        });
+    };
+
+    for (auto const& operation : operations) {
+        auto const bounds = operation.world_bounds();
+        if (operation.type != VolumeOperationType::Add || sdf::is_empty(bounds)) {
+            continue;
+        }
+
+        auto const range = root_range(bounds);
+        auto       roots = roots_.find(range.level);
+        if (roots == roots_.end()) {
+            continue;
+        }
+
+        iterate(range.min_cell, range.max_cell, [&](Cell const& cell) {
+            if (!is_recorded(range.level, cell)) {
+                roots->second.erase(cell);
+            }
+        });
+
+        if (roots->second.empty()) {
+            roots_.erase(roots);
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::replay_region(sdf::AABB<L, T> const&                    region,
+                                                     std::vector<VolumeOperation<L, T>> const& released) -> void {
+    if (sdf::is_empty(region)) {
+        return;
+    }
+
+    // Children never overlap a region their parent doesn't (see 'overlaps'), so the cells to
+    // rebuild are found by following the child masks down from the top cells that overlap it.
+    LevelMap<CellSet> stale_cells;
+
+    auto to_visit = top_cells();
+    while (!to_visit.empty()) {
+        auto const level = to_visit.back().first;
+        auto const cell  = to_visit.back().second;
+        to_visit.pop_back();
+
+        if (overlaps(region, level, cell) && stale_cells[level].insert(cell).second) {
+            for_each_child(level, cell, [&to_visit, level](Cell const& child) {
+                to_visit.emplace_back(level - 1, child);
+            });
+        }
+    }
+
+    for (auto const& [level, cells] : stale_cells) {
+        for (auto const& cell : cells) {
+            erase_cell(nullptr, level, cell);
+        }
+    }
+
+    // Stale roots would still be visited by the replay and create cells a full rebuild doesn't have
+    release_roots(released);
+
+    // Volumes that can't reach the region don't change any of its cells (intersections remove
+    // everything outside of them so they always do)
+    auto const reach        = glm::vec<L, T>(replay_reach(region));
+    auto const reach_region = sdf::AABB<L, T>{region.min_point - reach, region.max_point + reach};
+
+    std::vector<std::pair<std::size_t, VolumeOperation<L, T> const*>> replayed;
+    for (auto const& [id, record] : volumes_) {
+        if (record.operation.type == VolumeOperationType::Intersect
+            || sdf::intersects(reach_region, record.operation.world_bounds())) {
+            replayed.emplace_back(replayed.size(), &record.operation);
+        } else {
+            replayed.emplace_back(replayed.size(), nullptr);
+        }
+    }
+
+    // A full rebuild adds the roots of each volume right before applying it, so earlier volumes
+    // never visit the roots of later ones. The replay hides them the same way a batch does.
+    auto root_owners = std::make_shared<RootOwners>();
+    for (auto const& [index, operation] : replayed) {
+        if (operation && operation->type == VolumeOperationType::Add && !sdf::is_empty(operation->world_bounds())) {
+            auto const range  = root_range(operation->world_bounds());
+            auto&      owners = (*root_owners)[range.level];
+            iterate(range.min_cell, range.max_cell, [&owners, index = index](Cell const& cell) {
+                owners.try_emplace(cell, index);
+            });
+        }
+    }
+
+    for (auto const& [index, operation] : replayed) {
+        if (!operation) {
+            continue;
+        }
+
+        auto pending   = begin_operation(*operation, false, root_owners, index);
+        pending.region = (domain_ ? sdf::intersection(*domain_, region) : region);
+
+        while (!step(&pending, std::numeric_limits<std::size_t>::max())) {
+        }
+    }
+
+    update_narrow_band(region, applied_volumes(volumes_), BandStart::Outside);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::is_refined() const -> bool {
+    return !active_operation_ && queued_operations_.empty();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::levels() const -> LevelMap<SparseVolumeMap> const& {
+    return levels_;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::child_mask(int level, Cell const& cell) const -> ChildMask {
+    if (auto masks = child_masks_.find(level); masks != child_masks_.end()) {
+        if (auto mask = masks->second.find(cell); mask != masks->second.end()) {
+            return mask->second;
+        }
+    }
+    return 0u;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::use_leaf_bricks(bool enabled) -> void {
+    wait_for_pending_work();
+
+    leaf_bricks_ = enabled;
+
+    if (auto leaves = levels_.find(lowest_level_); leaves != levels_.end()) {
+        leaves->second.use_bricks(enabled ? std::optional(resolution(lowest_level_)) : std::nullopt);
+        ++revision_;
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::uses_leaf_bricks() const -> bool {
+    return leaf_bricks_;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::distance_at(glm::vec<L, T> const& point, Interpolation interpolation) const
+    -> T {
+    return interpolate(point, find_deepest(point), interpolation);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::distance_at(glm::vec<L, T> const* points,
+                                                   std::size_t           count,
+                                                   T*                    distances,
+                                                   Interpolation         interpolation) const -> void {
+    auto const num_chunks = (count + query_grain_size - 1u) / query_grain_size;
+
+    util::ThreadPool::shared().parallel_for(0, num_chunks, [&](std::size_t chunk) {
+        auto const begin = chunk * query_grain_size;
+        auto const end   = std::min(begin + query_grain_size, count);
+
+        QueryCursor query_cursor(*this);
+
+        for (auto i = begin; i < end; ++i) {
+            distances[i] = query_cursor.distance_at(points[i], interpolation);
+        }
+    });
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::cursor() const -> QueryCursor {
+    return QueryCursor(*this);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::raycast(glm::vec<L, T> const& origin,
+                                               glm::vec<L, T> const& direction,
+                                               T                     max_t) const -> std::optional<RayHit> {
+    QueryCursor query_cursor(*this);
+    return trace_ray(&query_cursor, cell_bounds(), origin, direction, max_t);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::raycast(glm::vec<L, T> const*  origins,
+                                               glm::vec<L, T> const*  directions,
+                                               std::size_t            count,
+                                               T                      max_t,
+                                               std::optional<RayHit>* hits) const -> void {
+    auto const bounds     = cell_bounds();
+    auto const num_chunks = (count + raycast_grain_size - 1u) / raycast_grain_size;
+
+    util::ThreadPool::shared().parallel_for(0, num_chunks, [&](std::size_t chunk) {
+        auto const begin = chunk * raycast_grain_size;
+        auto const end   = std::min(begin + raycast_grain_size, count);
+
+        QueryCursor query_cursor(*this);
+
+        for (auto i = begin; i < end; ++i) {
+            hits[i] = trace_ray(&query_cursor, bounds, origins[i], directions[i], max_t);
+        }
+    });
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::find_deepest(glm::vec<L, T> const&   point,
+                                                    CellQuery               start,
+                                                    std::vector<CellQuery>* path,
+                                                    BrickCache*             cache) const -> CellQuery {
+    // Every other cell has a parent, so only root levels (or every level if the roots are unknown,
+    // as in replicas) have to be searched directly
+    auto const& root_levels = roots_;
+
+    auto next_root_level = [&](std::optional<int> above) -> std::optional<int> {
+        if (root_levels.empty()) {
+            auto iter = (above ? levels_.upper_bound(*above) : levels_.begin());
+            return (iter == levels_.end() ? std::nullopt : std::optional(iter->first));
+        }
+        auto iter = (above ? root_levels.upper_bound(*above) : root_levels.begin());
+        return (iter == root_levels.end() ? std::nullopt : std::optional(iter->first));
+    };
+
+    auto query = start;
+    auto level = std::optional<int>();
+
+    if (start.value) {
+        query = descend(point, start, path, cache);
+        level = next_root_level(query.level);
+    } else {
+        level = next_root_level(std::nullopt);
+    }
+
+    while (level) {
+        auto deepest = *level;
+
+        if (auto distance_field = levels_.find(*level); distance_field != levels_.end()) {
+            auto const cell       = get_cell(point, resolution(*level));
+            auto const cell_value = distance_field->second.find(cell, cache);
+
+            if (cell_value != distance_field->second.end()) {
+                query = {*level, cell, cell_value->second};
+                if (path) {
+                    path->emplace_back(query);
+                }
+                query   = descend(point, query, path, cache);
+                deepest = query.level;
+            }
+        }
+
+        level = next_root_level(deepest);
+    }
+
+    return query;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::descend(glm::vec<L, T> const&   point,
+                                               CellQuery               query,
+                                               std::vector<CellQuery>* path,
+                                               BrickCache*             cache) const -> CellQuery {
+    while (query.level > lowest_level_) {
+        auto const child = get_cell(point, resolution(query.level - 1));
+
+        if ((child_mask(query.level, query.cell) & ChildMask(1u << child_index(child))) == 0u) {
+            break;
+        }
+
+        auto const& distance_field = levels_.find(query.level - 1)->second;
+        query                      = {query.level - 1, child, distance_field.find(child, cache)->second};
+
+        if (path) {
+            path->emplace_back(query);
+        }
+    }
+    return query;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::min_clearance(sdf::csg::Expression<L, T> const& expression,
+                                                     T early_exit_threshold) const -> std::optional<Clearance> {
+    return min_clearance_to(make_volume_operation<L, T>(VolumeOperationType::Subtract, expression),
+                            early_exit_threshold);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::min_clearance_to(VolumeOperation<L, T> const& operation,
+                                                        T early_exit_threshold) const -> std::optional<Clearance> {
+    struct Candidate {
+        T    lower_bound; ///< Of the distance from the geometries to anything in the cell
+        int  level;
+        Cell cell;
+        bool inside; ///< Part of a fully inside cell, so it only exists implicitly
+    };
+
+    auto is_further = [](Candidate const& lhs, Candidate const& rhs) { return lhs.lower_bound > rhs.lower_bound; };
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(is_further)> candidates(is_further);
+
+    std::optional<Clearance> closest;
+
+    std::vector<Cell>           cells;
+    std::vector<glm::vec<L, T>> centers;
+    std::vector<T>              distances;
+
+    // Evaluates 'cells' together. Finest cells are measured and coarser cells are queued if they
+    // might contain something closer.
+    auto evaluate_cells = [&](int level, bool inside) {
+        auto const level_resolution = resolution(level);
+        auto const half_diagonal    = glm::length(glm::vec<L, T>(level_resolution * T(0.5)));
+
+        centers.resize(cells.size());
+        distances.resize(cells.size());
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            centers[i] = dvh::cell_center(cells[i], level_resolution) - operation.translation;
+        }
+        operation.evaluate(centers.data(), cells.size(), distances.data());
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            if (level == lowest_level_) {
+                if (!closest || distances[i] < closest->distance) {
+                    closest = Clearance{distances[i], centers[i] + operation.translation, cells[i]};
+                }
+            } else if (!closest || distances[i] - half_diagonal < closest->distance) {
+                candidates.push({distances[i] - half_diagonal, level, cells[i], inside});
+            }
+        }
+    };
+
+    auto closer_than_threshold = [&] { return closest && closest->distance < early_exit_threshold; };
+
+    // Top cells are sorted by level so each level is evaluated together
+    auto const top = top_cells();
+
+    for (auto begin = 0ul; begin < top.size();) {
+        auto const level = top[begin].first;
+
+        cells.clear();
+        for (; begin < top.size() && top[begin].first == level; ++begin) {
+            cells.emplace_back(top[begin].second);
+        }
+        evaluate_cells(level, false);
+    }
+
+    while (!candidates.empty() && !closer_than_threshold()) {
+        auto const candidate = candidates.top();
+        candidates.pop();
+
+        // Candidates come out closest first so none of the others can be closer either
+        if (closest && candidate.lower_bound >= closest->distance) {
+            break;
+        }
+
+        auto const inside = (candidate.inside
+                             || levels_.at(candidate.level).at(candidate.cell)[L] != not_fully_inside);
+
+        cells.clear();
+        if (inside) {
+            for (auto i = 0; i < (1 << L); ++i) {
+                cells.emplace_back(child_cell(candidate.cell, i));
+            }
+        } else {
+            for_each_child(candidate.level, candidate.cell, [&](Cell const& child) { cells.emplace_back(child); });
+        }
+
+        evaluate_cells(candidate.level - 1, inside);
+    }
+
+    return closest;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::proximity(DistanceVolumeHierarchyCpu const& other,
+                                                 bool                              estimate_overlap,
+                                                 T                                 tolerance) const
+    -> std::optional<Proximity> {
+    // A cell of either hierarchy and its stored distance
+    struct Node {
+        DistanceVolumeHierarchyCpu const* hierarchy;
+        int                               level;
+        Cell                              cell;
+        T                                 distance;
+        sdf::AABB<L, T>                   box; ///< Around the existing children when the cell is split
+
+        auto is_leaf() const -> bool {
+            return distance != not_fully_inside || level == hierarchy->lowest_level_;
+        }
+        // The part of the cell that is inside (surface cells are assumed to be half inside)
+        auto inside_fraction() const -> T { return distance != not_fully_inside ? T(1) : T(0.5); }
+    };
+
+    struct NodePair {
+        T    lower_bound; ///< The distance between the boxes of the cells
+        Node node;
+        Node other_node;
+    };
+
+    auto box_distance = [](sdf::AABB<L, T> const& lhs, sdf::AABB<L, T> const& rhs) {
+        auto const gap = glm::max(lhs.min_point - rhs.max_point, rhs.min_point - lhs.max_point);
+        return glm::length(glm::max(gap, glm::vec<L, T>(0)));
+    };
+
+    auto is_further = [](NodePair const& lhs, NodePair const& rhs) { return lhs.lower_bound > rhs.lower_bound; };
+
+    std::vector<NodePair> pairs;
+    std::vector<NodePair> child_pairs;
+
+    std::optional<Proximity> closest;
+    auto                     overlap_volume = T(0);
+
+    auto needs_visit = [&](T lower_bound) {
+        // Every overlapping pair adds to the overlap volume
+        return !closest || lower_bound < closest->distance - tolerance || (estimate_overlap && lower_bound == T(0));
+    };
+
+    auto visit = [&](Node const& node, Node const& other_node) {
+        auto const& box         = node.box;
+        auto const& other_box   = other_node.box;
+        auto const  lower_bound = box_distance(box, other_box);
+
+        if (sdf::is_empty(box) || sdf::is_empty(other_box) || !needs_visit(lower_bound)) {
+            return;
+        }
+
+        if (!node.is_leaf() || !other_node.is_leaf()) {
+            child_pairs.push_back({lower_bound, node, other_node});
+            return;
+        }
+
+        // Both cells are entirely part of their volumes (up to surface cells) so their boxes are exact
+        if (!closest || lower_bound < closest->distance) {
+            closest = Proximity{lower_bound, node.level, node.cell, other_node.level, other_node.cell, std::nullopt};
+        }
+        if (estimate_overlap && lower_bound == T(0)) {
+            auto const shared = sdf::intersection(box, other_box);
+            auto const size   = glm::max(shared.max_point - shared.min_point, glm::vec<L, T>(0));
+
+            auto volume = node.inside_fraction() * other_node.inside_fraction();
+            for (int i = 0; i < L; ++i) {
+                volume *= size[i];
+            }
+            overlap_volume += volume;
+        }
+    };
+
+    auto cell_box = [](DistanceVolumeHierarchyCpu const& hierarchy, int level, Cell const& cell) {
+        auto const level_resolution = hierarchy.resolution(level);
+        return sdf::AABB<L, T>{glm::vec<L, T>(cell) * level_resolution, glm::vec<L, T>(cell + 1) * level_resolution};
+    };
+
+    auto make_node = [&](DistanceVolumeHierarchyCpu const& hierarchy, int level, Cell const& cell) {
+        auto node = Node{&hierarchy, level, cell, hierarchy.levels_.at(level).at(cell)[L], {}};
+
+        if (node.is_leaf()) {
+            node.box = cell_box(hierarchy, level, cell);
+        } else {
+            // Missing children are outside, which tightens the bounds of cells on the surface
+            hierarchy.for_each_child(level, cell, [&](Cell const& child) {
+                node.box = sdf::expand(node.box, cell_box(hierarchy, level - 1, child));
+            });
+        }
+        return node;
+    };
+
+    auto const top       = top_cells();
+    auto const other_top = other.top_cells();
+
+    // Depth-first with the closest pairs on top of the stack, so close leaves are found early and
+    // prune the rest
+    auto push_child_pairs = [&] {
+        std::sort(child_pairs.begin(), child_pairs.end(), is_further);
+        pairs.insert(pairs.end(), child_pairs.begin(), child_pairs.end());
+        child_pairs.clear();
+    };
+
+    for (auto const& [level, cell] : top) {
+        for (auto const& [other_level, other_cell] : other_top) {
+            visit(make_node(*this, level, cell), make_node(other, other_level, other_cell));
+        }
+    }
+    push_child_pairs();
+
+    while (!pairs.empty()) {
+        auto const pair = pairs.back();
+        pairs.pop_back();
+
+        // The closest pair may have improved since this pair was pushed
+        if (!needs_visit(pair.lower_bound)) {
+            continue;
+        }
+
+        // Split the larger cell (or the only one that can be split)
+        auto const& node       = pair.node;
+        auto const& other_node = pair.other_node;
+
+        auto const split_this = !node.is_leaf()
+            && (other_node.is_leaf() || node.hierarchy->resolution(node.level)
+                                            >= other_node.hierarchy->resolution(other_node.level));
+
+        if (split_this) {
+            for_each_child(node.level, node.cell, [&](Cell const& child) {
+                visit(make_node(*this, node.level - 1, child), other_node);
+            });
+        } else {
+            other.for_each_child(other_node.level, other_node.cell, [&](Cell const& child) {
+                visit(node, make_node(other, other_node.level - 1, child));
+            });
+        }
+        push_child_pairs();
+    }
+
+    if (closest && estimate_overlap) {
+        closest->overlap_volume = overlap_volume;
+    }
+    return closest;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::top_cells() const -> std::vector<std::pair<int, Cell>> {
+    std::vector<std::pair<int, Cell>> cells;
+
+    for (auto const& [level, distance_field] : levels_) {
+        if (roots_.empty()) {
+            // Without roots, every cell without a parent starts a subtree
+            auto const parents = levels_.find(level + 1);
+            for (auto const& cell_and_value : distance_field) {
+                if (parents == levels_.end()
+                    || parents->second.find(parent_cell(cell_and_value.first)) == parents->second.end()) {
+                    cells.emplace_back(level, cell_and_value.first);
+                }
+            }
+        } else if (auto const roots = roots_.find(level); roots != roots_.end()) {
+            for (auto const& cell : roots->second) {
+                if (distance_field.find(cell) != distance_field.end()) {
+                    cells.emplace_back(level, cell);
+                }
+            }
+        }
+    }
+    return cells;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::cell_bounds() const -> sdf::AABB<L, T> {
+    auto bounds = sdf::AABB<L, T>{};
+
+    auto expand_by_cell = [&](int level, Cell const& cell) {
+        auto const level_resolution = resolution(level);
+        bounds = sdf::expand(bounds, glm::vec<L, T>(cell) * level_resolution);
+        bounds = sdf::expand(bounds, glm::vec<L, T>(cell + 1) * level_resolution);
+    };
+
+    if (roots_.empty()) {
+        for (auto const& [level, distance_field] : levels_) {
+            for (auto const& cell_and_value : distance_field) {
+                expand_by_cell(level, cell_and_value.first);
+            }
+        }
+    } else {
+        for (auto const& [level, cells] : roots_) {
+            for (auto const& cell : cells) {
+                expand_by_cell(level, cell);
+            }
+        }
+    }
+    return bounds;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::trace_ray(QueryCursor*           cursor,
+                                                 sdf::AABB<L, T> const& bounds,
+                                                 glm::vec<L, T> const&  origin,
+                                                 glm::vec<L, T> const&  direction,
+                                                 T                      max_t) const -> std::optional<RayHit> {
+    if (sdf::is_empty(bounds)) {
+        return std::nullopt;
+    }
+
+    // A ray without a direction never leaves its cell, and non-finite values have no cell at all
+    for (int i = 0; i < L; ++i) {
+        if (!std::isfinite(origin[i]) || !std::isfinite(direction[i])) {
+            return std::nullopt;
+        }
+    }
+    if (direction == glm::vec<L, T>(0)) {
+        return std::nullopt;
+    }
+
+    // Only the part of the ray inside the cells has to be traced
+    auto t_min = T(0);
+    auto t_max = max_t;
+
+    for (int i = 0; i < L; ++i) {
+        if (direction[i] == T(0)) {
+            if (origin[i] < bounds.min_point[i] || origin[i] > bounds.max_point[i]) {
+                return std::nullopt;
+            }
+            continue;
+        }
+        auto const t0 = (bounds.min_point[i] - origin[i]) / direction[i];
+        auto const t1 = (bounds.max_point[i] - origin[i]) / direction[i];
+
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+
+    if (!(t_min <= t_max)) {
+        return std::nullopt;
+    }
+
+    // Without a cell, the point is in an empty cell on the finest level that has roots
+    auto const outside_level    = (roots_.empty() ? levels_.rbegin()->first : roots_.rbegin()->first);
+    auto const direction_length = glm::length(direction);
+    auto const face_offset      = raycast_face_offset * base_resolution_ / direction_length;
+    auto const finest_corner    = glm::length(glm::vec<L, T>(resolution(lowest_level_) * T(0.5)));
+
+    // Traced from where the ray enters the bounds. Far away origins would otherwise make the
+    // steps smaller than the precision of 't' and of the faces relative to the origin.
+    auto const entry = origin + t_min * direction;
+
+    for (auto t = T(0); t <= t_max - t_min;) {
+        auto const point = entry + t * direction;
+        auto const query = cursor->locate(point);
+
+        if (query.value && ((*query.value)[L] != not_fully_inside || query.level == lowest_level_)) {
+            return RayHit{t_min + t, point, query.level, query.cell, (*query.value)[L]};
+        }
+
+        // The missing child (or cell) containing the point is empty, so skip to where the ray leaves it
+        auto const empty_level      = (query.value ? query.level - 1 : outside_level);
+        auto const empty_resolution = resolution(empty_level);
+        auto const empty_cell       = get_cell(point, empty_resolution);
+
+        auto exit_t = std::numeric_limits<T>::infinity();
+        for (int i = 0; i < L; ++i) {
+            if (direction[i] != T(0)) {
+                auto const face = T(empty_cell[i] + (direction[i] > T(0) ? 1 : 0)) * empty_resolution;
+                exit_t          = std::min(exit_t, (face - entry[i]) / direction[i]);
+            }
+        }
+
+        // Where the band is stored the ray can also sphere trace. The point is up to a half
+        // diagonal from the center the band distance was measured at, and finest cells up to a
+        // half diagonal from the surface are solid across their whole width, so three half
+        // diagonals are kept as a margin.
+        if (auto const band = band_distance_at(point); band && band->distance > T(3) * finest_corner) {
+            exit_t = std::max(exit_t, t + (band->distance - T(3) * finest_corner) / direction_length);
+        }
+
+        // The offset is scaled with 't' so every step moves the ray, however far it has gone
+        auto const offset = std::max(face_offset, t * (T(4) * std::numeric_limits<T>::epsilon()));
+        auto const next_t = std::max(exit_t, t) + offset;
+        t                 = (next_t > t ? next_t : std::nextafter(t, std::numeric_limits<T>::infinity()));
+    }
+    return std::nullopt;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::interpolate(glm::vec<L, T> const& point,
+                                                   CellQuery const&      query,
+                                                   Interpolation         interpolation,
+                                                   BrickCache*           cache) const -> T {
+    auto band_distance = [this, &point] {
+        auto const band = band_distance_at(point);
+        return band ? band->distance : not_fully_inside;
+    };
+
+    if (!query.value || (*query.value)[L] == not_fully_inside) {
+        return band_distance();
+    }
+
+    auto const nearest = (*query.value)[L];
+
+    if (interpolation == Interpolation::Nearest) {
+        return nearest;
+    }
+
+    auto const& distance_field = levels_.find(query.level)->second;
+
+    // Cell centers are at integer coordinates of 'grid'
+    auto const grid    = point / resolution(query.level) - T(0.5);
+    auto const minimum = Cell(glm::floor(grid));
+    auto const weights = grid - glm::vec<L, T>(minimum);
+
+    auto distance = T(0);
+
+    for (int corner = 0; corner < (1 << L); ++corner) {
+        auto weight = T(1);
+        auto cell   = minimum;
+
+        for (int i = 0; i < L; ++i) {
+            if ((corner >> i) & 1) {
+                cell[i] += 1;
+                weight *= weights[i];
+            } else {
+                weight *= T(1) - weights[i];
+            }
+        }
+
+        auto iter = distance_field.find(cell, cache);
+        if (iter == distance_field.end() || iter->second[L] == not_fully_inside) {
+            return nearest;
+        }
+        distance += weight * iter->second[L];
+    }
+
+    return distance;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::set_narrow_band(std::optional<T> width) -> void {
+    wait_for_pending_work();
+
+    if (!width || *width <= T(0)) {
+        record_band_originals();
+        narrow_band_ = std::nullopt;
+        return;
+    }
+
+    auto start = BandStart::Outside;
+
+    if (sdf::is_empty(unrecorded_bounds_)) {
+        record_band_originals();
+        narrow_band_ = NarrowBand{*width, {}};
+
+    } else {
+        // Cells that weren't built by the recorded volumes can't be recomputed, so their band cells
+        // are kept (within the new width) and the recorded volumes are combined with them again
+        if (!narrow_band_) {
+            narrow_band_ = NarrowBand{*width, {}};
+        }
+        narrow_band_->width = *width;
+
+        auto& band_cells = narrow_band_->cells;
+        for (auto iter = band_cells.begin(); iter != band_cells.end();) {
+            if (iter->second.distance > *width) {
+                record_band_original(iter->first, iter->second.distance);
+                iter = band_cells.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        start = BandStart::Current;
+    }
+
+    auto region = sdf::AABB<L, T>{};
+    for (auto const& [id, record] : volumes_) {
+        region = sdf::expand(region, changed_region(record.operation));
+    }
+    update_narrow_band(region, applied_volumes(volumes_), start);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::narrow_band() const -> std::optional<T> {
+    return narrow_band_ ? std::optional(narrow_band_->width) : std::nullopt;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::band_distance_at(glm::vec<L, T> const& point) const
+    -> std::optional<BandDistance> {
+    if (!narrow_band_) {
+        return std::nullopt;
+    }
+
+    auto const& cells = narrow_band_->cells;
+    if (auto iter = cells.find(get_cell(point, resolution(lowest_level_))); iter != cells.end()) {
+        return iter->second;
+    }
+    return std::nullopt;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::band_cells() const -> CellMap<BandDistance> const* {
+    return narrow_band_ ? &narrow_band_->cells : nullptr;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::freeze() const -> FrozenHierarchy<L, T> {
+    return FrozenHierarchy<L, T>(*this);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::occupancy() const -> OccupancyPyramid<L, T> {
+    return OccupancyPyramid<L, T>(*this);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::save(std::string const& filename) -> util::Result<void> {
+    wait_for_pending_work();
+
+    snapshot::Writer writer;
+
+    writer.begin_section(snapshot::header_section);
+    writer.write_raw(std::uint32_t(L));
+    writer.write_raw(std::uint32_t(sizeof(T)));
+    writer.write_raw(base_resolution_);
+    writer.write_varint(snapshot::zigzag_encode(max_level_));
+    writer.write_varint(snapshot::zigzag_encode(lowest_level_));
+    writer.write_varint(roots_.size());
+    writer.write_varint(levels_.size());
+    writer.end_section();
+
+    std::vector<std::uint64_t> codes;
+
+    auto encode_cell = [&codes](Cell const& cell) {
+        auto code = snapshot::morton_encode(cell);
+        if (code) {
+            codes.emplace_back(*code);
+        }
+        return code.has_value();
+    };
+
+    auto out_of_range = [] { return tl::make_unexpected(LTB_MAKE_ERROR("Cells are too far away to be saved")); };
+
+    writer.begin_section(snapshot::roots_section);
+    for (auto const& [level, cells] : roots_) {
+        codes.clear();
+        for (auto const& cell : cells) {
+            if (!encode_cell(cell)) {
+                return out_of_range();
+            }
+        }
+        std::sort(codes.begin(), codes.end());
+
+        writer.write_varint(snapshot::zigzag_encode(level));
+        writer.write_sorted_codes(codes);
+    }
+    writer.end_section();
+
+    std::vector<std::pair<std::uint64_t, T>> cells;
+
+    for (auto const& [level, distance_field] : levels_) {
+        cells.clear();
+        codes.clear();
+        for (auto const& [cell, value] : distance_field) {
+            if (!encode_cell(cell)) {
+                return out_of_range();
+            }
+            cells.emplace_back(codes.back(), value[L]);
+        }
+        std::sort(cells.begin(), cells.end(), [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            codes[i] = cells[i].first;
+        }
+
+        // Points are always cell centers so only the distances are stored
+        writer.begin_section(snapshot::level_section);
+        writer.write_varint(snapshot::zigzag_encode(level));
+        writer.write_sorted_codes(codes);
+        for (auto const& cell : cells) {
+            writer.write_raw(cell.second);
+        }
+        writer.end_section();
+    }
+
+    // A flag followed by the band width and the band cells like a level
+    writer.begin_section(snapshot::band_section);
+    writer.write_varint(narrow_band_ ? 1u : 0u);
+    if (narrow_band_) {
+        cells.clear();
+        codes.clear();
+        for (auto const& [cell, distance] : narrow_band_->cells) {
+            if (!encode_cell(cell)) {
+                return out_of_range();
+            }
+            cells.emplace_back(codes.back(), distance.distance);
+        }
+        std::sort(cells.begin(), cells.end(), [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            codes[i] = cells[i].first;
+        }
+
+        writer.write_raw(narrow_band_->width);
+        writer.write_sorted_codes(codes);
+        for (auto const& cell : cells) {
+            writer.write_raw(cell.second);
+        }
+    }
+    writer.end_section();
+
+    std::ofstream output_stream(filename, std::ios::binary);
+    if (!output_stream.is_open()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to open: '" + filename + "'"));
+    }
+
+    output_stream.write(writer.buffer().data(), static_cast<std::streamsize>(writer.buffer().size()));
+    if (!output_stream) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to write: '" + filename + "'"));
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::load(std::string const& filename) -> util::Result<void> {
+    wait_for_pending_work();
+
+    std::ifstream input_stream(filename, std::ios::binary);
+    if (!input_stream.is_open()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Failed to open: '" + filename + "'"));
+    }
+
+    auto corrupted = [&filename] {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy snapshot: '" + filename + "'"));
+    };
+
+    // Sections are decoded as they are read so the file is never held in memory as a whole
+    snapshot::StreamReader reader(input_stream);
+
+    auto const file_magic = reader.read_raw<std::array<char, sizeof(snapshot::magic)>>();
+    auto const version    = reader.read_raw<std::uint32_t>();
+
+    if (!reader.ok() || !std::equal(file_magic.begin(), file_magic.end(), std::begin(snapshot::magic))) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Not a hierarchy snapshot: '" + filename + "'"));
+    }
+    if (version != snapshot::format_version) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Unsupported snapshot version: " + std::to_string(version)));
+    }
+
+    auto header = reader.read_section(snapshot::header_section);
+    if (!header) {
+        return tl::make_unexpected(header.error());
+    }
+
+    auto const dimensions  = header->read_raw<std::uint32_t>();
+    auto const scalar_size = header->read_raw<std::uint32_t>();
+    if (dimensions != L || scalar_size != sizeof(T)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot has a different dimension or scalar type"));
+    }
+
+    auto const base_resolution = header->read_raw<T>();
+    auto const max_level       = static_cast<int>(snapshot::zigzag_decode(header->read_varint()));
+    auto const lowest_level    = static_cast<int>(snapshot::zigzag_decode(header->read_varint()));
+    auto const num_root_levels = header->read_varint();
+    auto const num_levels      = header->read_varint();
+    if (!header->ok() || !(base_resolution > T(0)) || !std::isfinite(base_resolution) || lowest_level != base_level
+        || max_level < lowest_level) {
+        return corrupted();
+    }
+
+    auto is_valid_level = [&](int level) { return level >= lowest_level && level <= max_level; };
+
+    // Everything is decoded before the hierarchy is touched so it is unchanged if decoding fails
+    LevelMap<CellSet>         roots;
+    LevelMap<SparseVolumeMap> levels;
+
+    std::vector<std::uint64_t> codes;
+
+    auto root_section = reader.read_section(snapshot::roots_section);
+    if (!root_section) {
+        return tl::make_unexpected(root_section.error());
+    }
+    for (auto i = 0ul; i < num_root_levels && root_section->ok(); ++i) {
+        auto const level = static_cast<int>(snapshot::zigzag_decode(root_section->read_varint()));
+        if (!is_valid_level(level)) {
+            return corrupted();
+        }
+        root_section->read_sorted_codes(&codes);
+
+        auto& level_roots = roots[level];
+        level_roots.reserve(codes.size());
+        for (auto const& code : codes) {
+            level_roots.emplace(snapshot::morton_decode<L>(code));
+        }
+    }
+    if (!root_section->ok() || !root_section->at_end()) {
+        return corrupted();
+    }
+
+    for (auto i = 0ul; i < num_levels; ++i) {
+        auto section = reader.read_section(snapshot::level_section);
+        if (!section) {
+            return tl::make_unexpected(section.error());
+        }
+
+        auto const level            = static_cast<int>(snapshot::zigzag_decode(section->read_varint()));
+        auto const level_resolution = std::ldexp(base_resolution, level);
+        if (!is_valid_level(level) || !std::isfinite(level_resolution)) {
+            return corrupted();
+        }
+        section->read_sorted_codes(&codes);
+
+        auto& distance_field = levels[level];
+        distance_field.reserve(codes.size());
+
+        for (auto const& code : codes) {
+            auto const cell     = snapshot::morton_decode<L>(code);
+            auto const distance = section->read_raw<T>();
+
+            distance_field.emplace(cell,
+                                   distance == not_fully_inside
+                                       ? VecDist(not_fully_inside)
+                                       : VecDist(dvh::cell_center(cell, level_resolution), distance));
+        }
+        if (!section->ok() || !section->at_end()) {
+            return corrupted();
+        }
+    }
+
+    auto band_section = reader.read_section(snapshot::band_section);
+    if (!band_section) {
+        return tl::make_unexpected(band_section.error());
+    }
+
+    std::optional<NarrowBand> narrow_band;
+
+    if (band_section->read_varint() != 0u) {
+        auto const width = band_section->read_raw<T>();
+        if (!(width > T(0)) || !std::isfinite(width)) {
+            return corrupted();
+        }
+        narrow_band = NarrowBand{width, {}};
+
+        band_section->read_sorted_codes(&codes);
+        narrow_band->cells.reserve(codes.size());
+
+        for (auto const& code : codes) {
+            narrow_band->cells.emplace(snapshot::morton_decode<L>(code),
+                                       BandDistance{band_section->read_raw<T>(), VolumeHandle()});
+        }
+    }
+    if (!band_section->ok() || !band_section->at_end() || !reader.at_end()) {
+        return corrupted();
+    }
+
+    clear();
+
+    base_resolution_ = base_resolution;
+    max_level_       = max_level;
+    lowest_level_    = lowest_level;
+    roots_           = std::move(roots);
+    levels_          = std::move(levels);
+    narrow_band_     = std::move(narrow_band);
+
+    if (auto leaves = levels_.find(lowest_level_); leaf_bricks_ && leaves != levels_.end()) {
+        leaves->second.use_bricks(resolution(lowest_level_));
+    }
+
+    // None of the loaded cells came from a recorded volume
+    unrecorded_bounds_ = cell_bounds();
+
+    if (narrow_band_) {
+        auto const margin = glm::vec<L, T>(narrow_band_->width);
+        if (!sdf::is_empty(unrecorded_bounds_)) {
+            unrecorded_bounds_ = {unrecorded_bounds_.min_point - margin, unrecorded_bounds_.max_point + margin};
+        }
+
+        for (auto const& cell_and_distance : narrow_band_->cells) {
+            record_band_original(cell_and_distance.first, std::nullopt);
+        }
+    }
+
+    for (auto const& [level, distance_field] : levels_) {
+        auto& masks = child_masks_[level + 1];
+        for (auto const& cell_and_value : distance_field) {
+            auto const& cell = cell_and_value.first;
+            masks[parent_cell(cell)] |= ChildMask(1u << child_index(cell));
+
+            if (changes_) {
+                (*changes_)[level].try_emplace(cell, std::nullopt);
+            }
+        }
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::record_changes(bool enabled) -> void {
+    wait_for_pending_work();
+
+    if (!enabled) {
+        changes_      = std::nullopt;
+        band_changes_ = std::nullopt;
+    } else if (!changes_) {
+        changes_      = Journal{};
+        band_changes_ = CellMap<std::optional<T>>{};
+        delta_roots_.clear();
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::take_delta() -> util::Result<std::string> {
+    wait_for_pending_work();
+
+    if (!changes_) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Changes are not being recorded"));
+    }
+
+    snapshot::Writer writer;
+
+    writer.begin_section(snapshot::delta_header_section);
+    writer.write_raw(std::uint32_t(L));
+    writer.write_raw(double(base_resolution_));
+    writer.write_varint(snapshot::zigzag_encode(lowest_level_));
+    writer.end_section();
+
+    std::vector<std::uint64_t> codes;
+
+    // A flag followed by every root when they changed
+    auto const send_roots = (roots_ != delta_roots_);
+
+    writer.begin_section(snapshot::delta_roots_section);
+    writer.write_varint(send_roots ? 1u : 0u);
+    if (send_roots) {
+        writer.write_varint(roots_.size());
+
+        for (auto const& [level, cells] : roots_) {
+            codes.clear();
+            for (auto const& cell : cells) {
+                auto code = snapshot::morton_encode(cell);
+                if (!code) {
+                    return tl::make_unexpected(LTB_MAKE_ERROR("Cells are too far away to be encoded"));
+                }
+                codes.emplace_back(*code);
+            }
+            std::sort(codes.begin(), codes.end());
+
+            writer.write_varint(snapshot::zigzag_encode(level));
+            writer.write_sorted_codes(codes);
+        }
+    }
+    writer.end_section();
+
+    // Morton codes and quantized distances of the changed cells of one level
+    using CodedCells = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+
+    CodedCells removed;
+    CodedCells added;
+    CodedCells changed;
+
+    auto write_cells = [&writer, &codes](CodedCells* cells, bool with_distances) {
+        std::sort(cells->begin(), cells->end());
+
+        codes.clear();
+        for (auto const& cell : *cells) {
+            codes.emplace_back(cell.first);
+        }
+        writer.write_sorted_codes(codes);
+
+        if (with_distances) {
+            for (auto const& cell : *cells) {
+                writer.write_varint(cell.second);
+            }
+        }
+    };
+
+    // A flag followed by the band width, the removed band cells and the added or changed ones
+    writer.begin_section(snapshot::delta_band_section);
+    writer.write_varint(narrow_band_ ? 1u : 0u);
+    if (narrow_band_) {
+        auto const finest_resolution = resolution(lowest_level_);
+
+        for (auto const& [cell, original] : *band_changes_) {
+            auto code = snapshot::morton_encode(cell);
+            if (!code) {
+                return tl::make_unexpected(LTB_MAKE_ERROR("Cells are too far away to be encoded"));
+            }
+
+            auto const current = narrow_band_->cells.find(cell);
+            if (current == narrow_band_->cells.end()) {
+                if (original) {
+                    removed.emplace_back(*code, 0u);
+                }
+                continue;
+            }
+
+            auto const distance = snapshot::quantize_distance(current->second.distance, finest_resolution);
+            if (!original || distance != snapshot::quantize_distance(*original, finest_resolution)) {
+                changed.emplace_back(*code, distance);
+            }
+        }
+
+        writer.write_raw(double(narrow_band_->width));
+        write_cells(&removed, false);
+        write_cells(&changed, true);
+    }
+    writer.end_section();
+
+    for (auto const& [level, original_cells] : *changes_) {
+        removed.clear();
+        added.clear();
+        changed.clear();
+
+        auto const level_resolution = resolution(level);
+        auto const distance_field   = levels_.find(level);
+
+        for (auto const& [cell, original] : original_cells) {
+            auto code = snapshot::morton_encode(cell);
+            if (!code) {
+                return tl::make_unexpected(LTB_MAKE_ERROR("Cells are too far away to be encoded"));
+            }
+
+            std::optional<T> current;
+            if (distance_field != levels_.end()) {
+                if (auto iter = distance_field->second.find(cell); iter != distance_field->second.end()) {
+                    current = iter->second[L];
+                }
+            }
+
+            if (original && !current) {
+                removed.emplace_back(*code, 0u);
+
+            } else if (!original && current) {
+                added.emplace_back(*code, snapshot::quantize_distance(*current, level_resolution));
+
+            } else if (original && current) {
+                auto const distance = snapshot::quantize_distance(*current, level_resolution);
+                if (distance != snapshot::quantize_distance((*original)[L], level_resolution)) {
+                    changed.emplace_back(*code, distance);
+                }
+            }
+        }
+
+        if (removed.empty() && added.empty() && changed.empty()) {
+            continue;
+        }
+
+        writer.begin_section(snapshot::delta_level_section);
+        writer.write_varint(snapshot::zigzag_encode(level));
+        write_cells(&removed, false);
+        write_cells(&added, true);
+        write_cells(&changed, true);
+        writer.end_section();
+    }
+
+    changes_->clear();
+    band_changes_->clear();
+    delta_roots_ = roots_;
+    return writer.buffer();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::apply_delta(std::string const& delta) -> util::Result<void> {
+    wait_for_pending_work();
+
+    snapshot::Reader reader(delta.data(), delta.size());
+
+    auto const magic   = reader.read_raw<std::array<char, sizeof(snapshot::magic)>>();
+    auto const version = reader.read_raw<std::uint32_t>();
+
+    if (!reader.ok() || !std::equal(magic.begin(), magic.end(), std::begin(snapshot::magic))) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Not a hierarchy delta"));
+    }
+    if (version != snapshot::format_version) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Unsupported delta version: " + std::to_string(version)));
+    }
+
+    auto header = reader.read_section(snapshot::delta_header_section);
+    if (!header) {
+        return tl::make_unexpected(header.error());
+    }
+
+    auto const dimensions      = header->read_raw<std::uint32_t>();
+    auto const base_resolution = header->read_raw<double>();
+    auto const lowest_level    = static_cast<int>(snapshot::zigzag_decode(header->read_varint()));
+    if (!header->ok() || !header->at_end()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+    }
+    if (dimensions != L || base_resolution != double(base_resolution_)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Delta has a different dimension or base resolution"));
+    }
+
+    auto is_valid_level = [&](int level) { return level >= lowest_level && level <= max_level_; };
+
+    if (!is_valid_level(lowest_level) || lowest_level < base_level) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+    }
+
+    std::vector<std::uint64_t> codes;
+
+    auto roots_section = reader.read_section(snapshot::delta_roots_section);
+    if (!roots_section) {
+        return tl::make_unexpected(roots_section.error());
+    }
+
+    std::optional<LevelMap<CellSet>> roots;
+
+    if (roots_section->read_varint() != 0u) {
+        auto const num_root_levels = roots_section->read_varint();
+        roots.emplace();
+
+        for (auto i = 0ul; i < num_root_levels && roots_section->ok(); ++i) {
+            auto const level = static_cast<int>(snapshot::zigzag_decode(roots_section->read_varint()));
+            if (!is_valid_level(level)) {
+                return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+            }
+            roots_section->read_sorted_codes(&codes);
+
+            auto& level_roots = (*roots)[level];
+            for (auto const& code : codes) {
+                level_roots.emplace(snapshot::morton_decode<L>(code));
+            }
+        }
+    }
+    if (!roots_section->ok() || !roots_section->at_end()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+    }
+
+    auto band_section = reader.read_section(snapshot::delta_band_section);
+    if (!band_section) {
+        return tl::make_unexpected(band_section.error());
+    }
+
+    std::optional<T>                band_width;
+    std::vector<Cell>               removed_band_cells;
+    std::vector<std::pair<Cell, T>> updated_band_cells;
+
+    if (band_section->read_varint() != 0u) {
+        band_width = static_cast<T>(band_section->read_raw<double>());
+        if (!(*band_width > T(0)) || !std::isfinite(*band_width)) {
+            return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+        }
+
+        auto const finest_resolution = resolution(lowest_level);
+
+        band_section->read_sorted_codes(&codes);
+        for (auto const& code : codes) {
+            removed_band_cells.emplace_back(snapshot::morton_decode<L>(code));
+        }
+
+        band_section->read_sorted_codes(&codes);
+        for (auto const& code : codes) {
+            updated_band_cells.emplace_back(snapshot::morton_decode<L>(code),
+                                            snapshot::dequantize_distance(band_section->read_varint(),
+                                                                          finest_resolution));
+        }
+    }
+    if (!band_section->ok() || !band_section->at_end()) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+    }
+
+    struct LevelDelta {
+        int                             level;
+        std::vector<Cell>               removed;
+        std::vector<std::pair<Cell, T>> updated; ///< Added or changed
+    };
+
+    // Everything is decoded before the hierarchy is touched so it is unchanged if decoding fails
+    std::vector<LevelDelta> level_deltas;
+
+    while (!reader.at_end()) {
+        auto section = reader.read_section(snapshot::delta_level_section);
+        if (!section) {
+            return tl::make_unexpected(section.error());
+        }
+
+        auto& level_delta = level_deltas.emplace_back();
+        level_delta.level = static_cast<int>(snapshot::zigzag_decode(section->read_varint()));
+        if (!is_valid_level(level_delta.level)) {
+            return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+        }
+
+        auto const level_resolution = resolution(level_delta.level);
+
+        section->read_sorted_codes(&codes);
+        for (auto const& code : codes) {
+            level_delta.removed.emplace_back(snapshot::morton_decode<L>(code));
+        }
+
+        // Added cells followed by changed cells
+        for (auto i = 0; i < 2; ++i) {
+            section->read_sorted_codes(&codes);
+            for (auto const& code : codes) {
+                level_delta.updated.emplace_back(snapshot::morton_decode<L>(code),
+                                                 snapshot::dequantize_distance(section->read_varint(),
+                                                                               level_resolution));
+            }
+        }
+
+        if (!section->ok() || !section->at_end()) {
+            return tl::make_unexpected(LTB_MAKE_ERROR("Corrupted hierarchy delta"));
+        }
+    }
+
+    lowest_level_ = lowest_level;
+    if (roots) {
+        roots_ = std::move(*roots);
+    }
+
+    // None of the changes came from a recorded volume
+    auto mark_unrecorded = [this](int level, Cell const& cell) {
+        auto const level_resolution = resolution(level);
+        unrecorded_bounds_ = sdf::expand(unrecorded_bounds_, glm::vec<L, T>(cell) * level_resolution);
+        unrecorded_bounds_ = sdf::expand(unrecorded_bounds_, glm::vec<L, T>(cell + 1) * level_resolution);
+    };
+
+    if (!band_width) {
+        record_band_originals();
+        narrow_band_ = std::nullopt;
+    } else {
+        if (!narrow_band_) {
+            narrow_band_ = NarrowBand{*band_width, {}};
+        }
+        narrow_band_->width = *band_width;
+
+        auto& band_cells = narrow_band_->cells;
+
+        // The replica doesn't have the volumes so its band cells don't know where they came from
+        for (auto const& cell : removed_band_cells) {
+            mark_unrecorded(lowest_level_, cell);
+            if (auto iter = band_cells.find(cell); iter != band_cells.end()) {
+                record_band_original(cell, iter->second.distance);
+                band_cells.erase(iter);
+            }
+        }
+        for (auto const& [cell, distance] : updated_band_cells) {
+            mark_unrecorded(lowest_level_, cell);
+            auto iter = band_cells.find(cell);
+            record_band_original(cell, iter != band_cells.end() ? std::optional(iter->second.distance) : std::nullopt);
+            band_cells.insert_or_assign(cell, BandDistance{distance, VolumeHandle()});
+        }
+    }
+
+    for (auto const& level_delta : level_deltas) {
+        auto const level_resolution = resolution(level_delta.level);
+
+        for (auto const& cell : level_delta.removed) {
+            mark_unrecorded(level_delta.level, cell);
+            erase_cell(nullptr, level_delta.level, cell);
+        }
+        for (auto const& [cell, distance] : level_delta.updated) {
+            mark_unrecorded(level_delta.level, cell);
+            set_cell(nullptr,
+                     level_delta.level,
+                     cell,
+                     distance == not_fully_inside ? VecDist(not_fully_inside)
+                                                  : VecDist(dvh::cell_center(cell, level_resolution), distance));
+        }
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::base_resolution() const -> T {
+    return base_resolution_;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::resolution(int level_index) const -> T {
+    return std::ldexp(base_resolution_, level_index);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::add_roots_for_bounds(const sdf::AABB<L, T>& aabb,
+                                                            RootOwners*            owners,
+                                                            std::size_t            owner) -> void {
+    auto const range = root_range(aabb);
+    auto&      roots = roots_[range.level];
+
+    iterate(range.min_cell, range.max_cell, [&](auto const& cell) {
+        if (roots.emplace(cell).second && owners) {
+            (*owners)[range.level].emplace(cell, owner);
+        }
+    });
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::root_range(sdf::AABB<L, T> const& aabb) const -> RootRange {
+    auto root_level = lowest_level_;
+    auto min_cell   = Cell();
+    auto max_cell   = Cell();
+    auto dimensions = Cell(std::numeric_limits<int>::max());
+
+    for (int level = root_level; level < max_level_; ++level) {
+        auto level_resolution = resolution(level);
+
+        auto level_min_cell = get_cell(aabb.min_point, level_resolution);
+        auto level_max_cell = get_cell(aabb.max_point, level_resolution);
+
+        auto level_dimensions = level_max_cell - level_min_cell;
+
+        if (level_dimensions == dimensions) {
+            break;
+        }
+
+        root_level = level;
+        min_cell   = level_min_cell;
+        max_cell   = level_max_cell;
+        dimensions = level_dimensions;
+    }
+
+    return {root_level, min_cell, max_cell};
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::record_volume(VolumeOperation<L, T> const&        operation,
+                                                     std::shared_ptr<BuildControl const> build) -> VolumeHandle {
+    auto id = next_volume_id_++;
+    volumes_.emplace(id, VolumeRecord{operation, std::move(build)});
+    return VolumeHandle(id);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::apply_operation(VolumeOperation<L, T> operation) -> VolumeHandle {
+    wait_for_pending_work();
+
+    auto volume = record_volume(operation);
+
+    update_narrow_band(changed_region(operation), {{volume.id(), &operation}}, BandStart::Current);
+
+    auto pending = begin_operation(std::move(operation), false);
+    while (!step(&pending, std::numeric_limits<std::size_t>::max())) {
+    }
+
+    return volume;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::apply_operation_async(VolumeOperation<L, T> operation,
+                                                             ProgressCallback      on_progress) -> BuildHandle {
+    auto control         = std::make_shared<BuildControl>();
+    control->on_progress = std::move(on_progress);
+
+    // Only the id is taken here. Earlier builds may still be reading 'volumes_' on their thread, so
+    // the volume is recorded by the build once they are done.
+    auto const volume         = VolumeHandle(next_volume_id_++);
+    auto const previous_build = last_build_.future;
+
+    auto build = [this, operation = std::move(operation), control, previous_build, volume]() mutable {
+        // Builds modify the same maps so they are applied one after another
+        if (previous_build.valid()) {
+            previous_build.wait();
+        }
+        volumes_.emplace(volume.id(), VolumeRecord{operation, control});
+        finish_refinement();
+
+        BandJournal band_journal;
+        update_narrow_band(changed_region(operation), {{volume.id(), &operation}}, BandStart::Current, &band_journal);
+
+        auto pending         = begin_operation(std::move(operation), true);
+        pending.on_progress  = control->on_progress;
+        pending.band_journal = std::move(band_journal);
+
+        try {
+            while (!control->cancel_requested) {
+                if (step(&pending, frontier_chunk_size)) {
+                    return BuildStatus::Completed;
+                }
+            }
+        } catch (...) {
+            roll_back(&pending);
+            control->rolled_back = true;
+            throw;
+        }
+
+        roll_back(&pending);
+        control->rolled_back = true;
+        return BuildStatus::Cancelled;
+    };
+
+    last_build_.future = std::async(std::launch::async, std::move(build)).share();
+    return BuildHandle(last_build_.future, std::move(control), volume);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::wait_for_builds() -> void {
+    last_build_.wait();
+
+    // Volumes of cancelled builds never made it into the hierarchy
+    for (auto iter = volumes_.begin(); iter != volumes_.end();) {
+        if (iter->second.build && iter->second.build->rolled_back) {
+            iter = volumes_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::wait_for_pending_work() -> void {
+    wait_for_builds();
+    finish_refinement();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::finish_refinement() -> void {
+    if (active_operation_) {
+        while (!step(&*active_operation_, std::numeric_limits<std::size_t>::max())) {
+        }
+        active_operation_ = std::nullopt;
+    }
+
+    while (!queued_operations_.empty()) {
+        auto& [id, operation] = queued_operations_.front();
+
+        update_narrow_band(changed_region(operation), {{id, &operation}}, BandStart::Current);
+
+        auto pending = begin_operation(std::move(operation), false);
+        queued_operations_.pop_front();
+
+        while (!step(&pending, std::numeric_limits<std::size_t>::max())) {
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::changed_region(VolumeOperation<L, T> const& operation) const
+    -> sdf::AABB<L, T> {
+    auto region = operation.world_bounds();
+
+    if (operation.type == VolumeOperationType::Intersect) {
+        // Everything outside of the intersecting volume is removed
+        for (auto const& [id, record] : volumes_) {
+            region = sdf::expand(region, record.operation.world_bounds());
+        }
+        region = sdf::expand(region, unrecorded_bounds_);
+    }
+    return region;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::applied_volumes(std::map<std::uint64_t, VolumeRecord> const& volumes)
+    -> VolumeList {
+    VolumeList operations;
+
+    // Volumes of cancelled builds never made it into the hierarchy
+    for (auto const& [id, record] : volumes) {
+        if (!record.build || !record.build->rolled_back) {
+            operations.emplace_back(id, &record.operation);
+        }
+    }
+    return operations;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::combine_volumes(VolumeList const&     operations,
+                                                       glm::vec<L, T> const* points,
+                                                       std::size_t           count,
+                                                       BandDistance*         distances,
+                                                       BandDistance*         lower_distances) -> void {
+    std::vector<T> operation_distances(count);
+
+    auto combine = [](VolumeOperationType type, T distance, std::uint64_t id, BandDistance* combined) {
+        switch (type) {
+        case VolumeOperationType::Add:
+            if (distance < combined->distance) {
+                *combined = {distance, VolumeHandle(id)};
+            }
+            break;
+        case VolumeOperationType::Subtract:
+            if (-distance > combined->distance) {
+                *combined = {-distance, VolumeHandle(id)};
+            }
+            break;
+        case VolumeOperationType::Intersect:
+            if (distance > combined->distance) {
+                *combined = {distance, VolumeHandle(id)};
+            }
+            break;
+        }
+    };
+
+    // The volumes combined in order, like the levels
+    for (auto const& [id, operation] : operations) {
+        evaluate_operation(*operation, points, count, operation_distances.data());
+
+        for (auto i = 0ul; i < count; ++i) {
+            combine(operation->type, operation_distances[i], id, &distances[i]);
+            if (lower_distances) {
+                combine(operation->type, operation_distances[i], id, &lower_distances[i]);
+            }
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::update_narrow_band(sdf::AABB<L, T> const& changed,
+                                                          VolumeList             operations,
+                                                          BandStart              start,
+                                                          BandJournal*           journal) -> void {
+    if (!narrow_band_ || sdf::is_empty(changed)) {
+        return;
+    }
+
+    auto&      band_cells        = narrow_band_->cells;
+    auto const width             = narrow_band_->width;
+    auto const finest_resolution = resolution(lowest_level_);
+    auto const finest_corner     = glm::length(glm::vec<L, T>(finest_resolution * T(0.5)));
+
+    // Cells within 'width' of the changed geometry can get a new closest surface, and subtracted
+    // geometry can also remove cells just inside of the surface
+    auto const margin = glm::vec<L, T>(width + T(2) * finest_corner);
+
+    auto region = sdf::AABB<L, T>{changed.min_point - margin, changed.max_point + margin};
+    if (domain_) {
+        region = sdf::intersection(*domain_, region);
+    }
+
+    if (sdf::is_empty(region)) {
+        return;
+    }
+
+    auto in_region = [&region](glm::vec<L, T> const& point) { return sdf::intersects(region, {point, point}); };
+    auto in_band   = [&](T distance) { return distance >= -finest_corner && distance <= width; };
+
+    // Added volumes only change the combined distance where theirs is smaller, and subtracted ones
+    // where the negation of theirs is larger. Further than the band width (plus the lower bound of
+    // the band) away from the region the result is either unchanged or outside of the band, so those
+    // volumes are skipped and the cost of an edit follows the volumes near it.
+    auto const reach = glm::vec<L, T>(width + finest_corner);
+
+    operations.erase(std::remove_if(operations.begin(),
+                                    operations.end(),
+                                    [&](auto const& id_and_operation) {
+                                        auto const& operation = *id_and_operation.second;
+                                        if (operation.type == VolumeOperationType::Intersect) {
+                                            return false;
+                                        }
+                                        auto const bounds = operation.world_bounds();
+                                        return !sdf::intersects(region,
+                                                                {bounds.min_point - reach, bounds.max_point + reach});
+                                    }),
+                     operations.end());
+    if (operations.empty() && start == BandStart::Current) {
+        return;
+    }
+
+    // The band cells in the region can change even where the volumes aren't close to the band
+    auto const min_cell = get_cell(region.min_point, finest_resolution);
+    auto const max_cell = get_cell(region.max_point, finest_resolution);
+
+    auto num_region_cells = 1.0;
+    for (auto d = 0; d < L; ++d) {
+        num_region_cells *= double(max_cell[d]) - double(min_cell[d]) + 1.0;
+    }
+
+    CellSet candidates;
+
+    // Looking up the cells of a small region is cheaper than visiting the whole band
+    if (num_region_cells < double(band_cells.size())) {
+        iterate(min_cell, max_cell, [&](Cell const& cell) {
+            if (band_cells.find(cell) != band_cells.end() && in_region(dvh::cell_center(cell, finest_resolution))) {
+                candidates.emplace(cell);
+            }
+        });
+    } else {
+        for (auto const& cell_and_distance : band_cells) {
+            if (in_region(dvh::cell_center(cell_and_distance.first, finest_resolution))) {
+                candidates.emplace(cell_and_distance.first);
+            }
+        }
+    }
+
+    // Start on the finest level where the region is only a few cells wide
+    auto const extent = region.max_point - region.min_point;
+
+    auto level = lowest_level_;
+    while (level + 1 < max_level_ && glm::any(glm::greaterThan(extent, glm::vec<L, T>(resolution(level) * T(4))))) {
+        ++level;
+    }
+
+    std::vector<Cell> cells;
+    if (!operations.empty()) {
+        iterate(get_cell(region.min_point, resolution(level)),
+                get_cell(region.max_point, resolution(level)),
+                [&cells](Cell const& cell) { cells.emplace_back(cell); });
+    }
+
+    std::vector<Cell>           children;
+    std::vector<glm::vec<L, T>> points;
+    std::vector<BandDistance>   distances;
+    std::vector<BandDistance>   lower_distances;
+
+    auto const num_batches = [&cells] { return (cells.size() + parallel_grain_size - 1) / parallel_grain_size; };
+
+    // Cells that aren't in the band combine from either end of it, so only the combined distances
+    // starting outside and (with the current band) entirely inside decide which cells are split
+    for (; level > lowest_level_ && !cells.empty(); --level) {
+        auto const level_resolution = resolution(level);
+        auto const lower            = (start == BandStart::Current);
+
+        points.resize(cells.size());
+        distances.assign(cells.size(), {not_fully_inside, {}});
+        lower_distances.assign(lower ? cells.size() : 0ul, {-not_fully_inside, {}});
+
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            points[i] = dvh::cell_center(cells[i], level_resolution);
+        }
+
+        util::ThreadPool::shared().parallel_for(0, num_batches(), [&](std::size_t batch) {
+            auto const begin = batch * parallel_grain_size;
+            auto const end   = std::min(begin + parallel_grain_size, cells.size());
+
+            combine_volumes(operations,
+                            points.data() + begin,
+                            end - begin,
+                            distances.data() + begin,
+                            lower ? lower_distances.data() + begin : nullptr);
+        });
+
+        // Only cells within their corner distance of the band can contain band cells
+        auto const corner    = glm::length(glm::vec<L, T>(level_resolution * T(0.5)));
+        auto const near_band = [&](T distance) {
+            return distance >= -finest_corner - corner && distance <= width + corner;
+        };
+
+        children.clear();
+        for (auto i = 0ul; i < cells.size(); ++i) {
+            if ((near_band(distances[i].distance) || (lower && near_band(lower_distances[i].distance)))
+                && sdf::intersects(region, {points[i] - corner, points[i] + corner})) {
+                for (auto const& child : children_cells(cells[i])) {
+                    children.emplace_back(child);
+                }
+            }
+        }
+        std::swap(cells, children);
+    }
+
+    for (auto const& cell : cells) {
+        if (in_region(dvh::cell_center(cell, finest_resolution))) {
+            candidates.emplace(cell);
+        }
+    }
+    cells.assign(candidates.begin(), candidates.end());
+
+    points.resize(cells.size());
+    distances.resize(cells.size());
+
+    util::ThreadPool::shared().parallel_for(0, num_batches(), [&](std::size_t batch) {
+        auto const begin = batch * parallel_grain_size;
+        auto const end   = std::min(begin + parallel_grain_size, cells.size());
+
+        for (auto i = begin; i < end; ++i) {
+            points[i]    = dvh::cell_center(cells[i], finest_resolution);
+            distances[i] = {not_fully_inside, {}};
+
+            if (start == BandStart::Current) {
+                if (auto iter = band_cells.find(cells[i]); iter != band_cells.end()) {
+                    distances[i] = iter->second;
+                } else if (auto const deepest = find_deepest(points[i]);
+                           deepest.value && (*deepest.value)[L] != not_fully_inside) {
+                    distances[i] = {-not_fully_inside, {}};
+                }
+            }
+        }
+        combine_volumes(operations, points.data() + begin, end - begin, distances.data() + begin);
+    });
+
+    for (auto i = 0ul; i < cells.size(); ++i) {
+        auto const iter     = band_cells.find(cells[i]);
+        auto const original = (iter != band_cells.end() ? std::optional(iter->second) : std::nullopt);
+
+        if (in_band(distances[i].distance)) {
+            if (original && original->distance == distances[i].distance && original->volume == distances[i].volume) {
+                continue;
+            }
+            band_cells.insert_or_assign(cells[i], distances[i]);
+        } else if (original) {
+            band_cells.erase(iter);
+        } else {
+            continue;
+        }
+
+        record_band_original(cells[i], original ? std::optional(original->distance) : std::nullopt);
+        if (journal) {
+            journal->try_emplace(cells[i], original);
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::record_band_original(Cell const& cell, std::optional<T> distance) -> void {
+    if (band_changes_) {
+        band_changes_->try_emplace(cell, distance);
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::record_band_originals() -> void {
+    if (band_changes_ && narrow_band_) {
+        for (auto const& [cell, distance] : narrow_band_->cells) {
+            band_changes_->try_emplace(cell, distance.distance);
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::begin_operation(VolumeOperation<L, T>              operation,
+                                                       bool                               record_journal,
+                                                       std::shared_ptr<RootOwners> const& root_owners,
+                                                       std::size_t                        batch_index) -> PendingOperation {
+    PendingOperation pending;
+    pending.root_owners = root_owners;
+    pending.batch_index = batch_index;
+    pending.region      = domain_;
+
+    if (record_journal) {
+        pending.journal        = Journal{};
+        pending.previous_roots = roots_;
+        for (auto const& level : levels_) {
+            pending.previous_levels.emplace_back(level.first);
+        }
+    }
+
+    auto const bounds = operation.world_bounds();
+
+    if (operation.type == VolumeOperationType::Add && !sdf::is_empty(bounds)) {
+        add_roots_for_bounds(bounds, root_owners.get(), batch_index);
+    }
+
+    // Nothing to refine if there are no roots or the operation has no geometry (intersecting
+    // with nothing still has to remove every cell)
+    if (roots_.empty() || (sdf::is_empty(bounds) && operation.type != VolumeOperationType::Intersect)) {
+        pending.level = lowest_level_ - 1;
+    } else {
+        pending.level = roots_.begin()->first;
+    }
+
+    pending.operation = std::move(operation);
+    return pending;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::step(PendingOperation* pending, std::size_t max_cells) -> bool {
+    if (pending->level < lowest_level_) {
+        return true;
+    }
+
+    if (!pending->level_started) {
+        remove_children(pending);
+        gather_frontier(pending);
+    }
+
+    auto const begin_cell = pending->next_cell;
+    auto const end_cell   = begin_cell + std::min(max_cells, pending->cells.size() - begin_cell);
+
+    // Geometry evaluation is independent per cell so it is done in parallel
+    // before the (sequential) hash map updates below.
+    std::vector<glm::vec<L, T>> points(end_cell - begin_cell);
+    std::vector<T>              distances(end_cell - begin_cell);
+
+    auto const num_batches = (points.size() + parallel_grain_size - 1) / parallel_grain_size;
+
+    util::ThreadPool::shared().parallel_for(0, num_batches, [&](std::size_t batch) {
+        auto const batch_begin = batch * parallel_grain_size;
+        auto const batch_end   = std::min(batch_begin + parallel_grain_size, points.size());
+
+        evaluate_cells(*pending,
+                       begin_cell + batch_begin,
+                       begin_cell + batch_end,
+                       points.data() + batch_begin,
+                       distances.data() + batch_begin);
+    });
+
+    apply_cells(pending, begin_cell, end_cell, points.data(), distances.data());
+
+    if (pending->on_progress) {
+        pending->on_progress(
+            {pending->level, pending->next_cell, pending->cells.size(), pending->total_cells_processed});
+    }
+
+    if (pending->next_cell == pending->cells.size()) {
+        finish_level(pending);
+    }
+
+    return pending->level < lowest_level_;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::evaluate_cells(PendingOperation const& pending,
+                                                      std::size_t             begin_cell,
+                                                      std::size_t             end_cell,
+                                                      glm::vec<L, T>*         points,
+                                                      T*                      distances) const -> void {
+    auto const level_resolution = resolution(pending.level);
+    auto const num_cells        = end_cell - begin_cell;
+
+    for (auto i = 0ul; i < num_cells; ++i) {
+        points[i] = dvh::cell_center(pending.cells[begin_cell + i].first, level_resolution);
+    }
+
+    evaluate_operation(pending.operation, points, num_cells, distances);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::apply_cells(PendingOperation*     pending,
+                                                   std::size_t           begin_cell,
+                                                   std::size_t           end_cell,
+                                                   glm::vec<L, T> const* points,
+                                                   T const*              distances) -> void {
+    auto& distance_field = level_cells(pending->level);
+
+    auto level_resolution = resolution(pending->level);
+    auto half_resolution  = level_resolution * T(0.5);
+    auto cell_corner_dist = glm::length(glm::vec<L, T>(half_resolution));
+
+    for (auto i = begin_cell; i < end_cell; ++i) {
+        auto const& [cell, state] = pending->cells[i];
+        auto const& p             = points[i - begin_cell];
+        auto const  min_dist      = distances[i - begin_cell];
+
+        switch (pending->operation.type) {
+        case VolumeOperationType::Add:
+            process_add(pending, distance_field, cell, p, min_dist, cell_corner_dist);
+            break;
+        case VolumeOperationType::Subtract:
+            process_subtract(pending, distance_field, cell, state, p, min_dist, cell_corner_dist);
+            break;
+        case VolumeOperationType::Intersect:
+            process_intersect(pending, distance_field, cell, state, p, min_dist, cell_corner_dist);
+            break;
+        }
+    }
+
+    pending->next_cell += end_cell - begin_cell;
+    pending->total_cells_processed += end_cell - begin_cell;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::remove_children(PendingOperation* pending) -> void {
+    auto level = pending->level;
+
+    // Make sure the level exists even if nothing is added to it
+    level_cells(level);
+
+    CellSet parents;
+    std::swap(parents, pending->parents_to_clear);
+
+    // The masks are read when the children are removed (not when the parent was cleared) because
+    // earlier operations of a batch may have added children in between.
+    std::vector<Cell> children;
+
+    for (const auto& parent : parents) {
+        children.clear();
+        for_each_child(level + 1, parent, [&children](Cell const& child) { children.emplace_back(child); });
+
+        for (auto const& child : children) {
+            erase_cell(pending, level, child);
+            pending->parents_to_clear.insert(child);
+        }
+    }
+
+    if (pending->operation.type == VolumeOperationType::Intersect) {
+        // Nothing outside of the bounds is kept so those cells are removed without being evaluated.
+        // The test is nested so this also removes every descendant when the finer levels are reached.
+        auto const bounds = pending->operation.world_bounds();
+        auto&      field  = level_cells(level);
+
+        std::vector<Cell> outside;
+        for (auto const& [cell, value] : field) {
+            if (!overlaps(bounds, level, cell) && (!pending->region || overlaps(*pending->region, level, cell))) {
+                outside.emplace_back(cell);
+            }
+        }
+        for (auto const& cell : outside) {
+            erase_cell(pending, level, cell);
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::gather_frontier(PendingOperation* pending) -> void {
+    auto level = pending->level;
+
+    if (auto roots_iter = roots_.find(level); roots_iter != roots_.end()) {
+        for (const auto& root_cell : roots_iter->second) {
+            if (is_root_visible(pending->root_owners.get(), pending->batch_index, level, root_cell)) {
+                pending->to_visit.try_emplace(root_cell, VisitState::DoesNotMatter);
+            }
+        }
+    }
+
+    pending->cells.assign(pending->to_visit.begin(), pending->to_visit.end());
+    pending->to_visit.clear();
+
+    // Skip cells the operation can't change. Children are contained by their parents so skipped
+    // cells never need to be descended.
+    auto const bounds = pending->operation.world_bounds();
+
+    auto is_unaffected = [this, pending, level, &bounds](auto const& cell_and_state) {
+        auto const& cell = cell_and_state.first;
+        return !overlaps(bounds, level, cell) || (pending->region && !overlaps(*pending->region, level, cell));
+    };
+    pending->cells.erase(std::remove_if(pending->cells.begin(), pending->cells.end(), is_unaffected),
+                         pending->cells.end());
+
+    pending->next_cell     = 0;
+    pending->level_started = true;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::is_root_visible(RootOwners const* owners,
+                                                       std::size_t       owner,
+                                                       int               level,
+                                                       Cell const&       root_cell) const -> bool {
+    if (!owners) {
+        return true;
+    }
+
+    // Roots added by later operations of the same batch did not exist yet for this operation
+    if (auto level_owners = owners->find(level); level_owners != owners->end()) {
+        if (auto root_owner = level_owners->second.find(root_cell); root_owner != level_owners->second.end()) {
+            return root_owner->second <= owner;
+        }
+    }
+    return true;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::finish_level(PendingOperation* pending) -> void {
+    pending->cells.clear();
+    pending->next_cell     = 0;
+    pending->level_started = false;
+    --pending->level;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::overlaps(sdf::AABB<L, T> const& region, int level, Cell const& cell) const
+    -> bool {
+    // Cells are visited (and subtractions propagate their state to children) when their parent's
+    // bounding sphere touches a surface, so the parent's sphere bounds everything that can change
+    // this cell. Checking the parent also keeps the test nested: children never overlap a region
+    // their parent doesn't.
+    auto parent_resolution = resolution(level + 1);
+    auto cell_corner_dist  = glm::length(glm::vec<L, T>(parent_resolution * T(0.5)));
+    auto center            = dvh::cell_center(parent_cell(cell), parent_resolution);
+
+    return sdf::intersects(region, {center - cell_corner_dist, center + cell_corner_dist});
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::process_add(PendingOperation*     pending,
+                                                   SparseVolumeMap&      distance_field,
+                                                   Cell const&           cell,
+                                                   glm::vec<L, T> const& p,
+                                                   T                     min_dist,
+                                                   T                     cell_corner_dist) -> void {
+    auto const level        = pending->level;
+    auto const min_abs_dist = std::abs(min_dist);
+
+    bool inside_volume = (min_dist < 0.f);
+
+    auto value_to_store = (min_abs_dist <= cell_corner_dist ? not_fully_inside : min_dist);
+
+    if (value_to_store == not_fully_inside) {
+        // Cell may not be fully inside the volume, but it is close to the
+        // border so descendants might be inside the volume.
+
+        // Add if the cell does not already exist. If it does exist it is either an
+        // inside value we should not overwrite or it is already a 'not_fully_inside' value.
+        if (distance_field.find(cell) == distance_field.end()) {
+            set_cell(pending, level, cell, VecDist(not_fully_inside));
+        }
+
+    } else if (inside_volume) {
+        // This is entirely contained by the volume
+
+        // Add/replace the cell if it doesn't exist or the current value contains a smaller distance
+        if (auto iter = distance_field.find(cell); iter == distance_field.end()) {
+            set_cell(pending, level, cell, VecDist(p, value_to_store));
+
+        } else if (iter->second[L] > min_abs_dist) {
+            auto old_dist = iter->second[L];
+            set_cell(pending, level, cell, VecDist(p, value_to_store));
+
+            if (old_dist == not_fully_inside) {
+                pending->parents_to_clear.insert(cell);
+            }
+        }
+    }
+
+    if (auto iter = distance_field.find(cell); iter != distance_field.end() && iter->second[L] == not_fully_inside) {
+        for (const auto& child_cell : children_cells(cell)) {
+            pending->to_visit.try_emplace(child_cell, VisitState::DoesNotMatter);
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::process_subtract(PendingOperation*     pending,
+                                                        SparseVolumeMap&      distance_field,
+                                                        Cell const&           cell,
+                                                        VisitState            state,
+                                                        glm::vec<L, T> const& p,
+                                                        T                     min_dist,
+                                                        T                     cell_corner_dist) -> void {
+    auto const level = pending->level;
+
+    if (min_dist < -cell_corner_dist) {
+        erase_cell(pending, level, cell);
+        pending->parents_to_clear.insert(cell);
+
+    } else if (min_dist < cell_corner_dist) {
+        VisitState children_state = state;
+
+        if (auto iter = distance_field.find(cell); iter != distance_field.end()) {
+            if (iter->second[L] < 0.f) {
+                children_state = VisitState::PreviouslyInside;
+            }
+            set_cell(pending, level, cell, VecDist(not_fully_inside));
+
+        } else if (state == VisitState::PreviouslyInside) {
+            // Part of a cell that used to be inside. Its children may be kept so it has to exist.
+            set_cell(pending, level, cell, VecDist(not_fully_inside));
+        }
+
+        visit_children(pending, cell, children_state);
+
+    } else {
+        if (auto previous = distance_field.find(cell);
+            previous == distance_field.end() || previous->second[L] < -min_dist) {
+            if (state == VisitState::PreviouslyInside) {
+                set_cell(pending, level, cell, VecDist(p, -min_dist));
+            }
+        }
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::process_intersect(PendingOperation*     pending,
+                                                         SparseVolumeMap&      distance_field,
+                                                         Cell const&           cell,
+                                                         VisitState            state,
+                                                         glm::vec<L, T> const& p,
+                                                         T                     min_dist,
+                                                         T                     cell_corner_dist) -> void {
+    auto const level = pending->level;
+
+    if (min_dist > cell_corner_dist) {
+        // Entirely outside of the intersecting volume
+        if (erase_cell(pending, level, cell)) {
+            pending->parents_to_clear.insert(cell);
+        }
+
+    } else if (min_dist < -cell_corner_dist) {
+        // Entirely inside so the cell and its children are kept as they are
+        if (state == VisitState::PreviouslyInside && distance_field.find(cell) == distance_field.end()) {
+            set_cell(pending, level, cell, VecDist(p, min_dist));
+        }
+
+    } else {
+        VisitState children_state = state;
+
+        if (auto iter = distance_field.find(cell); iter != distance_field.end()) {
+            if (iter->second[L] < 0.f) {
+                children_state = VisitState::PreviouslyInside;
+                set_cell(pending, level, cell, VecDist(not_fully_inside));
+            }
+
+        } else if (state == VisitState::PreviouslyInside) {
+            set_cell(pending, level, cell, VecDist(not_fully_inside));
+
+        } else {
+            // Nothing here to intersect
+            return;
+        }
+
+        visit_children(pending, cell, children_state);
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::roll_back(PendingOperation* pending) -> void {
+    if (pending->band_journal && narrow_band_) {
+        for (auto const& [cell, original] : *pending->band_journal) {
+            if (original) {
+                narrow_band_->cells.insert_or_assign(cell, *original);
+            } else {
+                narrow_band_->cells.erase(cell);
+            }
+        }
+    }
+    pending->band_journal = std::nullopt;
+
+    if (!pending->journal) {
+        return;
+    }
+
+    for (auto const& [level, original_cells] : *pending->journal) {
+        for (auto const& [cell, original_value] : original_cells) {
+            if (original_value) {
+                set_cell(nullptr, level, cell, *original_value);
+            } else {
+                erase_cell(nullptr, level, cell);
+            }
+        }
+    }
+
+    // Remove levels that were created by the operation
+    for (auto iter = levels_.begin(); iter != levels_.end();) {
+        if (std::find(pending->previous_levels.begin(), pending->previous_levels.end(), iter->first)
+            == pending->previous_levels.end()) {
+            iter = levels_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    roots_ = *pending->previous_roots;
+
+    pending->journal = std::nullopt;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::set_cell(PendingOperation* pending,
+                                                int               level,
+                                                Cell const&       cell,
+                                                VecDist const&    value) -> void {
+    auto& distance_field = level_cells(level);
+
+    auto record_original = [&](Journal* journal) {
+        auto& original_cells = (*journal)[level];
+
+        if (original_cells.find(cell) == original_cells.end()) {
+            auto iter = distance_field.find(cell);
+            original_cells.emplace(cell, iter == distance_field.end() ? std::nullopt : std::optional(iter->second));
+        }
+    };
+
+    if (pending && pending->journal) {
+        record_original(&*pending->journal);
+    }
+    if (changes_) {
+        record_original(&*changes_);
+    }
+
+    ++revision_;
+
+    if (distance_field.insert_or_assign(cell, value).second) {
+        child_masks_[level + 1][parent_cell(cell)] |= ChildMask(1u << child_index(cell));
+    }
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::erase_cell(PendingOperation* pending, int level, Cell const& cell) -> bool {
+    auto level_iter = levels_.find(level);
+    if (level_iter == levels_.end()) {
+        return false;
+    }
+
+    auto& distance_field = level_iter->second;
+
+    auto iter = distance_field.find(cell);
+    if (iter == distance_field.end()) {
+        return false;
+    }
+
+    if (pending && pending->journal) {
+        (*pending->journal)[level].try_emplace(cell, iter->second);
+    }
+    if (changes_) {
+        (*changes_)[level].try_emplace(cell, iter->second);
+    }
+
+    distance_field.erase(cell);
+    ++revision_;
+
+    auto& masks = child_masks_[level + 1];
+    auto  mask  = masks.find(parent_cell(cell));
+    mask->second &= ChildMask(~(1u << child_index(cell)));
+    if (mask->second == 0u) {
+        masks.erase(mask);
+    }
+    return true;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::level_cells(int level) -> SparseVolumeMap& {
+    auto& cells = levels_[level];
+    if (leaf_bricks_ && level == lowest_level_ && !cells.bricked()) {
+        cells.use_bricks(resolution(level));
+    }
+    return cells;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::visit_children(PendingOperation* pending,
+                                                      Cell const&       cell,
+                                                      VisitState        children_state) -> void {
+    auto visit = [pending, children_state](Cell const& child) {
+        pending->to_visit.insert_or_assign(child, children_state);
+    };
+
+    // Subtracting or intersecting never creates a cell that used to be outside, so only existing
+    // children can change unless they are part of a cell that used to be inside.
+    if (children_state == VisitState::PreviouslyInside) {
+        for (auto const& child : children_cells(cell)) {
+            visit(child);
+        }
+    } else if (pending->batched) {
+        for (auto const& child : children_cells(cell)) {
+            pending->to_visit.insert_or_assign(child, VisitState::ExistingOnly);
+        }
+    } else {
+        for_each_child(pending->level, cell, visit);
+    }
+}
+
+template <int L, typename T>
+DistanceVolumeHierarchyCpu<L, T>::LastBuild::LastBuild(LastBuild const& other) {
+    other.wait();
+    future = other.future;
+}
+
+template <int L, typename T>
+DistanceVolumeHierarchyCpu<L, T>::LastBuild::LastBuild(LastBuild&& other) {
+    other.wait();
+    future = std::move(other.future);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::LastBuild::operator=(LastBuild const& other) -> LastBuild& {
+    wait();
+    other.wait();
+    future = other.future;
+    return *this;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::LastBuild::operator=(LastBuild&& other) -> LastBuild& {
+    wait();
+    other.wait();
+    future = std::move(other.future);
+    return *this;
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::LastBuild::wait() const -> void {
+    if (future.valid()) {
+        future.wait();
+    }
+}
+
+template <int L, typename T>
+DistanceVolumeHierarchyCpu<L, T>::QueryCursor::QueryCursor(DistanceVolumeHierarchyCpu const& hierarchy)
+    : hierarchy_(&hierarchy), revision_(hierarchy.revision_) {}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::QueryCursor::distance_at(glm::vec<L, T> const& point,
+                                                                Interpolation         interpolation) -> T {
+    return hierarchy_->interpolate(point, locate(point), interpolation, &leaf_cache_);
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::QueryCursor::reset() -> void {
+    revision_ = hierarchy_->revision_;
+    chain_.clear();
+}
+
+template <int L, typename T>
+auto DistanceVolumeHierarchyCpu<L, T>::QueryCursor::locate(glm::vec<L, T> const& point) -> CellQuery {
+    if (revision_ != hierarchy_->revision_) {
+        reset();
+    }
+
+    // The cells of the chain are nested, so climb until one of them contains the point
+    while (!chain_.empty() && get_cell(point, hierarchy_->resolution(chain_.back().level)) != chain_.back().cell) {
+        chain_.pop_back();
+    }
+
+    // Cells on the lowest level have no children so the previous cell is still the deepest
+    if (!chain_.empty() && chain_.back().level == hierarchy_->lowest_level_) {
+        return chain_.back();
+    }
+
+    auto const start = (chain_.empty() ? CellQuery{} : chain_.back());
+    return hierarchy_->find_deepest(point, start, &chain_, &leaf_cache_);
+}
+
+template class DistanceVolumeHierarchyCpu<2, float>;
+template class DistanceVolumeHierarchyCpu<3, float>;
+template class DistanceVolumeHierarchyCpu<2, double>;
+template class DistanceVolumeHierarchyCpu<3, double>;
+
+namespace {
+
+auto make_test_boxes() -> std::vector<sdf::TransformedGeometry<sdf::Box, 3>> {
+    return {
+        sdf::make_transformed_geometry(sdf::make_box<3>({2.5f, 1.2f, 1.f}), {0.5f, -0.75f, 1.f}),
+        sdf::make_transformed_geometry(sdf::make_box<3>({0.25f, 1.1f, 3.f}), {3.7f, 2.f, -1.f}),
+    };
+}
+
+auto make_test_lines() -> std::vector<sdf::OffsetLine<3>> {
+    return {
+        sdf::make_offset_line<3>({4.5f, 3.25f, 0.3f}, {0.5f, -0.75f, 0.f}, 0.1f),
+        sdf::make_offset_line<3>({0.5f, -0.75f, 0.f}, {0.5f, -0.75f, 5.f}, 0.1f),
+    };
+}
+
+} // namespace
+
+TEST_CASE("[dvh] asynchronous builds match synchronous builds") {
+    DistanceVolumeHierarchyCpu<3, float> sync_dvh(0.1f);
+    sync_dvh.add_volume(make_test_boxes());
+    sync_dvh.subtract_volumes(make_test_lines());
+
+    DistanceVolumeHierarchyCpu<3, float> async_dvh(0.1f);
+
+    std::vector<BuildProgress> progress;
+
+    auto add_handle      = async_dvh.add_volume_async(make_test_boxes());
+    auto subtract_handle = async_dvh.subtract_volumes_async(make_test_lines(), [&](BuildProgress const& update) {
+        progress.emplace_back(update);
+    });
+
+    CHECK(add_handle.get() == BuildStatus::Completed);
+    CHECK(subtract_handle.get() == BuildStatus::Completed);
+
+    CHECK(async_dvh.levels() == sync_dvh.levels());
+
+    REQUIRE_FALSE(progress.empty());
+    CHECK(progress.back().level == DistanceVolumeHierarchyCpu<3, float>::base_level);
+    CHECK(std::is_sorted(progress.begin(), progress.end(), [](auto const& lhs, auto const& rhs) {
+        return lhs.level > rhs.level;
+    }));
+}
+
+TEST_CASE("[dvh] copies and moves wait for asynchronous builds") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh sync_dvh(0.1f);
+    sync_dvh.add_volume(make_test_boxes());
+    sync_dvh.subtract_volumes(make_test_lines());
+
+    Dvh async_dvh(0.1f);
+    async_dvh.add_volume_async(make_test_boxes());
+    async_dvh.subtract_volumes_async(make_test_lines());
+
+    auto const copy = async_dvh;
+    CHECK(copy.levels() == sync_dvh.levels());
+
+    Dvh assigned(0.1f);
+    assigned.add_volume_async(make_test_lines());
+    async_dvh.subtract_volumes_async(make_test_lines());
+    assigned = async_dvh;
+    CHECK(assigned.levels() == sync_dvh.levels());
+
+    async_dvh.add_volume_async(make_test_boxes());
+    sync_dvh.add_volume(make_test_boxes());
+    auto const moved = std::move(async_dvh);
+    CHECK(moved.levels() == sync_dvh.levels());
+
+    assigned.subtract_volumes_async(make_test_lines());
+    assigned = Dvh(0.1f);
+    CHECK(assigned.levels().empty());
+}
+
+TEST_CASE("[dvh] progressive refinement matches synchronous builds") {
+    DistanceVolumeHierarchyCpu<3, float> sync_dvh(0.1f);
+    sync_dvh.add_volume(make_test_boxes());
+
+    DistanceVolumeHierarchyCpu<3, float> progressive_dvh(0.1f);
+    progressive_dvh.queue_add_volume(make_test_boxes());
+
+    CHECK_FALSE(progressive_dvh.is_refined());
+
+    auto num_calls = 0;
+    while (!progressive_dvh.refine(std::chrono::steady_clock::duration::zero())) {
+        ++num_calls;
+
+        // Cells known to be inside the volume never change while adding a volume
+        for (auto const& [level, cells] : progressive_dvh.levels()) {
+            for (auto const& [cell, vec_dist] : cells) {
+                if (vec_dist[3] != DistanceVolumeHierarchyCpu<3, float>::not_fully_inside) {
+                    REQUIRE(sync_dvh.levels().at(level).at(cell) == vec_dist);
+                }
+            }
+        }
+    }
+
+    CHECK(num_calls > 1);
+    CHECK(progressive_dvh.is_refined());
+    CHECK(progressive_dvh.levels() == sync_dvh.levels());
+
+    // Synchronous operations finish any queued refinement first
+    sync_dvh.subtract_volumes(make_test_lines());
+
+    progressive_dvh.queue_subtract_volumes(make_test_lines());
+    progressive_dvh.refine(std::chrono::steady_clock::duration::zero());
+    progressive_dvh.add_volume(std::vector<sdf::TransformedGeometry<sdf::Box, 3>>{});
+
+    CHECK(progressive_dvh.is_refined());
+    CHECK(progressive_dvh.levels() == sync_dvh.levels());
+
+    // Queuing waits for asynchronous builds, which refine queued operations on their own thread
+    DistanceVolumeHierarchyCpu<3, float> async_dvh(0.1f);
+    async_dvh.queue_add_volume(make_test_boxes());
+    auto const handle = async_dvh.subtract_volumes_async(make_test_lines());
+    async_dvh.queue_add_volume(std::vector<sdf::TransformedGeometry<sdf::Box, 3>>{});
+
+    CHECK(handle.is_ready());
+    while (!async_dvh.refine(std::chrono::steady_clock::duration::zero())) {
+    }
+    CHECK(async_dvh.levels() == sync_dvh.levels());
+}
+
+TEST_CASE("[dvh] rebuilding a region matches a full rebuild") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+
+    auto boxes = make_test_boxes();
+    auto lines = make_test_lines();
+
+    auto const make_operations = [&] {
+        std::vector<VolumeOperation<3, float>> operations;
+        for (auto const& box : boxes) {
+            operations.emplace_back(make_volume_operation<3, float>(VolumeOperationType::Add, Boxes{box}));
+        }
+        operations.emplace_back(make_volume_operation<3, float>(VolumeOperationType::Subtract, lines));
+        return operations;
+    };
+
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.1f);
+
+    std::vector<VolumeHandle> volumes;
+    for (auto const& box : boxes) {
+        volumes.emplace_back(dvh.add_volume(Boxes{box}));
+    }
+    volumes.emplace_back(dvh.subtract_volumes(lines));
+
+    // Move the second box
+    auto region = boxes[1].bounding_box();
+    boxes[1]    = sdf::make_transformed_geometry(sdf::make_box<3>({0.25f, 1.1f, 3.f}), {3.2f, 2.1f, -0.5f});
+    region      = sdf::expand(region, boxes[1].bounding_box());
+
+    auto const rebuilt_volumes = dvh.rebuild_region(region, make_operations());
+    REQUIRE(rebuilt_volumes);
+    CHECK(*rebuilt_volumes == volumes);
+
+    auto const make_expected = [&] {
+        DistanceVolumeHierarchyCpu<3, float> expected_dvh(0.1f);
+        for (auto const& box : boxes) {
+            expected_dvh.add_volume(Boxes{box});
+        }
+        expected_dvh.subtract_volumes(lines);
+        return expected_dvh;
+    };
+
+    CHECK(dvh.levels() == make_expected().levels());
+
+    // The handles still refer to the same volumes
+    CHECK(dvh.remove_volume(volumes[0]));
+    boxes.erase(boxes.begin());
+
+    CHECK(dvh.levels() == make_expected().levels());
+}
+
+TEST_CASE("[dvh] replays keep the cells that weren't built by recorded volumes") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+
+    auto const filename = (std::filesystem::temp_directory_path() / "ltb_dvh_replay_test.bin").string();
+
+    auto const box     = sdf::make_transformed_geometry(sdf::make_box<3>({0.5f, 0.5f, 0.5f}), {});
+    auto const far_box = sdf::make_transformed_geometry(sdf::make_box<3>({0.5f, 0.5f, 0.5f}), {20.f, 0.f, 0.f});
+
+    DistanceVolumeHierarchyCpu<3, float> saved(0.1f);
+    saved.add_volume(Boxes{box});
+    REQUIRE(saved.save(filename));
+
+    DistanceVolumeHierarchyCpu<3, float> loaded(0.1f);
+    REQUIRE(loaded.load(filename));
+    std::filesystem::remove(filename);
+
+    auto const inside_distance = loaded.distance_at({0.f, 0.f, 0.f});
+    REQUIRE(inside_distance < 0.f);
+
+    // Rebuilding far away from the loaded box keeps its cells and roots
+    auto const far_volumes = loaded.rebuild_region(
+        far_box.bounding_box(),
+        {make_volume_operation<3, float>(VolumeOperationType::Add, Boxes{far_box})});
+    REQUIRE(far_volumes);
+    REQUIRE(far_volumes->size() == 1u);
+
+    CHECK(loaded.distance_at({0.f, 0.f, 0.f}) == inside_distance);
+    CHECK(loaded.distance_at({20.f, 0.f, 0.f}) < 0.f);
+    CHECK(loaded.raycast({-2.f, 0.f, 0.f}, {1.f, 0.f, 0.f}));
+
+    // So does moving the new volume
+    CHECK(loaded.move_volume(far_volumes->front(), {0.f, 2.f, 0.f}));
+    CHECK(loaded.distance_at({0.f, 0.f, 0.f}) == inside_distance);
+    CHECK(loaded.distance_at({20.f, 0.f, 0.f}) == DistanceVolumeHierarchyCpu<3, float>::not_fully_inside);
+    CHECK(loaded.distance_at({20.f, 2.f, 0.f}) < 0.f);
+
+    // Volumes next to the loaded cells can't be moved or removed since the cells can't be recomputed
+    auto const levels      = loaded.levels();
+    auto const near_box    = sdf::make_transformed_geometry(sdf::make_box<3>({0.5f, 0.5f, 0.5f}), {0.6f, 0.f, 0.f});
+    auto const near_volume = loaded.add_volume(Boxes{near_box});
+    auto const near_levels = loaded.levels();
+
+    CHECK(near_levels != levels);
+    CHECK_FALSE(loaded.remove_volume(near_volume));
+    CHECK_FALSE(loaded.move_volume(near_volume, {0.f, 1.f, 0.f}));
+    CHECK_FALSE(loaded.rebuild_region(near_box.bounding_box(), {}));
+    CHECK(loaded.levels() == near_levels);
+}
+
+TEST_CASE("[dvh] volumes can be moved and removed through their handles") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+
+    auto boxes = make_test_boxes();
+    auto lines = make_test_lines();
+
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.1f);
+
+    std::vector<VolumeHandle> box_volumes;
+    for (auto const& box : boxes) {
+        box_volumes.emplace_back(dvh.add_volume(Boxes{box}));
+    }
+    auto line_volume = dvh.subtract_volumes(lines);
+
+    CHECK(box_volumes[0] != box_volumes[1]);
+    CHECK(dvh.move_volume(box_volumes[1], {-0.5f, 0.1f, 0.5f}));
+
+    boxes[1].translation += glm::vec3(-0.5f, 0.1f, 0.5f);
+
+    {
+        DistanceVolumeHierarchyCpu<3, float> expected_dvh(0.1f);
+        for (auto const& box : boxes) {
+            expected_dvh.add_volume(Boxes{box});
+        }
+        expected_dvh.subtract_volumes(lines);
+
+        CHECK(dvh.levels() == expected_dvh.levels());
+    }
+
+    CHECK(dvh.remove_volume(line_volume));
+    CHECK_FALSE(dvh.remove_volume(line_volume));
+    CHECK_FALSE(dvh.move_volume(VolumeHandle{}, {}));
+
+    {
+        DistanceVolumeHierarchyCpu<3, float> expected_dvh(0.1f);
+        for (auto const& box : boxes) {
+            expected_dvh.add_volume(Boxes{box});
+        }
+
+        CHECK(dvh.levels() == expected_dvh.levels());
+    }
+}
+
+TEST_CASE("[dvh] moving a volume every frame matches rebuilding the hierarchy") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+
+    auto const part    = make_test_boxes();
+    auto const lines   = make_test_lines();
+    auto const fixture = sdf::make_transformed_geometry(sdf::make_box<3>({0.3f, 0.3f, 0.3f}), {6.f, 0.f, 0.f});
+    auto const keep    = sdf::make_transformed_geometry(sdf::make_box<3>({3.f, 3.f, 3.f}), {2.f, 0.f, 0.f});
+
+    auto make_expected = [&](glm::vec3 const& fixture_translation, glm::vec3 const& keep_translation) {
+        auto fixture_operation        = make_volume_operation<3, float>(VolumeOperationType::Add, Boxes{fixture});
+        auto keep_operation           = make_volume_operation<3, float>(VolumeOperationType::Intersect, Boxes{keep});
+        fixture_operation.translation = fixture_translation;
+        keep_operation.translation    = keep_translation;
+
+        EditBatch<3> batch;
+        batch.add_volume(part).subtract_volumes(lines).add_operation(fixture_operation).add_operation(keep_operation);
+
+        DistanceVolumeHierarchyCpu<3, float> expected_dvh(0.1f);
+        expected_dvh.apply(std::move(batch));
+        return expected_dvh;
+    };
+
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.1f);
+    dvh.add_volume(part);
+    dvh.subtract_volumes(lines);
+    auto const fixture_volume = dvh.add_volume(Boxes{fixture});
+    auto const keep_volume    = dvh.intersect_volumes(Boxes{keep});
+
+    for (auto frame = 1; frame <= 4; ++frame) {
+        auto const translation = glm::vec3(0.f, 0.3f, 0.2f) * float(frame);
+        REQUIRE(dvh.move_volume(fixture_volume, translation));
+        CHECK(dvh.levels() == make_expected(translation, glm::vec3(0.f)).levels());
+    }
+
+    // Moving an intersection brings back everything that was outside of it
+    REQUIRE(dvh.move_volume(keep_volume, {1.5f, 0.f, 0.f}));
+    CHECK(dvh.levels() == make_expected(glm::vec3(0.f, 1.2f, 0.8f), {1.5f, 0.f, 0.f}).levels());
+}
+
+TEST_CASE("[dvh] batched edits match individual edits") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+
+    auto boxes = make_test_boxes();
+    boxes.emplace_back(sdf::make_transformed_geometry(sdf::make_box<3>({0.5f, 0.5f, 0.5f}), {-4.f, 3.f, 2.f}));
+
+    auto envelope = Boxes{sdf::make_transformed_geometry(sdf::make_box<3>({4.f, 3.f, 3.f}), {1.f, 0.5f, 0.f})};
+
+    DistanceVolumeHierarchyCpu<3, float> expected_dvh(0.1f);
+    expected_dvh.add_volume(Boxes{boxes[0]});
+    expected_dvh.subtract_volumes(make_test_lines());
+    expected_dvh.add_volume(Boxes{boxes[1]});
+    expected_dvh.add_volume(Boxes{boxes[2]});
+    expected_dvh.intersect_volumes(envelope);
+
+    EditBatch<3> batch;
+    batch.add_volume(Boxes{boxes[0]})
+        .subtract_volumes(make_test_lines())
+        .add_volume(Boxes{boxes[1]})
+        .add_volume(Boxes{boxes[2]})
+        .intersect_volumes(envelope);
+
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.1f);
+    auto volumes = dvh.apply(std::move(batch));
+
+    CHECK(volumes.size() == 5ul);
+    CHECK(dvh.levels() == expected_dvh.levels());
+
+    // Batch volumes can be edited like any other volume
+    CHECK(dvh.remove_volume(volumes[1]));
+    CHECK(expected_dvh.remove_volume(VolumeHandle(2u)));
+    CHECK(dvh.levels() == expected_dvh.levels());
+}
+
+TEST_CASE("[dvh] batches of many overlapping edits match individual edits") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+    using Lines = std::vector<sdf::OffsetLine<3>>;
+    using Dvh   = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const base = Boxes{sdf::make_transformed_geometry(sdf::make_box<3>({3.f, 1.f, 1.f}), {0.5f, 0.f, 0.f})};
+
+    Dvh expected_dvh(0.1f);
+    Dvh dvh(0.1f);
+
+    for (auto* hierarchy : {&expected_dvh, &dvh}) {
+        hierarchy->set_domain(sdf::AABB<3, float>{{-2.f, -2.f, -2.f}, {2.5f, 2.f, 2.f}});
+        hierarchy->add_volume(base);
+    }
+
+    // Small boxes that overlap the existing cells and each other, with subtractions in between
+    EditBatch<3> batch;
+    for (int i = 0; i < 24; ++i) {
+        auto const offset = glm::vec3(float(i % 6) * 0.55f - 1.2f, float(i / 6) * 0.45f - 0.7f, float(i % 3) * 0.3f);
+
+        if (i % 5 == 4) {
+            auto const lines = Lines{sdf::make_offset_line<3>(offset - glm::vec3(0.f, 0.f, 1.f), offset, 0.15f)};
+            expected_dvh.subtract_volumes(lines);
+            batch.subtract_volumes(lines);
+        } else {
+            auto const boxes = Boxes{sdf::make_transformed_geometry(sdf::make_box<3>({0.4f, 0.4f, 0.4f}), offset)};
+            expected_dvh.add_volume(boxes);
+            batch.add_volume(boxes);
+        }
+
+        if (i == 17) {
+            auto const envelope = Boxes{sdf::make_transformed_geometry(sdf::make_box<3>({3.f, 2.f, 1.6f}))};
+            expected_dvh.intersect_volumes(envelope);
+            batch.intersect_volumes(envelope);
+        }
+    }
+
+    CHECK(dvh.apply(std::move(batch)).size() == 25ul);
+    CHECK(dvh.levels() == expected_dvh.levels());
+}
+
+TEST_CASE("[dvh] intersecting keeps only the cells inside both volumes") {
+    using Boxes = std::vector<sdf::TransformedGeometry<sdf::Box, 3>>;
+    using Dvh   = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto envelope = sdf::make_transformed_geometry(sdf::make_box<3>({2.f, 2.f, 2.f}), {1.f, 1.f, 1.f});
+
+    Dvh dvh(0.1f);
+    dvh.add_volume(Boxes{sdf::make_transformed_geometry(sdf::make_box<3>({4.f, 4.f, 4.f}))});
+
+    auto const original_levels = dvh.levels();
+
+    auto volume = dvh.intersect_volumes(Boxes{envelope});
+
+    auto const bounds = envelope.bounding_box();
+
+    auto inside_cells = 0ul;
+
+    for (auto const& [level, cells] : dvh.levels()) {
+        auto const parent_resolution = dvh.resolution(level + 1);
+
+        for (auto const& [cell, value] : cells) {
+            // Nothing is kept if the parent's bounding sphere doesn't touch the envelope
+            auto const parent_center = cell_center(parent_cell(cell), parent_resolution);
+            auto const parent_radius = glm::length(glm::vec3(parent_resolution * 0.5f));
+            CHECK(sdf::intersects(bounds, {parent_center - parent_radius, parent_center + parent_radius}));
+
+            if (value[3] == Dvh::not_fully_inside) {
+                continue;
+            }
+
+            auto const center = glm::vec3(value);
+            CHECK(envelope.distance_from(center) < 0.f);
+
+            // Cells entirely inside the envelope are kept as they were
+            auto const& original_cells = original_levels.at(level);
+            if (auto iter = original_cells.find(cell); iter != original_cells.end()) {
+                CHECK(iter->second == value);
+            } else {
+                CHECK(value[3] == doctest::Approx(envelope.distance_from(center)));
+            }
+            ++inside_cells;
+        }
+    }
+    CHECK(inside_cells > 0ul);
+
+    CHECK(dvh.remove_volume(volume));
+    CHECK(dvh.levels() == original_levels);
+
+    // Intersecting with nothing removes everything
+    dvh.intersect_volumes(Boxes{});
+    for (auto const& [level, cells] : dvh.levels()) {
+        CHECK(cells.empty());
+    }
+}
+
+TEST_CASE("[dvh] compacting removes cells without changing the volume") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const boxes = make_test_boxes();
+    auto const lines = make_test_lines();
+    auto const hole  = sdf::make_transformed_geometry(sdf::make_box<3>({1.f, 1.f, 1.f}), {0.5f, -0.75f, 1.f});
+
+    Dvh dvh(0.1f);
+    dvh.add_volume(boxes);
+    dvh.subtract_volumes(lines);
+    dvh.subtract_volumes(std::vector{hole});
+
+    auto true_distance = [&](glm::vec3 const& point) {
+        auto distance = Dvh::not_fully_inside;
+        for (auto const& box : boxes) {
+            distance = std::min(distance, box.distance_from(point));
+        }
+        for (auto const& line : lines) {
+            distance = std::max(distance, -line.distance_from(point));
+        }
+        return std::max(distance, -hole.distance_from(point));
+    };
+
+    // The finest inside cell covering 'point' (or 'not_fully_inside')
+    auto inside_distance = [](Dvh const& hierarchy, glm::vec3 const& point) {
+        for (auto iter = hierarchy.levels().rbegin(); iter != hierarchy.levels().rend(); ++iter) {
+            auto const& cells = iter->second;
+            if (auto cell = cells.find(get_cell(point, hierarchy.resolution(iter->first))); cell != cells.end()) {
+                if (cell->second[3] != Dvh::not_fully_inside) {
+                    return cell->second[3];
+                }
+            }
+        }
+        return Dvh::not_fully_inside;
+    };
+
+    auto const original = dvh;
+
+    auto count_cells = [](Dvh const& hierarchy) {
+        auto count = 0ul;
+        for (auto const& [level, cells] : hierarchy.levels()) {
+            count += cells.size();
+        }
+        return count;
+    };
+
+    auto const reclaimed = dvh.compact();
+    CHECK(reclaimed > 0ul);
+    CHECK(count_cells(dvh) + reclaimed == count_cells(original));
+
+    // Every point that was inside is still inside
+    for (auto const& [cell, value] : original.levels().at(Dvh::base_level)) {
+        auto const center = glm::vec3(value);
+        CHECK((inside_distance(original, center) == Dvh::not_fully_inside)
+              == (inside_distance(dvh, center) == Dvh::not_fully_inside));
+    }
+
+    // Every remaining 'not_fully_inside' cell above the finest level has children
+    for (auto const& [level, cells] : dvh.levels()) {
+        if (level == Dvh::base_level) {
+            continue;
+        }
+        auto const& children = dvh.levels().at(level - 1);
+
+        for (auto const& [cell, value] : cells) {
+            if (value[3] == Dvh::not_fully_inside) {
+                auto child_cells = children_cells(cell);
+                CHECK(std::any_of(child_cells.begin(), child_cells.end(), [&](auto const& child) {
+                    return children.find(child) != children.end();
+                }));
+            }
+        }
+    }
+
+    // Inside cells are either untouched or collapsed cells storing the distance of the whole
+    // volume at their center, which has to be entirely inside
+    for (auto const& [level, cells] : dvh.levels()) {
+        auto const& original_cells = original.levels().at(level);
+        auto const  corner         = glm::length(glm::vec3(dvh.resolution(level) * 0.5f));
+
+        for (auto const& [cell, value] : cells) {
+            if (value[3] == Dvh::not_fully_inside) {
+                continue;
+            }
+            if (auto iter = original_cells.find(cell); iter != original_cells.end() && iter->second == value) {
+                continue;
+            }
+            auto const center = glm::vec3(value);
+            CHECK(value[3] == doctest::Approx(true_distance(center)));
+            CHECK(value[3] < -corner);
+        }
+    }
+
+    CHECK(dvh.compact() == 0ul);
+}
+
+TEST_CASE("[dvh] compacting keeps the unrefined cells on the edge of the domain") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const domain = sdf::AABB<3, float>{{-1.f, -1.f, 0.f}, {1.f, 0.5f, 2.f}};
+
+    Dvh dvh(0.1f);
+    dvh.set_domain(domain);
+    dvh.add_volume(make_test_boxes());
+
+    auto const original = dvh;
+
+    dvh.compact();
+
+    // Cells whose children were left out by the domain are still there
+    auto boundary_cells = 0ul;
+
+    for (auto const& [level, cells] : original.levels()) {
+        if (level == Dvh::base_level) {
+            continue;
+        }
+        auto const level_resolution = dvh.resolution(level);
+        auto const corner           = glm::length(glm::vec3(level_resolution * 0.5f));
+
+        for (auto const& [cell, value] : cells) {
+            auto const center = cell_center(cell, level_resolution);
+            if (value[3] != Dvh::not_fully_inside || original.child_mask(level, cell) != 0u
+                || sdf::intersects(domain, {center - corner, center + corner})) {
+                continue;
+            }
+            auto const& compacted = dvh.levels().at(level);
+            CHECK(compacted.find(cell) != compacted.end());
+            ++boundary_cells;
+        }
+    }
+    CHECK(boundary_cells > 0ul);
+}
+
+TEST_CASE("[dvh] CSG trees are evaluated without intermediate volumes") {
+    using namespace sdf;
+
+    auto outer = csg::make_geometry<3, float>(std::vector{make_box<3, float>({2.f, 2.f, 2.f})});
+    auto inner = csg::make_geometry<3, float>(
+        std::vector{make_transformed_geometry(make_box<3, float>({1.f, 1.f, 1.f}), {0.5f, 0.5f, 0.5f})});
+    auto expression = csg::make_subtraction(outer, inner);
+
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.1f);
+    dvh.add_volume(expression);
+
+    auto inside_cells = 0ul;
+
+    for (auto const& [level, cells] : dvh.levels()) {
+        for (auto const& [cell, value] : cells) {
+            if (value[3] == DistanceVolumeHierarchyCpu<3, float>::not_fully_inside) {
+                continue;
+            }
+            auto const center = glm::vec3(value);
+            CHECK(value[3] < 0.f);
+            CHECK(value[3] == doctest::Approx(expression.distance_from(center)));
+            CHECK(inner.distance_from(center) > 0.f);
+            ++inside_cells;
+        }
+    }
+    CHECK(inside_cells > 0ul);
+}
+
+TEST_CASE("[dvh] cancelled builds restore the previous hierarchy") {
+    DistanceVolumeHierarchyCpu<3, float> dvh(0.05f);
+    dvh.add_volume(make_test_boxes());
+
+    auto const original_levels = dvh.levels();
+
+    std::promise<BuildHandle> handle_promise;
+    auto                      handle_future = handle_promise.get_future().share();
+
+    auto handle = dvh.subtract_volumes_async(make_test_lines(), [handle_future](BuildProgress const& update) {
+        // Cancel before the finest level (which may be refined in a single chunk) but after the
+        // hierarchy has definitely been modified
+        if (update.level == DistanceVolumeHierarchyCpu<3, float>::base_level + 1) {
+            handle_future.get().cancel();
+        }
+    });
+    handle_promise.set_value(handle);
+
+    CHECK(handle.get() == BuildStatus::Cancelled);
+    CHECK(dvh.levels() == original_levels);
+}
+
+TEST_CASE("[dvh] child masks match the existing children") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto check_masks = [](Dvh const& dvh) {
+        for (auto const& [level, cells] : dvh.levels()) {
+            auto children_iter = dvh.levels().find(level - 1);
+
+            for (auto const& [cell, value] : cells) {
+                auto expected = Dvh::ChildMask(0u);
+
+                if (children_iter != dvh.levels().end()) {
+                    for (auto const& child : children_cells(cell)) {
+                        if (children_iter->second.find(child) != children_iter->second.end()) {
+                            expected |= Dvh::ChildMask(1u << child_index(child));
+                        }
+                    }
+                }
+                CHECK(dvh.child_mask(level, cell) == expected);
+            }
+        }
+    };
+
+    Dvh  dvh(0.1f);
+    auto boxes = dvh.add_volume(make_test_boxes());
+    check_masks(dvh);
+
+    dvh.subtract_volumes(make_test_lines());
+    check_masks(dvh);
+
+    dvh.intersect_volumes(
+        std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({2.f, 2.f, 2.f}), {0.5f, -0.75f, 1.f})});
+    check_masks(dvh);
+
+    dvh.compact();
+    check_masks(dvh);
+
+    dvh.remove_volume(boxes);
+    check_masks(dvh);
+
+    dvh.add_volume(make_test_boxes());
+    auto handle = dvh.subtract_volumes_async(make_test_lines(), [](BuildProgress const&) {});
+    handle.cancel();
+    handle.get();
+    check_masks(dvh);
+}
+
+TEST_CASE("[dvh] snapshots restore the hierarchy") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const filename = (std::filesystem::temp_directory_path() / "ltb_dvh_snapshot_test.bin").string();
+
+    Dvh dvh(0.1f);
+    dvh.set_narrow_band(0.3f);
+    auto boxes = dvh.add_volume(make_test_boxes());
+    dvh.subtract_volumes(make_test_lines());
+    REQUIRE(dvh.save(filename));
+
+    // The resolution comes from the snapshot
+    Dvh loaded(1.f);
+    loaded.add_volume(make_test_boxes());
+    REQUIRE(loaded.load(filename));
+    CHECK(loaded.base_resolution() == dvh.base_resolution());
+    CHECK(loaded.levels() == dvh.levels());
+
+    // The band is saved too, without the volumes its distances came from
+    CHECK(loaded.narrow_band() == dvh.narrow_band());
+    REQUIRE(loaded.band_cells());
+    REQUIRE(loaded.band_cells()->size() == dvh.band_cells()->size());
+    for (auto const& [cell, distance] : *dvh.band_cells()) {
+        auto const iter = loaded.band_cells()->find(cell);
+        REQUIRE(iter != loaded.band_cells()->end());
+        CHECK(iter->second.distance == distance.distance);
+    }
+
+    // Volumes aren't saved, and the ones recorded before loading are gone
+    CHECK_FALSE(loaded.remove_volume(boxes));
+
+    // Child masks and roots are restored too so later edits match
+    auto const extra_box
+        = std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({1.f, 1.f, 1.f}), {4.f, 2.f, 0.f})};
+    dvh.add_volume(extra_box);
+    loaded.add_volume(extra_box);
+    dvh.compact();
+    loaded.compact();
+    CHECK(loaded.levels() == dvh.levels());
+
+    SUBCASE("Corrupted snapshots are rejected without changing the hierarchy") {
+        std::string contents;
+        {
+            std::ifstream input_stream(filename, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(input_stream), std::istreambuf_iterator<char>());
+        }
+        contents[contents.size() / 2u] ^= 0x01;
+        {
+            std::ofstream output_stream(filename, std::ios::binary);
+            output_stream.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        }
+
+        CHECK_FALSE(loaded.load(filename));
+        CHECK(loaded.levels() == dvh.levels());
+        CHECK_FALSE(loaded.load(filename + ".missing"));
+    }
+
+    SUBCASE("Levels above the maximum level are rejected") {
+        snapshot::Writer writer;
+
+        writer.begin_section(snapshot::header_section);
+        writer.write_raw(std::uint32_t(3));
+        writer.write_raw(std::uint32_t(sizeof(float)));
+        writer.write_raw(0.1f);
+        writer.write_varint(snapshot::zigzag_encode(2)); // Max level
+        writer.write_varint(snapshot::zigzag_encode(Dvh::base_level));
+        writer.write_varint(0u);
+        writer.write_varint(1u);
+        writer.end_section();
+
+        writer.begin_section(snapshot::roots_section);
+        writer.end_section();
+
+        writer.begin_section(snapshot::level_section);
+        writer.write_varint(snapshot::zigzag_encode(40));
+        writer.write_sorted_codes({*snapshot::morton_encode(glm::ivec3(0))});
+        writer.write_raw(-1.f);
+        writer.end_section();
+
+        {
+            std::ofstream output_stream(filename, std::ios::binary);
+            output_stream.write(writer.buffer().data(), static_cast<std::streamsize>(writer.buffer().size()));
+        }
+
+        CHECK_FALSE(loaded.load(filename));
+        CHECK(loaded.levels() == dvh.levels());
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("[dvh] deltas keep a replica in sync") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.1f);
+    Dvh replica(0.1f);
+
+    CHECK_FALSE(dvh.take_delta());
+    dvh.record_changes(true);
+
+    // Sends the latest changes and returns the size of the delta
+    auto sync_replica = [&] {
+        auto delta = dvh.take_delta();
+        REQUIRE(delta);
+        REQUIRE(replica.apply_delta(*delta));
+
+        auto num_cells         = 0ul;
+        auto num_replica_cells = 0ul;
+
+        for (auto const& [level, cells] : dvh.levels()) {
+            auto const tolerance = dvh.resolution(level) / float(snapshot::delta_quantization_steps);
+
+            num_cells += cells.size();
+            for (auto const& [cell, value] : cells) {
+                auto const& replica_cells = replica.levels().at(level);
+                auto        iter          = replica_cells.find(cell);
+                REQUIRE(iter != replica_cells.end());
+                CHECK(glm::vec3(iter->second) == glm::vec3(value));
+                CHECK((iter->second.w == value.w || std::abs(iter->second.w - value.w) <= tolerance));
+            }
+        }
+        for (auto const& level : replica.levels()) {
+            num_replica_cells += level.second.size();
+        }
+        CHECK(num_replica_cells == num_cells);
+
+        return delta->size();
+    };
+
+    dvh.add_volume(make_test_boxes());
+    auto const build_size = sync_replica();
+
+    dvh.subtract_volumes(make_test_lines());
+    sync_replica();
+
+    // A small edit only sends the cells around it
+    dvh.subtract_volumes(std::vector{sdf::make_offset_line<3>({1.5f, -0.5f, 1.2f}, {1.6f, -0.5f, 1.2f}, 0.05f)});
+    CHECK(sync_replica() * 20ul < build_size);
+
+    // Nothing changed, so only the sections every delta has are sent
+    Dvh unchanged(0.1f);
+    unchanged.record_changes(true);
+    CHECK(sync_replica() == unchanged.take_delta()->size());
+
+    SUBCASE("Invalid deltas are rejected without changing the replica") {
+        dvh.add_volume(std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({1.f, 1.f, 1.f}), {4.f, 2.f, 0.f})});
+
+        auto delta = dvh.take_delta();
+        REQUIRE(delta);
+
+        auto corrupted = *delta;
+        corrupted[corrupted.size() / 2u] ^= 0x01;
+
+        auto const levels = replica.levels();
+        CHECK_FALSE(replica.apply_delta(corrupted));
+        CHECK_FALSE(replica.apply_delta(delta->substr(0u, delta->size() - 1u)));
+        CHECK(replica.levels() == levels);
+
+        Dvh other_resolution(0.2f);
+        CHECK_FALSE(other_resolution.apply_delta(*delta));
+
+        CHECK(replica.apply_delta(*delta));
+    }
+
+    SUBCASE("Clearing removes every cell") {
+        dvh.clear();
+        sync_replica();
+        for (auto const& level : replica.levels()) {
+            CHECK(level.second.empty());
+        }
+    }
+}
+
+TEST_CASE("[dvh] replicas answer queries like the original") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const filename = (std::filesystem::temp_directory_path() / "ltb_dvh_replica_test.bin").string();
+
+    Dvh dvh(0.1f);
+    dvh.set_narrow_band(0.3f);
+    dvh.add_volume(make_test_boxes());
+
+    // The replica starts from a snapshot so it has roots of its own
+    Dvh replica(0.1f);
+    REQUIRE(dvh.save(filename));
+    REQUIRE(replica.load(filename));
+    std::filesystem::remove(filename);
+
+    dvh.record_changes(true);
+
+    // Far from the existing roots
+    dvh.add_volume(std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({1.f, 1.f, 1.f}), {-8.f, 0.f, 0.f})});
+    dvh.subtract_volumes(make_test_lines());
+
+    auto delta = dvh.take_delta();
+    REQUIRE(delta);
+    REQUIRE(replica.apply_delta(*delta));
+
+    // The band cells are sent like the finest level
+    auto const band_tolerance = dvh.resolution(Dvh::base_level) / float(snapshot::delta_quantization_steps);
+
+    REQUIRE(replica.band_cells());
+    CHECK(replica.band_cells()->size() == dvh.band_cells()->size());
+    for (auto const& [cell, distance] : *dvh.band_cells()) {
+        auto const iter = replica.band_cells()->find(cell);
+        REQUIRE(iter != replica.band_cells()->end());
+        CHECK(std::abs(iter->second.distance - distance.distance) <= band_tolerance);
+    }
+
+    std::vector<glm::vec3> points;
+    for (int x = -100; x < 50; ++x) {
+        for (int y = -15; y < 40; y += 2) {
+            for (int z = -15; z < 30; z += 3) {
+                points.emplace_back(glm::vec3(x, y, z) * 0.0973f + glm::vec3(0.011f, 0.003f, 0.007f));
+            }
+        }
+    }
+
+    std::vector<float> distances(points.size());
+    std::vector<float> replica_distances(points.size());
+    dvh.distance_at(points.data(), points.size(), distances.data());
+    replica.distance_at(points.data(), points.size(), replica_distances.data());
+
+    // Distances are quantized relative to their cell, so the coarsest cells are the least precise
+    auto const tolerance = dvh.resolution(dvh.levels().begin()->first) / float(snapshot::delta_quantization_steps);
+
+    for (auto i = 0ul; i < points.size(); ++i) {
+        if (distances[i] == Dvh::not_fully_inside) {
+            CHECK(replica_distances[i] == Dvh::not_fully_inside);
+        } else {
+            CHECK(std::abs(replica_distances[i] - distances[i]) <= tolerance);
+        }
+    }
+
+    for (int y = -10; y < 30; ++y) {
+        auto const origin    = glm::vec3(-12.f, float(y) * 0.131f, 0.31f);
+        auto const direction = glm::vec3(1.f, 0.f, 0.f);
+
+        auto hit         = dvh.raycast(origin, direction);
+        auto replica_hit = replica.raycast(origin, direction);
+
+        REQUIRE(hit.has_value() == replica_hit.has_value());
+        if (hit) {
+            CHECK(replica_hit->t == doctest::Approx(hit->t));
+            CHECK(replica_hit->cell == hit->cell);
+        }
+    }
+
+    // Releasing the band releases it on the replica
+    dvh.set_narrow_band(std::nullopt);
+    delta = dvh.take_delta();
+    REQUIRE(delta);
+    REQUIRE(replica.apply_delta(*delta));
+    CHECK_FALSE(replica.band_cells());
+}
+
+TEST_CASE("[dvh] distance queries return the finest cell containing each point") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.1f);
+    CHECK(dvh.distance_at(glm::vec3(0.f)) == Dvh::not_fully_inside);
+
+    dvh.add_volume(make_test_boxes());
+    dvh.subtract_volumes(make_test_lines());
+    // A root below the existing roots
+    dvh.add_volume(std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({0.2f, 0.2f, 0.2f}), {3.f, 0.f, 0.f})});
+
+    std::vector<glm::vec3> points;
+    for (int x = -40; x < 60; ++x) {
+        for (int y = -30; y < 40; ++y) {
+            for (int z = -20; z < 30; z += 3) {
+                points.emplace_back(glm::vec3(x, y, z) * 0.0973f + glm::vec3(0.011f, 0.003f, 0.007f));
+            }
+        }
+    }
+
+    std::vector<float> distances(points.size());
+    std::vector<float> interpolated(points.size());
+    dvh.distance_at(points.data(), points.size(), distances.data());
+    dvh.distance_at(points.data(), points.size(), interpolated.data(), Dvh::Interpolation::Multilinear);
+
+    auto const& levels = dvh.levels();
+
+    for (auto i = 0ul; i < points.size(); ++i) {
+        auto const& point = points[i];
+
+        auto expected = Dvh::not_fully_inside;
+        for (auto iter = levels.rbegin(); iter != levels.rend(); ++iter) {
+            auto const found = iter->second.find(get_cell(point, dvh.resolution(iter->first)));
+            if (found != iter->second.end()) {
+                expected = found->second.w;
+                break;
+            }
+        }
+
+        CHECK(dvh.distance_at(point) == expected);
+        CHECK(distances[i] == expected);
+        CHECK(dvh.distance_at(point, Dvh::Interpolation::Multilinear) == interpolated[i]);
+
+        if (expected == Dvh::not_fully_inside) {
+            CHECK(interpolated[i] == Dvh::not_fully_inside);
+        } else {
+            // Neighbouring cell centers are at most one cell away
+            CHECK(std::abs(interpolated[i] - expected) <= dvh.base_resolution() * 2.f);
+        }
+    }
+
+    // Interpolating at a cell center returns that cell's distance
+    for (auto const& [cell, value] : levels.at(Dvh::base_level)) {
+        if (value.w != Dvh::not_fully_inside) {
+            CHECK(dvh.distance_at(glm::vec3(value), Dvh::Interpolation::Multilinear)
+                  == doctest::Approx(value.w).epsilon(1e-4));
+        }
+    }
+}
+
+TEST_CASE("[dvh] query cursors match independent queries") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.05f);
+    dvh.add_volume(make_test_boxes());
+    dvh.subtract_volumes(make_test_lines());
+
+    // A toolpath moving in small steps in and out of the volumes
+    std::vector<glm::vec3> toolpath;
+    for (int i = 0; i < 4000; ++i) {
+        auto const t = float(i) * 0.002f;
+        toolpath.emplace_back(-2.f + t * 1.5f, std::sin(t * 3.f) * 2.f - 0.5f, std::cos(t * 2.f) * 1.5f + 0.5f);
+    }
+
+    auto cursor = dvh.cursor();
+
+    auto check_toolpath = [&] {
+        for (auto const& point : toolpath) {
+            CHECK(cursor.distance_at(point) == dvh.distance_at(point));
+            CHECK(cursor.distance_at(point, Dvh::Interpolation::Multilinear)
+                  == dvh.distance_at(point, Dvh::Interpolation::Multilinear));
+        }
+    };
+
+    check_toolpath();
+
+    // Cursors start over after the hierarchy changes
+    dvh.subtract_volumes(std::vector{sdf::make_offset_line<3>({-2.f, -2.f, 0.f}, {2.f, 2.f, 1.f}, 0.3f)});
+    check_toolpath();
+
+    std::reverse(toolpath.begin(), toolpath.end());
+    cursor.reset();
+    check_toolpath();
+}
+
+TEST_CASE("[dvh] ray casts stop in the first cell containing the surface") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.05f);
+    dvh.add_volume(make_test_boxes());
+    dvh.subtract_volumes(make_test_lines());
+
+    auto const& levels = dvh.levels();
+
+    // Inside a fully inside cell or a finest cell the surface passes through
+    auto is_solid = [&](glm::vec3 const& point) {
+        for (auto iter = levels.rbegin(); iter != levels.rend(); ++iter) {
+            auto const& cells = iter->second;
+            auto const  cell  = cells.find(get_cell(point, dvh.resolution(iter->first)));
+
+            if (cell != cells.end()) {
+                return cell->second[3] != Dvh::not_fully_inside || iter->first == Dvh::base_level;
+            }
+        }
+        return false;
+    };
+
+    // Rays from a sphere around the volumes towards points around their center, plus a few that
+    // start inside or point away
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+
+    for (int i = 0; i < 400; ++i) {
+        auto const a      = float(i) * 2.39996f;
+        auto const z      = 1.f - 2.f * (float(i) + 0.5f) / 400.f;
+        auto const xy     = std::sqrt(1.f - z * z);
+        auto const origin = glm::vec3(xy * std::cos(a), xy * std::sin(a), z) * 8.f + glm::vec3(1.5f, 0.5f, 0.5f);
+        auto const target = glm::vec3(std::sin(a * 3.f) * 2.f + 1.5f, std::cos(a * 5.f) + 0.5f, std::sin(a * 7.f));
+
+        origins.emplace_back(origin);
+        directions.emplace_back(target - origin);
+    }
+    origins.emplace_back(0.f, -0.75f, 1.f);
+    directions.emplace_back(0.f, 0.f, 1.f);
+    origins.emplace_back(20.f, 0.f, 0.f);
+    directions.emplace_back(1.f, 0.f, 0.f);
+
+    auto num_hits = 0;
+
+    for (auto i = 0ul; i < origins.size(); ++i) {
+        auto const hit  = dvh.raycast(origins[i], directions[i], 2.f);
+        auto const step = dvh.base_resolution() * 0.125f / glm::length(directions[i]);
+
+        // Nothing solid before the hit (up to the offset used to step past cell faces)
+        auto const end_t = (hit ? hit->t - step : 2.f);
+        for (auto t = 0.f; t < end_t; t += step) {
+            CHECK_FALSE(is_solid(origins[i] + t * directions[i]));
+        }
+
+        if (hit) {
+            ++num_hits;
+            CHECK(is_solid(hit->point));
+            CHECK(glm::length(hit->point - (origins[i] + hit->t * directions[i])) < 1e-5f);
+            CHECK(hit->cell == get_cell(hit->point, dvh.resolution(hit->level)));
+            CHECK(hit->distance == levels.at(hit->level).at(hit->cell)[3]);
+        }
+    }
+    CHECK(num_hits > 100);
+
+    auto const inside = dvh.raycast(origins[400], directions[400]);
+    REQUIRE(inside);
+    CHECK(inside->t == 0.f);
+    CHECK_FALSE(dvh.raycast(origins[401], directions[401]));
+
+    SUBCASE("Rays from far away hit the same cells as rays from nearby") {
+        for (auto const& offset : {glm::vec3(0.013f, 0.31f, 0.f), glm::vec3(0.5f, -0.75f, 1.2f)}) {
+            auto const direction = glm::vec3(1.f, 0.f, 0.f);
+            auto const far       = dvh.raycast(glm::vec3(-1e5f, offset.x, offset.y), direction);
+            auto const near      = dvh.raycast(glm::vec3(-10.f, offset.x, offset.y), direction);
+
+            REQUIRE(far.has_value() == near.has_value());
+            if (near) {
+                CHECK(far->cell == near->cell);
+                CHECK(far->level == near->level);
+                CHECK(far->t == doctest::Approx(near->t + (1e5f - 10.f)));
+            }
+        }
+    }
+
+    SUBCASE("Narrow band distances don't change the hits") {
+        std::vector<std::optional<Dvh::RayHit>> hits;
+        for (auto i = 0ul; i < origins.size(); ++i) {
+            hits.emplace_back(dvh.raycast(origins[i], directions[i], 2.f));
+        }
+
+        dvh.set_narrow_band(1.f);
+
+        for (auto i = 0ul; i < origins.size(); ++i) {
+            auto const hit = dvh.raycast(origins[i], directions[i], 2.f);
+            REQUIRE(hits[i].has_value() == hit.has_value());
+            if (hit) {
+                CHECK(hits[i]->cell == hit->cell);
+                CHECK(hits[i]->level == hit->level);
+            }
+        }
+    }
+
+    SUBCASE("Rays without a direction or with non-finite values don't hit anything") {
+        auto const infinity = std::numeric_limits<float>::infinity();
+
+        CHECK_FALSE(dvh.raycast(origins[400], glm::vec3(0.f)));
+        CHECK_FALSE(dvh.raycast(glm::vec3(-10.f, 0.f, 0.f), glm::vec3(0.f)));
+        CHECK_FALSE(dvh.raycast(glm::vec3(-infinity, 0.f, 0.f), glm::vec3(1.f, 0.f, 0.f)));
+        CHECK_FALSE(dvh.raycast(glm::vec3(-10.f, 0.f, 0.f), glm::vec3(std::nanf(""), 1.f, 0.f)));
+        CHECK_FALSE(dvh.raycast(glm::vec3(-10.f, 0.f, 0.f), glm::vec3(infinity, 0.f, 0.f)));
+    }
+
+    SUBCASE("Ray packets match single rays") {
+        std::vector<std::optional<Dvh::RayHit>> hits(origins.size());
+        dvh.raycast(origins.data(), directions.data(), origins.size(), 2.f, hits.data());
+
+        for (auto i = 0ul; i < origins.size(); ++i) {
+            auto const hit = dvh.raycast(origins[i], directions[i], 2.f);
+            REQUIRE(hits[i].has_value() == hit.has_value());
+            if (hit) {
+                CHECK(hits[i]->t == hit->t);
+                CHECK(hits[i]->cell == hit->cell);
+                CHECK(hits[i]->level == hit->level);
+            }
+        }
+    }
+}
+
+TEST_CASE("[dvh] leaf bricks answer queries like hashed cells") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh hashed(0.05f);
+    Dvh bricked(0.05f);
+    bricked.use_leaf_bricks(true);
+
+    for (auto* dvh : {&hashed, &bricked}) {
+        dvh->add_volume(make_test_boxes());
+        dvh->subtract_volumes(make_test_lines());
+    }
+
+    // Points along a path in and out of the volumes, and rays towards them from around the volumes
+    std::vector<glm::vec3> points;
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+
+    for (int i = 0; i < 2000; ++i) {
+        auto const t = float(i) * 0.004f;
+        points.emplace_back(-2.f + t * 1.5f, std::sin(t * 3.f) * 2.f - 0.5f, std::cos(t * 2.f) * 1.5f + 0.5f);
+
+        auto const a = float(i) * 2.39996f;
+        origins.emplace_back(glm::vec3(std::cos(a), std::sin(a), std::sin(a * 0.5f)) * 8.f);
+        directions.emplace_back(points.back() - origins.back());
+    }
+
+    auto check_queries = [&] {
+        auto const& leaves = bricked.levels().at(Dvh::base_level);
+        CHECK(leaves.bricked());
+        CHECK_FALSE(leaves.bricks().empty());
+        CHECK_FALSE(hashed.levels().at(Dvh::base_level).bricked());
+        CHECK(bricked.levels() == hashed.levels());
+
+        for (auto interpolation : {Dvh::Interpolation::Nearest, Dvh::Interpolation::Multilinear}) {
+            std::vector<float> hashed_distances(points.size());
+            std::vector<float> bricked_distances(points.size());
+            hashed.distance_at(points.data(), points.size(), hashed_distances.data(), interpolation);
+            bricked.distance_at(points.data(), points.size(), bricked_distances.data(), interpolation);
+
+            auto cursor = bricked.cursor();
+            for (auto i = 0ul; i < points.size(); ++i) {
+                CHECK(bricked_distances[i] == hashed_distances[i]);
+                CHECK(bricked.distance_at(points[i], interpolation) == hashed_distances[i]);
+                CHECK(cursor.distance_at(points[i], interpolation) == hashed_distances[i]);
+            }
+        }
+
+        std::vector<std::optional<Dvh::RayHit>> hashed_hits(origins.size());
+        std::vector<std::optional<Dvh::RayHit>> bricked_hits(origins.size());
+        hashed.raycast(origins.data(), directions.data(), origins.size(), 2.f, hashed_hits.data());
+        bricked.raycast(origins.data(), directions.data(), origins.size(), 2.f, bricked_hits.data());
+
+        auto num_leaf_hits = 0;
+        for (auto i = 0ul; i < origins.size(); ++i) {
+            REQUIRE(bricked_hits[i].has_value() == hashed_hits[i].has_value());
+            if (hashed_hits[i]) {
+                CHECK(bricked_hits[i]->t == hashed_hits[i]->t);
+                CHECK(bricked_hits[i]->level == hashed_hits[i]->level);
+                CHECK(bricked_hits[i]->cell == hashed_hits[i]->cell);
+                CHECK(bricked_hits[i]->distance == hashed_hits[i]->distance);
+                num_leaf_hits += (hashed_hits[i]->level == Dvh::base_level ? 1 : 0);
+            }
+        }
+        CHECK(num_leaf_hits > 100);
+    };
+
+    check_queries();
+
+    // Edits, roll-backs and compaction go through the bricks
+    auto const groove = std::vector{sdf::make_offset_line<3>({-2.f, -2.f, 0.f}, {2.f, 2.f, 1.f}, 0.3f)};
+    for (auto* dvh : {&hashed, &bricked}) {
+        dvh->subtract_volumes(groove);
+        dvh->intersect_volumes(
+            std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({6.f, 3.f, 3.f}), {1.f, 0.f, 0.5f})});
+
+        auto handle = dvh->add_volume_async(
+            std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({1.f, 1.f, 1.f}), {4.f, 4.f, 0.f})});
+        handle.cancel();
+        handle.get();
+
+        dvh->compact();
+    }
+    check_queries();
+
+    // Loading keeps the bricks, and switching back to hashed cells keeps the cells
+    auto const filename = (std::filesystem::temp_directory_path() / "ltb_dvh_leaf_brick_test.bin").string();
+    REQUIRE(hashed.save(filename));
+    REQUIRE(bricked.load(filename));
+    check_queries();
+
+    bricked.use_leaf_bricks(false);
+    CHECK_FALSE(bricked.uses_leaf_bricks());
+    CHECK_FALSE(bricked.levels().at(Dvh::base_level).bricked());
+    CHECK(bricked.levels() == hashed.levels());
+}
+
+TEST_CASE("[dvh] minimum clearance matches the closest finest cell") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.1f);
+    CHECK_FALSE(dvh.min_clearance(make_test_lines()));
+
+    dvh.add_volume(make_test_boxes());
+    dvh.subtract_volumes(make_test_lines());
+
+    // The distance to every finest cell center in the volume, splitting fully inside cells
+    auto brute_force_clearance = [&](std::vector<sdf::OffsetLine<3>> const& tool) {
+        auto closest = std::numeric_limits<float>::infinity();
+
+        auto measure = [&](glm::ivec3 const& cell) {
+            auto const center = cell_center(cell, dvh.base_resolution());
+            for (auto const& geometry : tool) {
+                closest = std::min(closest, geometry.distance_from(center));
+            }
+        };
+
+        for (auto const& [level, cells] : dvh.levels()) {
+            for (auto const& [cell, value] : cells) {
+                if (level == Dvh::base_level) {
+                    measure(cell);
+                } else if (value[3] != Dvh::not_fully_inside) {
+                    auto const size = 1 << level;
+                    iterate(cell * size, cell * size + (size - 1), measure);
+                }
+            }
+        }
+        return closest;
+    };
+
+    // A spindle and tool moving over the top of the first box, then into it
+    for (int i = 0; i < 10; ++i) {
+        auto const tip  = glm::vec3(-1.f + float(i) * 0.3f, -0.5f, 1.9f - float(i) * 0.07f);
+        auto const tool = std::vector{sdf::make_offset_line<3>(tip, tip + glm::vec3(0.f, 0.f, 1.f), 0.15f),
+                                      sdf::make_offset_line<3>(tip + glm::vec3(0.f, 0.f, 1.f),
+                                                               tip + glm::vec3(0.f, 0.f, 2.f),
+                                                               0.4f)};
+
+        auto const expected  = brute_force_clearance(tool);
+        auto const clearance = dvh.min_clearance(tool);
+        REQUIRE(clearance);
+        CHECK(clearance->distance == expected);
+        CHECK(clearance->point == cell_center(clearance->cell, dvh.base_resolution()));
+
+        // Stops at any cell closer than the threshold
+        auto const early = dvh.min_clearance(tool, expected + 0.2f);
+        REQUIRE(early);
+        CHECK(early->distance < expected + 0.2f);
+        CHECK(early->distance >= expected);
+    }
+}
+
+TEST_CASE("[dvh] proximity queries match the closest pair of cells") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh part(0.1f);
+    part.add_volume(std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({1.f, 1.f, 0.6f}), {0.f, 0.f, 0.f})});
+    part.subtract_volumes(std::vector{sdf::make_offset_line<3>({0.f, 0.f, -1.f}, {0.f, 0.f, 1.f}, 0.2f)});
+
+    // The cells that make up a volume
+    auto solid_cells = [](Dvh const& dvh) {
+        std::vector<std::tuple<sdf::AABB<3, float>, float>> cells;
+        for (auto const& [level, level_cells] : dvh.levels()) {
+            for (auto const& [cell, value] : level_cells) {
+                if (value[3] != Dvh::not_fully_inside || level == Dvh::base_level) {
+                    auto const resolution = dvh.resolution(level);
+                    auto const min_point  = glm::vec3(cell) * resolution;
+                    auto const max_point  = glm::vec3(cell + 1) * resolution;
+                    cells.emplace_back(sdf::AABB<3, float>{min_point, max_point},
+                                       value[3] != Dvh::not_fully_inside ? 1.f : 0.5f);
+                }
+            }
+        }
+        return cells;
+    };
+
+    auto const part_cells = solid_cells(part);
+
+    auto brute_force = [&](Dvh const& other) {
+        auto const other_cells = solid_cells(other);
+
+        auto closest = std::numeric_limits<float>::infinity();
+        auto overlap = 0.f;
+
+        for (auto const& [box, fraction] : part_cells) {
+            for (auto const& [other_box, other_fraction] : other_cells) {
+                auto const gap = glm::max(box.min_point - other_box.max_point, other_box.min_point - box.max_point);
+                closest        = std::min(closest, glm::length(glm::max(gap, glm::vec3(0.f))));
+
+                auto const shared = sdf::intersection(box, other_box);
+                auto const size   = glm::max(shared.max_point - shared.min_point, glm::vec3(0.f));
+                overlap += fraction * other_fraction * size.x * size.y * size.z;
+            }
+        }
+        return std::pair(closest, overlap);
+    };
+
+    CHECK_FALSE(part.proximity(Dvh(0.1f)));
+
+    // Fixtures with a different resolution approaching the part, then overlapping it
+    for (auto const offset : {1.3f, 0.9f, 0.75f, 0.5f}) {
+        Dvh fixture(0.075f);
+        fixture.add_volume(
+            std::vector{sdf::make_transformed_geometry(sdf::make_box<3>({0.5f, 0.5f, 0.5f}), {offset, 0.2f, 0.1f})});
+
+        auto const [expected_distance, expected_overlap] = brute_force(fixture);
+
+        auto const proximity = part.proximity(fixture, true);
+        REQUIRE(proximity);
+        CHECK(proximity->distance == doctest::Approx(expected_distance));
+        REQUIRE(proximity->overlap_volume);
+        CHECK(*proximity->overlap_volume == doctest::Approx(expected_overlap).epsilon(1e-3));
+
+        // The reported cells are the closest pair
+        auto const box       = sdf::AABB<3, float>{glm::vec3(proximity->cell) * part.resolution(proximity->level),
+                                             glm::vec3(proximity->cell + 1) * part.resolution(proximity->level)};
+        auto const other_box = sdf::AABB<3, float>{
+            glm::vec3(proximity->other_cell) * fixture.resolution(proximity->other_level),
+            glm::vec3(proximity->other_cell + 1) * fixture.resolution(proximity->other_level)};
+        auto const gap = glm::max(box.min_point - other_box.max_point, other_box.min_point - box.max_point);
+        CHECK(glm::length(glm::max(gap, glm::vec3(0.f))) == doctest::Approx(proximity->distance));
+
+        CHECK_FALSE(part.proximity(fixture)->overlap_volume);
+        CHECK(part.proximity(fixture)->distance == proximity->distance);
+        CHECK(fixture.proximity(part)->distance == doctest::Approx(proximity->distance));
+
+        auto const approximate = part.proximity(fixture, false, 0.2f);
+        REQUIRE(approximate);
+        CHECK(approximate->distance >= proximity->distance);
+        CHECK(approximate->distance <= proximity->distance + 0.2f);
+    }
+}
+
+TEST_CASE("[dvh] narrow band distances match the geometry outside of the volumes") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const box  = sdf::make_box<3>({1.f, 1.f, 0.6f});
+    auto const hole = sdf::make_offset_line<3>({0.f, 0.f, -1.f}, {0.f, 0.f, 1.f}, 0.2f);
+
+    Dvh dvh(0.05f);
+    dvh.set_narrow_band(0.2f);
+
+    auto const box_volume  = dvh.add_volume(std::vector{box});
+    auto const hole_volume = dvh.subtract_volumes(std::vector{hole});
+
+    auto const resolution = dvh.resolution(Dvh::base_level);
+    auto const corner     = std::sqrt(3.f) * 0.5f * resolution;
+
+    // Every finest cell near the part is in the band exactly when its distance is in range
+    auto check_band = [&](std::optional<glm::vec3> const& hole_translation) {
+        auto const* band = dvh.band_cells();
+        REQUIRE(band);
+
+        auto expected = [&](glm::vec3 const& point) -> std::pair<float, VolumeHandle> {
+            auto const box_distance = box.distance_from(point);
+            if (hole_translation && -hole.distance_from(point - *hole_translation) > box_distance) {
+                return {-hole.distance_from(point - *hole_translation), hole_volume};
+            }
+            return {box_distance, box_volume};
+        };
+
+        auto num_checked = 0ul;
+        iterate(glm::ivec3(-18, -18, -14), glm::ivec3(17, 17, 13), [&](glm::ivec3 const& cell) {
+            auto const [distance, volume] = expected(cell_center(cell, resolution));
+
+            // Skip cells right at the edges of the band
+            if (std::abs(distance + corner) < 1e-4f || std::abs(distance - 0.2f) < 1e-4f) {
+                return;
+            }
+
+            auto const iter = band->find(cell);
+            CHECK((iter != band->end()) == (distance >= -corner && distance <= 0.2f));
+
+            if (iter != band->end()) {
+                CHECK(iter->second.distance == doctest::Approx(distance));
+                CHECK(iter->second.volume == volume);
+                ++num_checked;
+            }
+        });
+        CHECK(num_checked == band->size());
+    };
+
+    check_band(glm::vec3(0.f));
+
+    // Points that are not entirely inside a cell read the band
+    auto const outside = glm::vec3(0.6f, 0.1f, 0.f);
+    REQUIRE(dvh.band_distance_at(outside));
+    CHECK(dvh.band_distance_at(outside)->distance > 0.f);
+    CHECK(dvh.distance_at(outside) == dvh.band_distance_at(outside)->distance);
+    CHECK(dvh.distance_at(outside) == doctest::Approx(box.distance_from(outside)).epsilon(corner));
+    CHECK(dvh.distance_at(glm::vec3(0.35f, 0.35f, 0.f)) < -corner);
+    CHECK_FALSE(dvh.band_distance_at(glm::vec3(2.f)));
+    CHECK(dvh.distance_at(glm::vec3(2.f)) == Dvh::not_fully_inside);
+
+    // Edits only recompute the band around the volumes they change
+    dvh.move_volume(hole_volume, {0.2f, 0.f, 0.f});
+    check_band(glm::vec3(0.2f, 0.f, 0.f));
+
+    dvh.remove_volume(hole_volume);
+    check_band(std::nullopt);
+
+    // Asynchronous builds update the band before they are ready
+    Dvh async_dvh(0.05f);
+    async_dvh.set_narrow_band(0.2f);
+    async_dvh.add_volume_async(std::vector{box}).wait();
+    REQUIRE(async_dvh.band_cells());
+    CHECK(async_dvh.band_cells()->size() == dvh.band_cells()->size());
+
+    dvh.set_narrow_band(std::nullopt);
+    CHECK_FALSE(dvh.band_cells());
+    CHECK(dvh.distance_at(outside) == Dvh::not_fully_inside);
+}
+
+TEST_CASE("[dvh] narrow band edits match recomputing the band") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    Dvh dvh(0.05f);
+    dvh.set_narrow_band(0.15f);
+
+    // Edits far from most of the volumes skip them
+    std::vector<VolumeHandle> volumes;
+    for (int i = 0; i < 8; ++i) {
+        auto const box = sdf::make_box<3>({0.5f, 0.5f, 0.5f});
+        volumes.emplace_back(dvh.add_volume(
+            std::vector{sdf::make_transformed_geometry(box, {float(i) * 0.7f, float(i % 2) * 0.2f, 0.f})}));
+    }
+    dvh.subtract_volumes(std::vector{sdf::make_offset_line<3>({0.f, 0.f, 0.f}, {2.f, 0.f, 0.f}, 0.1f)});
+    dvh.move_volume(volumes[5], {0.f, 0.f, 0.3f});
+    dvh.remove_volume(volumes[6]);
+
+    auto const edited = *dvh.band_cells();
+    dvh.set_narrow_band(0.15f);
+    auto const& recomputed = *dvh.band_cells();
+
+    CHECK(edited.size() == recomputed.size());
+    for (auto const& [cell, distance] : recomputed) {
+        auto const iter = edited.find(cell);
+        REQUIRE(iter != edited.end());
+        CHECK(iter->second.distance == distance.distance);
+        CHECK(iter->second.volume == distance.volume);
+    }
+}
+
+TEST_CASE("[dvh] narrow band edits after loading match building the hierarchy directly") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const filename = (std::filesystem::temp_directory_path() / "ltb_dvh_band_edit_test.bin").string();
+
+    auto const box    = sdf::make_box<3>({1.f, 1.f, 1.f});
+    auto const hole   = sdf::make_offset_line<3>({0.f, 0.f, -1.f}, {0.f, 0.f, 1.f}, 0.2f);
+    auto const next   = sdf::make_transformed_geometry(box, {0.8f, 0.2f, 0.f});
+    auto const groove = sdf::make_offset_line<3>({0.4f, -1.f, 0.5f}, {0.4f, 1.f, 0.5f}, 0.15f);
+    auto const keep   = sdf::make_box<3>({2.4f, 1.2f, 1.2f});
+
+    Dvh saved(0.05f);
+    saved.set_narrow_band(0.15f);
+    saved.add_volume(std::vector{box});
+    saved.subtract_volumes(std::vector{hole});
+    REQUIRE(saved.save(filename));
+
+    Dvh loaded(0.05f);
+    REQUIRE(loaded.load(filename));
+    std::filesystem::remove(filename);
+
+    // Edits next to the loaded cells (queued ones too) are combined with their band distances
+    loaded.queue_add_volume(std::vector{next});
+    loaded.subtract_volumes(std::vector{groove});
+    loaded.intersect_volumes(std::vector{keep});
+
+    Dvh expected(0.05f);
+    expected.set_narrow_band(0.15f);
+    expected.add_volume(std::vector{box});
+    expected.subtract_volumes(std::vector{hole});
+    expected.add_volume(std::vector{next});
+    expected.subtract_volumes(std::vector{groove});
+    expected.intersect_volumes(std::vector{keep});
+
+    auto check_band = [&] {
+        auto const& edited = *loaded.band_cells();
+        auto const& built  = *expected.band_cells();
+
+        CHECK(edited.size() == built.size());
+        for (auto const& [cell, distance] : built) {
+            auto const iter = edited.find(cell);
+            REQUIRE(iter != edited.end());
+            CHECK(iter->second.distance == distance.distance);
+        }
+    };
+    check_band();
+
+    auto const outside = glm::vec3(0.3f, 0.f, 0.55f);
+    REQUIRE(expected.band_distance_at(outside));
+    CHECK(loaded.distance_at(outside) == expected.distance_at(outside));
+
+    // The loaded band cells are kept when the band gets narrower
+    loaded.set_narrow_band(0.1f);
+    expected.set_narrow_band(0.1f);
+    check_band();
+}
 
-} // namespace ltb::dvh
\ No newline at end of file
+} // namespace ltb::dvh
@@ -23,14 +23,29 @@
 #pragma once
 
 // project
+#include "ltb/dvh/build_handle.hpp"
+#include "ltb/dvh/edit_batch.hpp"
+#include "ltb/dvh/frozen_hierarchy.hpp"
+#include "ltb/dvh/level_cells.hpp"
+#include "ltb/dvh/occupancy_pyramid.hpp"
+#include "ltb/dvh/volume_handle.hpp"
+#include "ltb/dvh/volume_operation.hpp"
 #include "ltb/sdf/geometry.hpp"
+#include "ltb/util/result.hpp"
 
 // external
 #include <glm/gtx/hash.hpp>
 
 // standard
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -44,12 +59,72 @@ public:
     using CellSet = std::unordered_set<Cell>;
     template <typename V>
     using CellMap         = std::unordered_map<Cell, V>;
-    using SparseVolumeMap = std::unordered_map<Cell, glm::vec<L + 1, T>>;
+    using SparseVolumeMap = LevelCells<L, T>;
     template <typename V>
     using LevelMap = std::map<int, V, std::greater<int>>;
 
+    /// One bit per existing child, indexed like 'children_cells'
+    using ChildMask = std::uint8_t;
+
+    /// How 'distance_at' turns the stored distances around a point into a distance
+    enum class Interpolation {
+        Nearest,     ///< The distance of the finest cell containing the point
+        Multilinear, ///< Blends the cell centers around the point on the level of that cell
+    };
+
+    class QueryCursor;
+
+    /// The first cell hit by a ray (see 'raycast')
+    struct RayHit {
+        T              t; ///< 'point' is 'origin + t * direction' (up to rounding)
+        glm::vec<L, T> point;
+        int            level;
+        Cell           cell;
+        T              distance; ///< The distance stored in 'cell'
+    };
+
+    /// The part of the volume closest to a set of geometries (see 'min_clearance')
+    struct Clearance {
+        T              distance; ///< Negative when the geometries overlap the volume
+        glm::vec<L, T> point;    ///< The center of 'cell'
+        Cell           cell;     ///< On the finest level
+    };
+
+    /// A signed distance stored in the narrow band (see 'set_narrow_band')
+    struct BandDistance {
+        T            distance;
+        VolumeHandle volume; ///< The volume the closest surface belongs to
+    };
+
+    /// The closest cells of two hierarchies (see 'proximity')
+    struct Proximity {
+        T                distance;       ///< Between the boxes of the cells (zero when they touch or overlap)
+        int              level;          ///< Of 'cell' in this hierarchy
+        Cell             cell;           ///< Fully inside or on the finest level
+        int              other_level;    ///< Of 'other_cell' in the other hierarchy
+        Cell             other_cell;     ///< Fully inside or on the finest level
+        std::optional<T> overlap_volume; ///< Only when requested
+    };
+
     explicit DistanceVolumeHierarchyCpu(T base_resolution, int max_level = std::numeric_limits<int>::max());
 
+    /**
+     * @brief Waits for any asynchronous builds that are still modifying this hierarchy.
+     */
+    ~DistanceVolumeHierarchyCpu();
+
+    /**
+     * @brief Copies and moves first wait for the asynchronous builds of both hierarchies, since
+     *        their threads still write to the hierarchy they were started on.
+     *
+     * Cancel builds (see 'BuildHandle::cancel') before replacing a hierarchy to avoid waiting for
+     * them to complete.
+     */
+    DistanceVolumeHierarchyCpu(DistanceVolumeHierarchyCpu const&) = default;
+    DistanceVolumeHierarchyCpu(DistanceVolumeHierarchyCpu&&)      = default;
+    auto operator=(DistanceVolumeHierarchyCpu const&) -> DistanceVolumeHierarchyCpu& = default;
+    auto operator=(DistanceVolumeHierarchyCpu&&) -> DistanceVolumeHierarchyCpu& = default;
+
     void clear();
 
     /**
@@ -58,13 +133,432 @@ public:
      * @param geometries - the list of geometries to add.
      */
     template <typename Geometry>
-    void add_volume(std::vector<Geometry> const& geometries);
+    auto add_volume(std::vector<Geometry> const& geometries) -> VolumeHandle;
+
+    template <typename Geometry>
+    auto subtract_volumes(std::vector<Geometry> const& geometries) -> VolumeHandle;
+
+    /**
+     * @brief Keeps only the parts of the hierarchy that are inside 'geometries'.
+     *
+     * Cells outside the bounds of 'geometries' are removed without evaluating any geometry, and
+     * cells entirely inside the geometries are kept without visiting their children.
+     */
+    template <typename Geometry>
+    auto intersect_volumes(std::vector<Geometry> const& geometries) -> VolumeHandle;
+
+    /**
+     * @brief Adds the volume described by a CSG tree without building any of its sub-expressions.
+     */
+    auto add_volume(sdf::csg::Expression<L, T> const& expression) -> VolumeHandle;
+
+    auto subtract_volumes(sdf::csg::Expression<L, T> const& expression) -> VolumeHandle;
+
+    auto intersect_volumes(sdf::csg::Expression<L, T> const& expression) -> VolumeHandle;
+
+    /**
+     * @brief Removes a previously added or subtracted volume and recomputes the cells around it.
+     *
+     * Only the cells near the volume are visited, and only the recorded volumes that can reach
+     * them are replayed, so the cost follows the volume and its neighbours rather than the whole
+     * hierarchy. Removing an intersection recomputes every cell since anything outside of it may
+     * come back.
+     *
+     * @return false if 'volume' does not refer to a volume in this hierarchy, or if the cells near
+     *         it weren't all built by recorded volumes (see 'load' and 'apply_delta') so they can't
+     *         be recomputed. Nothing is changed in that case.
+     */
+    auto remove_volume(VolumeHandle const& volume) -> bool;
+
+    /**
+     * @brief Translates every geometry of a volume and recomputes the cells around its old and new positions.
+     *
+     * Costs the same as 'remove_volume' for the old and new positions together.
+     *
+     * @param translation - relative to the original position of the geometries.
+     * @return false (without moving anything) in the same cases as 'remove_volume'.
+     */
+    auto move_volume(VolumeHandle const& volume, glm::vec<L, T> const& translation) -> bool;
+
+    /**
+     * @brief Same as 'add_volume' but the hierarchy is built on another thread.
+     *
+     * Asynchronous builds are applied in the order they were requested. The hierarchy must not be
+     * read, modified, moved, or destroyed by other threads until the returned handle is ready.
+     * Cancelling the build restores the hierarchy to its state before this call.
+     *
+     * @param geometries - copied so they do not need to outlive the build.
+     * @param on_progress - called from the build thread after every processed frontier chunk.
+     */
+    template <typename Geometry>
+    auto add_volume_async(std::vector<Geometry> geometries, ProgressCallback on_progress = nullptr) -> BuildHandle;
+
+    template <typename Geometry>
+    auto subtract_volumes_async(std::vector<Geometry> geometries, ProgressCallback on_progress = nullptr)
+        -> BuildHandle;
+
+    template <typename Geometry>
+    auto intersect_volumes_async(std::vector<Geometry> geometries, ProgressCallback on_progress = nullptr)
+        -> BuildHandle;
+
+    /**
+     * @brief Same as 'add_volume' but the hierarchy is only built during calls to 'refine'.
+     *
+     * Queued operations are applied in order, refining coarse levels before fine ones. Any
+     * synchronous or asynchronous operation finishes the queued refinement before it is applied.
+     * Queuing an operation waits for asynchronous builds that are still running.
+     */
+    template <typename Geometry>
+    auto queue_add_volume(std::vector<Geometry> geometries) -> VolumeHandle;
 
     template <typename Geometry>
-    void subtract_volumes(std::vector<Geometry> const& geometries);
+    auto queue_subtract_volumes(std::vector<Geometry> geometries) -> VolumeHandle;
+
+    template <typename Geometry>
+    auto queue_intersect_volumes(std::vector<Geometry> geometries) -> VolumeHandle;
+
+    /**
+     * @brief Continues refining queued operations until 'budget' is used up.
+     *
+     * At least one chunk of the frontier is processed per call so progress is always made. Levels
+     * are refined from the coarsest to the finest so 'levels()' is a valid (coarser) approximation
+     * between calls.
+     *
+     * Example (once per frame):
+     *
+     *     if (!dvh.is_refined()) {
+     *         dvh.refine(std::chrono::milliseconds(16));
+     *     }
+     *
+     * @return true if every queued operation has been fully applied.
+     */
+    auto refine(std::chrono::steady_clock::duration budget) -> bool;
+
+    /**
+     * @brief False while queued operations still need to be refined.
+     */
+    auto is_refined() const -> bool;
+
+    /**
+     * @brief Recomputes only the cells near 'region' by replaying 'operations' in order.
+     *
+     * 'operations' should be the full ordered list of operations that built the hierarchy,
+     * including any edits. They replace the recorded volumes one for one: a recorded volume keeps
+     * its handle and takes the operation at the same position, extra operations are recorded as
+     * new volumes and recorded volumes past the end of 'operations' are removed.
+     *
+     * Every cell whose parent's bounding sphere overlaps 'region' is discarded (on every level)
+     * and rebuilt from the operations that can reach it. Those cells are found by following the
+     * child masks down from the roots, so cells further away are never visited and keep their
+     * values. As long as 'region' contains every geometry that changed (before and after the
+     * edit) the result matches a full rebuild.
+     *
+     * Prefer 'move_volume' and 'remove_volume' when editing a single volume.
+     *
+     * Example (moving a box):
+     *
+     *     auto region  = sdf::expand(old_box.bounding_box(), new_box.bounding_box());
+     *     auto volumes = dvh.rebuild_region(region,
+     *                                       {make_volume_operation<3, float>(VolumeOperationType::Add, boxes),
+     *                                        make_volume_operation<3, float>(VolumeOperationType::Subtract, lines)});
+     *
+     * @return a handle for each operation, or an error (without changing anything) if the cells
+     *         near 'region' weren't all built by recorded volumes (see 'load' and 'apply_delta').
+     */
+    auto rebuild_region(sdf::AABB<L, T> const& region, std::vector<VolumeOperation<L, T>> operations)
+        -> util::Result<std::vector<VolumeHandle>>;
+
+    /**
+     * @brief Applies every operation in 'batch' in a single traversal of the hierarchy.
+     *
+     * The result is the same as applying the operations one at a time, in order. Each visited cell
+     * keeps the ordered list of operations that reach it and applies them in order, and a child
+     * only inherits the operations whose bounds overlap it, so operations are pruned per subtree.
+     * The cells shared by many operations are walked once instead of once per operation.
+     *
+     * @return a handle for each operation in the batch.
+     */
+    auto apply(EditBatch<L, T> batch) -> std::vector<VolumeHandle>;
+
+    /**
+     * @brief Only builds the cells overlapping 'domain' (every cell when std::nullopt).
+     *
+     * Lets a large hierarchy be split into independent pieces (see 'TiledHierarchy'). Like
+     * 'rebuild_region', a cell overlaps the domain when its parent's bounding sphere does, so cells
+     * just outside of the domain are built too. Cells built before the domain was set are kept.
+     */
+    auto set_domain(std::optional<sdf::AABB<L, T>> domain) -> void;
+
+    auto domain() const -> std::optional<sdf::AABB<L, T>> const&;
+
+    /**
+     * @brief Removes cells that no longer contribute to the hierarchy.
+     *
+     * - Cells whose parent was removed or is already entirely inside are deleted (top-down).
+     * - 'not_fully_inside' cells without any children are deleted since nothing below them is
+     *   inside (bottom-up, except on the finest level and on the edge of the domain, where they
+     *   were never refined).
+     * - Sibling groups that are all entirely inside are merged into their parent if the parent is
+     *   entirely inside too. It stores the distance of the recorded volumes at its center
+     *   (bottom-up).
+     *
+     * Edits can stale cells over time (mostly subtractions) so this is meant to be called after
+     * long sequences of edits. The recorded volumes are not affected.
+     *
+     * @return the number of cells removed.
+     */
+    auto compact() -> std::size_t;
 
     auto levels() const -> LevelMap<SparseVolumeMap> const&;
 
+    /**
+     * @brief Which children of 'cell' (on 'level - 1') exist, without looking up each child.
+     */
+    auto child_mask(int level, Cell const& cell) const -> ChildMask;
+
+    /**
+     * @brief Stores the finest level in dense bricks (see 'LevelCells') when enabled, or in a hash
+     *        map otherwise (the default).
+     *
+     * The cells and their values don't change, only how the finest level is stored. Large parts
+     * have dense finest levels, where bricks take less memory and queries ('distance_at',
+     * 'QueryCursor', 'raycast') look up one brick for many neighbouring cells. The choice is kept
+     * by 'clear' and 'load'.
+     */
+    auto use_leaf_bricks(bool enabled) -> void;
+    auto uses_leaf_bricks() const -> bool;
+
+    /**
+     * @brief The distance at 'point' read from the finest cell containing it.
+     *
+     * The lookup starts at the coarsest cell containing the point and follows the child masks
+     * down, so only levels where a new subtree can start (root levels) are searched directly.
+     * Multilinear interpolation falls back to the nearest distance if any of the neighbouring
+     * cell centers is missing or not fully inside.
+     *
+     * Must not be called while an asynchronous build is running.
+     *
+     * @return the band distance if the point is not entirely inside a cell but is in the narrow
+     *         band (see 'set_narrow_band'), otherwise 'not_fully_inside' (infinity).
+     */
+    auto distance_at(glm::vec<L, T> const& point, Interpolation interpolation = Interpolation::Nearest) const -> T;
+
+    /**
+     * @brief Same as 'distance_at' for 'count' points, evaluated in parallel.
+     *
+     * Points are evaluated in the given order with one 'QueryCursor' per chunk of points, so a
+     * point close to the previous one costs almost no lookups. Queries that are ordered spatially
+     * (by Morton code, for example) keep hitting the same cells and run about twice as fast as
+     * scattered ones, so callers should generate them in a coherent order when they can. Sorting
+     * inside this call doesn't pay off since reordering costs about as much as the cache misses it
+     * saves.
+     */
+    auto distance_at(glm::vec<L, T> const* points,
+                     std::size_t           count,
+                     T*                    distances,
+                     Interpolation         interpolation = Interpolation::Nearest) const -> void;
+
+    /**
+     * @brief A cursor for queries that move in small steps (see 'QueryCursor').
+     */
+    auto cursor() const -> QueryCursor;
+
+    /**
+     * @brief The first point along a ray that is inside a cell, or std::nullopt if there is none
+     *        before 'max_t'.
+     *
+     * The levels only store distances inside the volumes, so the ray skips empty space a cell at a
+     * time. A point inside a 'not_fully_inside' cell whose child is missing jumps past that child,
+     * and a point outside of every cell jumps past its cell on the finest root level, so large
+     * empty regions take a few steps. Where the narrow band (see 'set_narrow_band') has a distance
+     * the ray sphere traces with it instead if that goes further. The ray stops in the first fully
+     * inside cell or finest 'not_fully_inside' cell (which the surface passes through), so hits are
+     * accurate to a finest cell. Rays that start inside stop at t = 0.
+     *
+     * Must not be called while an asynchronous build is running.
+     *
+     * @param direction - doesn't have to be normalized since 't' is measured in multiples of it.
+     *                    Rays with a zero direction (or a non-finite origin or direction) never hit.
+     */
+    auto raycast(glm::vec<L, T> const& origin,
+                 glm::vec<L, T> const& direction,
+                 T                     max_t = std::numeric_limits<T>::infinity()) const -> std::optional<RayHit>;
+
+    /**
+     * @brief Same as 'raycast' for 'count' rays, evaluated in parallel.
+     *
+     * Rays are traced in the given order with one 'QueryCursor' per chunk of rays, so neighbouring
+     * rays (like the pixels of a camera) share most of their cell lookups.
+     */
+    auto raycast(glm::vec<L, T> const*  origins,
+                 glm::vec<L, T> const*  directions,
+                 std::size_t            count,
+                 T                      max_t,
+                 std::optional<RayHit>* hits) const -> void;
+
+    /**
+     * @brief The smallest distance from 'geometries' to the volume (a tool holder to the stock, for example).
+     *
+     * Cells are visited closest first, from coarse to fine. The geometry distance at a cell's center
+     * minus half its diagonal bounds every distance inside the cell, so subtrees that can't beat the
+     * closest cell found so far are never visited. Fully inside cells are split down to the finest
+     * level without any lookups. Distances are measured to the centers of the finest cells that are
+     * inside or contain the surface, which makes the result accurate to half a finest cell diagonal.
+     *
+     * Must not be called while an asynchronous build is running.
+     *
+     * @param early_exit_threshold - stops as soon as a cell is closer than this, in which case the
+     *                               result is not necessarily the closest cell. Collision checks
+     *                               should pass the clearance they require.
+     * @return std::nullopt if the hierarchy is empty.
+     */
+    template <typename Geometry>
+    auto min_clearance(std::vector<Geometry> const& geometries,
+                       T early_exit_threshold = -std::numeric_limits<T>::infinity()) const -> std::optional<Clearance>;
+
+    auto min_clearance(sdf::csg::Expression<L, T> const& expression,
+                       T early_exit_threshold = -std::numeric_limits<T>::infinity()) const -> std::optional<Clearance>;
+
+    /**
+     * @brief The separation between this volume and the volume of 'other' (a part and a fixture, for example).
+     *
+     * Both volumes are made of their fully inside cells and the finest cells the surface passes
+     * through. The two trees are traversed together, depth-first with the closest pair of cells
+     * first, always splitting the larger cell of a pair. The distance between the boxes around two
+     * cells' existing children bounds every pair below them, so pairs that can't beat the closest
+     * pair found so far are never split and neither hierarchy is converted back into geometry. The
+     * hierarchies may have different base resolutions.
+     *
+     * Large parallel faces are the slowest case since every pair of cells along them comes close
+     * to the closest distance. A small 'tolerance' (a finest cell or two) prunes most of them.
+     *
+     * Must not be called while an asynchronous build is running on either hierarchy.
+     *
+     * @param estimate_overlap - also adds up the volume shared by overlapping cells, which visits
+     *                           every overlapping pair. Fully inside cells count fully and finest
+     *                           cells the surface passes through count as half inside.
+     * @param tolerance - pairs are only split if they can be closer by more than this, so the
+     *                    distance may be up to 'tolerance' larger than the closest pair.
+     * @return std::nullopt if either hierarchy is empty.
+     */
+    auto proximity(DistanceVolumeHierarchyCpu const& other, bool estimate_overlap = false, T tolerance = T(0)) const
+        -> std::optional<Proximity>;
+
+    /**
+     * @brief Also stores distances outside of the volumes, up to 'width' from the surface, when enabled.
+     *
+     * 'levels()' only has distances for cells that are entirely inside, so distances outside of
+     * the volumes would otherwise need the geometry. The band holds every finest cell whose center
+     * is between half a cell diagonal inside the surface and 'width' outside of it, which includes
+     * the finest 'not_fully_inside' cells. 'distance_at' (and cursors) fall back to the nearest
+     * band cell for points that are not entirely inside a cell.
+     *
+     * Band distances combine the recorded volumes in order the same way the levels do (the
+     * minimum with added volumes, the maximum with negated subtracted ones and the maximum with
+     * intersected ones), so every band cell also knows which volume its distance came from.
+     *
+     * New volumes are combined with the band before they change the levels: cells near the volume
+     * start from their band distance (or from the levels when they aren't in the band), so adding
+     * a volume only evaluates that volume and also keeps the band of loaded or replicated cells.
+     * Removing or moving a volume recomputes the band around it from the recorded volumes that
+     * can reach it (added and subtracted volumes further than the band width away are skipped).
+     * Queued operations update the band when 'refine' starts applying them. Snapshots and deltas
+     * include the band.
+     *
+     * Cells that weren't built by the recorded volumes (after 'load' or 'apply_delta') keep their
+     * band cells when the width changes, so widening the band only adds cells around the recorded
+     * volumes.
+     *
+     * @param width - std::nullopt (or a width that isn't positive) releases the band.
+     */
+    auto set_narrow_band(std::optional<T> width) -> void;
+
+    /**
+     * @brief The width of the narrow band or std::nullopt if it isn't used.
+     */
+    auto narrow_band() const -> std::optional<T>;
+
+    /**
+     * @brief The band distance of the finest cell containing 'point' or std::nullopt if the cell
+     *        isn't in the band.
+     */
+    auto band_distance_at(glm::vec<L, T> const& point) const -> std::optional<BandDistance>;
+
+    /**
+     * @brief Every finest cell in the narrow band or nullptr if it isn't used.
+     */
+    auto band_cells() const -> CellMap<BandDistance> const*;
+
+    /**
+     * @brief A read-only copy for fast concurrent queries and compact storage (see 'FrozenHierarchy').
+     */
+    auto freeze() const -> FrozenHierarchy<L, T>;
+
+    /**
+     * @brief A bit-packed copy that only answers inside/outside tests (see 'OccupancyPyramid').
+     */
+    auto occupancy() const -> OccupancyPyramid<L, T>;
+
+    /**
+     * @brief Writes the cells and roots to a versioned binary snapshot.
+     *
+     * Cells are stored per level in Morton order with delta and varint encoded keys and every
+     * section is checksummed. The narrow band is saved with its cells. The recorded volumes are not
+     * saved (their geometry has no serialized form) so volumes added before saving can't be moved
+     * or removed after loading.
+     */
+    auto save(std::string const& filename) -> util::Result<void>;
+
+    /**
+     * @brief Replaces the hierarchy with a snapshot written by 'save'.
+     *
+     * The file is decoded one section at a time. Nothing is changed if the file can't be read or is
+     * corrupted. The narrow band is restored as it was saved (released if it wasn't enabled), but
+     * its cells don't know which volume their distance came from. New volumes are combined with the
+     * loaded band cells. Snapshots don't hold the recorded
+     * volumes so the loaded hierarchy has none: its cells can be queried and edited with new
+     * volumes, but the saved volumes can't be moved or removed. Neither can new volumes near the
+     * loaded cells, since those cells can't be recomputed.
+     */
+    auto load(std::string const& filename) -> util::Result<void>;
+
+    /**
+     * @brief Starts (or stops) recording which cells change so they can be sent with 'take_delta'.
+     */
+    auto record_changes(bool enabled) -> void;
+
+    /**
+     * @brief Encodes the cells added, removed and changed since the previous delta (or since
+     *        changes started being recorded).
+     *
+     * Each level lists its removed, added and changed cells with Morton sorted varint keys, and
+     * distances are quantized relative to their cell's width, so the size of a delta follows the
+     * size of the edits rather than the size of the hierarchy. Cells that changed back or whose
+     * quantized distance is the same are left out. The roots are only sent when they changed so
+     * queries on the replica start from the same cells, and the narrow band cells are sent the same
+     * way as the finest level.
+     *
+     * Example (keeping a replica in sync):
+     *
+     *     dvh.record_changes(true);
+     *     dvh.add_volume(boxes);
+     *
+     *     if (auto delta = dvh.take_delta()) {
+     *         auto applied = replica.apply_delta(*delta);
+     *         ...
+     *     }
+     */
+    auto take_delta() -> util::Result<std::string>;
+
+    /**
+     * @brief Applies a delta from 'take_delta' of a hierarchy with the same base resolution.
+     *
+     * Nothing is changed if the delta is corrupted. Deltas include the roots and the narrow band but
+     * not the volumes, so a replica answers the same queries but the original volumes can't be moved
+     * or removed on it (nor can its own volumes near the applied cells).
+     */
+    auto apply_delta(std::string const& delta) -> util::Result<void>;
+
     auto base_resolution() const -> T;
 
     auto resolution(int level_index) const -> T;
@@ -73,14 +567,478 @@ public:
     constexpr static T   not_fully_inside = std::numeric_limits<T>::infinity();
 
 private:
+    using VecDist = glm::vec<L + 1, T>;
+
+    enum class VisitState : unsigned {
+        DoesNotMatter    = 0u,
+        PreviouslyInside = 1u,
+        ExistingOnly     = 2u, ///< Batched operations skip the cell if it doesn't exist when they reach it
+    };
+
+    /// The original value of every cell touched by an operation (std::nullopt if it did not exist)
+    using Journal = LevelMap<CellMap<std::optional<VecDist>>>;
+
+    /// The index (within a batch or replay) of the operation that added each root cell
+    using RootOwners = LevelMap<CellMap<std::size_t>>;
+
+    /// The original band cells changed by an operation that can be undone
+    using BandJournal = CellMap<std::optional<BandDistance>>;
+
+    /**
+     * @brief An operation that has been started but has not finished refining every level.
+     *
+     * Levels are refined from the coarsest to the finest. Each level is processed in chunks so the
+     * traversal can stop between chunks and continue later.
+     */
+    struct PendingOperation {
+        VolumeOperation<L, T> operation;
+
+        int                                      level     = 0;
+        std::vector<std::pair<Cell, VisitState>> cells     = {}; ///< The frontier of 'level'
+        std::size_t                              next_cell = 0;
+        CellMap<VisitState>                      to_visit  = {}; ///< The frontier of 'level - 1'
+        CellSet                                  parents_to_clear = {}; ///< Cells on 'level + 1' losing their children
+        std::size_t                              total_cells_processed = 0;
+        bool                                     level_started         = false;
+        ProgressCallback                         on_progress           = nullptr;
+        std::optional<sdf::AABB<L, T>>           region; ///< Only cells overlapping this are visited
+
+        // Set when roots of later operations are hidden from this one
+        std::shared_ptr<RootOwners const> root_owners = nullptr;
+        std::size_t                       batch_index = 0;
+
+        // Earlier operations of a batch may still add (or remove) children of a cell by the time a
+        // batched operation reaches them, so it visits every child as 'VisitState::ExistingOnly'.
+        bool batched = false;
+
+        // Only recorded when the operation can be undone
+        std::optional<Journal>           journal;
+        std::optional<BandJournal>       band_journal;
+        std::optional<LevelMap<CellSet>> previous_roots;
+        std::vector<int>                 previous_levels;
+    };
+
+    /// An operation of a batch reaching a cell
+    struct BatchVisit {
+        std::size_t operation;
+        VisitState  state;
+        bool        root = false; ///< The cell is also a root the operation can see
+    };
+
+    /// The cells a batch visits on one level
+    struct BatchFrontier {
+        CellMap<std::vector<BatchVisit>>  cells; ///< With the operations reaching them, in order
+        CellMap<std::vector<std::size_t>> parents_to_clear; ///< On the level above, with the operations clearing them
+    };
+
+    // Number of cells evaluated by one thread pool task
+    constexpr static std::size_t parallel_grain_size = 256;
+
+    // Number of cells processed between cancellation checks and progress reports
+    constexpr static std::size_t frontier_chunk_size = 8192;
+
+    // Number of cells processed between time checks in 'refine'
+    constexpr static std::size_t refine_chunk_size = 1024;
+
+    // Number of points handled by one thread pool task in 'distance_at'
+    constexpr static std::size_t query_grain_size = 4096;
+
+    // Number of rays traced by one thread pool task in 'raycast'
+    constexpr static std::size_t raycast_grain_size = 256;
+
+    // How far (in finest cells) rays are pushed past the faces of the empty cells they skip
+    constexpr static T raycast_face_offset = T(1e-3);
+
+    /**
+     * @brief The most recently requested asynchronous build.
+     *
+     * Copying, moving or assigning this waits for the builds of both sides. It is the first member
+     * so the defaulted copy and move operations wait before any other member is read or written.
+     */
+    struct LastBuild {
+        std::shared_future<BuildStatus> future;
+
+        LastBuild() = default;
+        LastBuild(LastBuild const& other);
+        LastBuild(LastBuild&& other);
+        auto operator=(LastBuild const& other) -> LastBuild&;
+        auto operator=(LastBuild&& other) -> LastBuild&;
+
+        auto wait() const -> void;
+    };
+
+    LastBuild last_build_;
+
     T   base_resolution_;
     int max_level_;
     int lowest_level_ = 0;
 
+    // Incremented by every change to 'levels_' so cursors know when their cells are stale
+    std::uint64_t revision_ = 0u;
+
     LevelMap<SparseVolumeMap> levels_;
     LevelMap<CellSet>         roots_;
 
-    auto add_roots_for_bounds(sdf::AABB<L, T> const& aabb) -> void;
+    // Whether the finest level of 'levels_' is stored in bricks
+    bool leaf_bricks_ = false;
+
+    // Operations don't visit cells outside of this (when set)
+    std::optional<sdf::AABB<L, T>> domain_;
+
+    // The existing children of every cell with children. Kept up to date by 'set_cell' and
+    // 'erase_cell' so subtrees can be visited without probing children that never existed.
+    LevelMap<CellMap<ChildMask>> child_masks_;
+
+    struct NarrowBand {
+        T                     width;
+        CellMap<BandDistance> cells; ///< On the finest level
+    };
+
+    // Distances outside of the volumes (only when enabled)
+    std::optional<NarrowBand> narrow_band_;
+
+    // The original value of every cell changed since the last delta (only when recording changes)
+    std::optional<Journal> changes_;
+
+    // The original distance of every band cell changed since the last delta (when recording changes)
+    std::optional<CellMap<std::optional<T>>> band_changes_;
+
+    // The roots as of the last delta. They are sent again whenever they differ.
+    LevelMap<CellSet> delta_roots_;
+
+    struct VolumeRecord {
+        VolumeOperation<L, T>               operation;
+        std::shared_ptr<BuildControl const> build = nullptr; ///< Only set for asynchronous builds
+    };
+
+    // Every volume that contributes to the hierarchy, in the order they were applied
+    std::map<std::uint64_t, VolumeRecord> volumes_;
+    std::uint64_t                         next_volume_id_ = 1u;
+
+    // Around the cells that weren't built by the recorded volumes (from 'load' and 'apply_delta').
+    // They can't be recomputed, so volumes near them can't be moved or removed.
+    sdf::AABB<L, T> unrecorded_bounds_;
+
+    // Progressive refinement
+    std::deque<std::pair<std::uint64_t, VolumeOperation<L, T>>> queued_operations_; ///< With their volume ids
+    std::optional<PendingOperation>                             active_operation_;
+
+    /**
+     * @brief Adds the root cells that cover 'aabb'. Roots that didn't already exist are recorded
+     *        as owned by 'owner' in 'owners' (if provided).
+     */
+    auto add_roots_for_bounds(sdf::AABB<L, T> const& aabb, RootOwners* owners = nullptr, std::size_t owner = 0)
+        -> void;
+
+    /// The root cells that cover a box, all on one level
+    struct RootRange {
+        int  level;
+        Cell min_cell;
+        Cell max_cell;
+    };
+
+    auto root_range(sdf::AABB<L, T> const& aabb) const -> RootRange;
+
+    auto record_volume(VolumeOperation<L, T> const& operation, std::shared_ptr<BuildControl const> build = nullptr)
+        -> VolumeHandle;
+
+    /**
+     * @brief How far from 'region' a volume can be and still change a cell that overlaps it (the
+     *        diameter of a parent's bounding sphere on the coarsest level a replay visits).
+     */
+    auto replay_reach(sdf::AABB<L, T> const& region) const -> T;
+
+    /**
+     * @brief False if replaying 'region' could discard cells that weren't built by the recorded volumes.
+     */
+    auto can_replay(sdf::AABB<L, T> const& region) const -> bool;
+
+    /**
+     * @brief Removes the roots of 'operations' that aren't roots of a recorded volume too.
+     */
+    auto release_roots(std::vector<VolumeOperation<L, T>> const& operations) -> void;
+
+    /**
+     * @brief Rebuilds the cells overlapping 'region' from the recorded volumes that can reach them.
+     *
+     * 'released' are the operations that were removed or replaced. Their roots are released so
+     * the hierarchy has the same roots as a full rebuild.
+     */
+    auto replay_region(sdf::AABB<L, T> const& region, std::vector<VolumeOperation<L, T>> const& released) -> void;
+
+    auto apply_operation(VolumeOperation<L, T> operation) -> VolumeHandle;
+    auto apply_operation_async(VolumeOperation<L, T> operation, ProgressCallback on_progress) -> BuildHandle;
+    auto finish_refinement() -> void;
+
+    /**
+     * @brief Waits for asynchronous builds without refining queued operations.
+     *
+     * Builds finish queued refinement and read the recorded volumes on their own thread, so
+     * anything that records volumes or queues operations has to wait for them first.
+     */
+    auto wait_for_builds() -> void;
+    auto wait_for_pending_work() -> void;
+
+    /// Recorded volumes in the order they were applied
+    using VolumeList = std::vector<std::pair<std::uint64_t, VolumeOperation<L, T> const*>>;
+
+    /**
+     * @brief The volumes of 'volumes' that weren't rolled back.
+     */
+    static auto applied_volumes(std::map<std::uint64_t, VolumeRecord> const& volumes) -> VolumeList;
+
+    /**
+     * @brief Combines the signed distance of 'operations' in order with 'distances' at every point
+     *        and keeps the volume each distance came from.
+     *
+     * Added volumes take the minimum, subtracted volumes the maximum with their negated distance
+     * and intersected volumes the maximum. Starting from 'not_fully_inside' this is the distance
+     * of the whole CSG sequence, which the levels only store per operation.
+     *
+     * @param lower_distances - combined with the same volume distances as 'distances' (if provided).
+     */
+    static auto combine_volumes(VolumeList const&     operations,
+                                glm::vec<L, T> const* points,
+                                std::size_t           count,
+                                BandDistance*         distances,
+                                BandDistance*         lower_distances = nullptr) -> void;
+
+    /**
+     * @brief The geometry 'operation' can change (everything for intersections).
+     */
+    auto changed_region(VolumeOperation<L, T> const& operation) const -> sdf::AABB<L, T>;
+
+    /**
+     * @brief What 'update_narrow_band' combines the volumes with.
+     */
+    enum class BandStart : char {
+        Outside, ///< Nothing, the band is recomputed from the volumes
+        Current, ///< The band distance, or the levels for cells that aren't in the band
+    };
+
+    /**
+     * @brief Combines 'operations' with the band cells within the band width of 'region'.
+     *
+     * Cells that aren't in the band are further than the band width from the surface or entirely
+     * inside, so starting them from the levels ('not_fully_inside' or negative infinity) gives the
+     * same band cells as combining every volume. Coarse cells are only split where the combined
+     * distance could be in the band, so the volumes are evaluated at few points away from the
+     * surface. This has to run before the levels are changed by 'operations'.
+     *
+     * @param journal - keeps the original of every changed cell (if provided).
+     */
+    auto update_narrow_band(sdf::AABB<L, T> const& region,
+                            VolumeList             operations,
+                            BandStart              start,
+                            BandJournal*           journal = nullptr) -> void;
+
+    /**
+     * @brief Keeps the distance a band cell had before its first change since the last delta.
+     */
+    auto record_band_original(Cell const& cell, std::optional<T> distance) -> void;
+
+    /**
+     * @brief 'record_band_original' for every band cell, before the whole band is replaced.
+     */
+    auto record_band_originals() -> void;
+
+    auto begin_operation(VolumeOperation<L, T>              operation,
+                         bool                               record_journal,
+                         std::shared_ptr<RootOwners> const& root_owners = nullptr,
+                         std::size_t                        batch_index = 0) -> PendingOperation;
+
+    /**
+     * @brief Processes at most 'max_cells' cells of the current frontier.
+     * @return true when the operation has refined every level.
+     */
+    auto step(PendingOperation* pending, std::size_t max_cells) -> bool;
+
+    // The steps of refining one level: 'remove_children' -> 'gather_frontier' ->
+    // 'evaluate_cells' (parallel) -> 'apply_cells' (sequential) -> 'finish_level'.
+    auto remove_children(PendingOperation* pending) -> void;
+    auto gather_frontier(PendingOperation* pending) -> void;
+    auto evaluate_cells(PendingOperation const& pending,
+                        std::size_t             begin_cell,
+                        std::size_t             end_cell,
+                        glm::vec<L, T>*         points,
+                        T*                      distances) const -> void;
+    auto apply_cells(PendingOperation*     pending,
+                     std::size_t           begin_cell,
+                     std::size_t           end_cell,
+                     glm::vec<L, T> const* points,
+                     T const*              distances) -> void;
+    auto finish_level(PendingOperation* pending) -> void;
+
+    /**
+     * @brief Applies the operations of a batch to the cells of 'level' in one pass.
+     *
+     * Every cell goes through the steps of each operation reaching it ('remove_children' and
+     * 'apply_cells') in order. A cell's steps only change that cell, so this is the same as
+     * applying each operation to the whole level in order. 'frontier' holds the cells of 'level'
+     * and is replaced with the frontier of the next level.
+     *
+     * @param top_levels - the coarsest level each operation visits (below 'lowest_level_' if none).
+     */
+    auto apply_batch_level(std::vector<VolumeOperation<L, T>> const& operations,
+                           RootOwners const&                         root_owners,
+                           std::vector<int> const&                   top_levels,
+                           int                                       level,
+                           BatchFrontier*                            frontier) -> void;
+
+    /**
+     * @brief False if the root was added by an operation after 'owner' (see 'RootOwners').
+     */
+    auto is_root_visible(RootOwners const* owners, std::size_t owner, int level, Cell const& root_cell) const -> bool;
+    auto overlaps(sdf::AABB<L, T> const& region, int level, Cell const& cell) const -> bool;
+    auto process_add(PendingOperation*     pending,
+                     SparseVolumeMap&      distance_field,
+                     Cell const&           cell,
+                     glm::vec<L, T> const& p,
+                     T                     min_dist,
+                     T                     cell_corner_dist) -> void;
+    auto process_subtract(PendingOperation*     pending,
+                          SparseVolumeMap&      distance_field,
+                          Cell const&           cell,
+                          VisitState            state,
+                          glm::vec<L, T> const& p,
+                          T                     min_dist,
+                          T                     cell_corner_dist) -> void;
+    auto process_intersect(PendingOperation*     pending,
+                           SparseVolumeMap&      distance_field,
+                           Cell const&           cell,
+                           VisitState            state,
+                           glm::vec<L, T> const& p,
+                           T                     min_dist,
+                           T                     cell_corner_dist) -> void;
+
+    /**
+     * @brief Undoes every change recorded in the operation's journal.
+     */
+    auto roll_back(PendingOperation* pending) -> void;
+
+    // All modifications of 'levels_' go through these so they can be recorded (and so the child
+    // masks and the storage of the finest level stay up to date).
+    auto set_cell(PendingOperation* pending, int level, Cell const& cell, VecDist const& value) -> void;
+    auto erase_cell(PendingOperation* pending, int level, Cell const& cell) -> bool;
+
+    /// The finest stored cell containing a point
+    struct CellQuery {
+        int            level = 0;
+        Cell           cell  = {};
+        std::optional<VecDist> value = {}; ///< Not set if no cell contains the point
+    };
+
+    using BrickCache = typename SparseVolumeMap::BrickCache;
+
+    /**
+     * @brief Finds the finest cell containing 'point'.
+     *
+     * The search continues below 'start' (a cell containing 'point') when it is set. Every cell
+     * found on the way is appended to 'path', coarsest first. Lookups in leaf bricks reuse
+     * 'cache' (if set) while they stay in the same brick.
+     */
+    auto find_deepest(glm::vec<L, T> const&   point,
+                      CellQuery               start = {},
+                      std::vector<CellQuery>* path  = nullptr,
+                      BrickCache*             cache = nullptr) const -> CellQuery;
+
+    /**
+     * @brief Follows the existing children containing 'point' down from 'query'.
+     */
+    auto descend(glm::vec<L, T> const&   point,
+                 CellQuery               query,
+                 std::vector<CellQuery>* path,
+                 BrickCache*             cache) const -> CellQuery;
+
+    auto interpolate(glm::vec<L, T> const& point,
+                     CellQuery const&      query,
+                     Interpolation         interpolation,
+                     BrickCache*           cache = nullptr) const -> T;
+
+    /**
+     * @brief The cells of 'level', created if needed and stored in bricks if it is the finest
+     *        level and leaf bricks are enabled.
+     */
+    auto level_cells(int level) -> SparseVolumeMap&;
+
+    /**
+     * @brief The box around every root cell (every cell if the roots are unknown).
+     */
+    auto cell_bounds() const -> sdf::AABB<L, T>;
+
+    /**
+     * @brief The roots that exist, or every cell without a parent if the roots are unknown (as in replicas).
+     */
+    auto top_cells() const -> std::vector<std::pair<int, Cell>>;
+
+    /**
+     * @brief 'min_clearance' for the union of the geometries evaluated by 'operation'.
+     */
+    auto min_clearance_to(VolumeOperation<L, T> const& operation, T early_exit_threshold) const
+        -> std::optional<Clearance>;
+
+    auto trace_ray(QueryCursor*           cursor,
+                   sdf::AABB<L, T> const& bounds,
+                   glm::vec<L, T> const&  origin,
+                   glm::vec<L, T> const&  direction,
+                   T                      max_t) const -> std::optional<RayHit>;
+
+    /**
+     * @brief Calls 'func(child)' for every existing child of 'cell'.
+     */
+    template <typename Func>
+    auto for_each_child(int level, Cell const& cell, Func const& func) const -> void;
+
+    /**
+     * @brief Adds the children of 'cell' to the visited cells of the next level.
+     *
+     * Missing children are only visited when they can be created by the operation.
+     */
+    auto visit_children(PendingOperation* pending, Cell const& cell, VisitState children_state) -> void;
+};
+
+/**
+ * @brief Answers 'distance_at' queries for points that move in small steps.
+ *
+ * The cursor remembers the chain of cells containing the previous point. The next query only
+ * climbs the chain until a cell contains the new point and descends from there, so a point in the
+ * same cell as the previous one needs no lookups at all.
+ *
+ * A cursor can outlive edits of its hierarchy (it starts over from the coarsest cells after any
+ * change) but not the hierarchy itself. Use one cursor per thread.
+ *
+ * Example (following a toolpath):
+ *
+ *     auto cursor = dvh.cursor();
+ *     for (auto const& point : toolpath) {
+ *         auto distance = cursor.distance_at(point);
+ *         ...
+ *     }
+ */
+template <int L, typename T>
+class DistanceVolumeHierarchyCpu<L, T>::QueryCursor {
+public:
+    explicit QueryCursor(DistanceVolumeHierarchyCpu const& hierarchy);
+
+    auto distance_at(glm::vec<L, T> const& point, Interpolation interpolation = Interpolation::Nearest) -> T;
+
+    /**
+     * @brief Forgets the previous query.
+     */
+    auto reset() -> void;
+
+private:
+    friend class DistanceVolumeHierarchyCpu;
+
+    DistanceVolumeHierarchyCpu const* hierarchy_;
+    std::uint64_t                     revision_;
+    std::vector<CellQuery>            chain_; ///< The cells containing the previous point, coarsest first
+    BrickCache                        leaf_cache_; ///< The leaf brick of the previous lookup
+
+    /**
+     * @brief The finest cell containing 'point', starting from the previous chain.
+     */
+    auto locate(glm::vec<L, T> const& point) -> CellQuery;
 };
 
 template <int L, typename T = float>
@@ -70,6 +70,12 @@ public:
     template <typename Geometry>
     void subtract_volumes(std::vector<Geometry> const& geometries);
 
+    /**
+     * @brief Keeps only the parts of the hierarchy that are inside 'geometries'.
+     */
+    template <typename Geometry>
+    void intersect_volumes(std::vector<Geometry> const& geometries);
+
     auto levels() const -> LevelMap<SparseVolumeMap> const&;
 
     auto base_resolution() const -> T;
@@ -0,0 +1,166 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "distance_volume_hierarchy_gpu.hpp"
+#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+
+namespace ltb {
+namespace dvh {
+
+template <int L, typename T>
+template <typename Geometry>
+void DistanceVolumeHierarchyGpu<L, T>::intersect_volumes(std::vector<Geometry> const& cpu_geometries) {
+    if (cpu_roots_.empty()) {
+        return;
+    }
+
+    auto volume_bounds = sdf::AABB<L, T>();
+
+    for (const auto& cpu_geometry : cpu_geometries) {
+        auto aabb     = cpu_geometry.bounding_box();
+        volume_bounds = sdf::expand(volume_bounds, aabb.min_point);
+        volume_bounds = sdf::expand(volume_bounds, aabb.max_point);
+    }
+
+    enum State : unsigned {
+        DoesNotMatter    = 0u,
+        PreviouslyInside = 1u,
+    };
+
+    CellSet        children_to_remove;
+    CellSet        to_remove;
+    CellMap<State> to_visit;
+    CellMap<State> cells;
+
+    for (int level = cpu_roots_.begin()->first; level >= lowest_level_; --level) {
+
+        auto& distance_field = cpu_levels_[level];
+
+        std::swap(to_remove, children_to_remove);
+
+        for (const auto& cell_to_remove : to_remove) {
+            if (distance_field.erase(cell_to_remove) == 0u) {
+                continue;
+            }
+
+            auto children = children_cells(cell_to_remove);
+            children_to_remove.insert(std::make_move_iterator(children.begin()),
+                                      std::make_move_iterator(children.end()));
+        }
+        to_remove.clear();
+
+        // Cells whose parent's bounding sphere doesn't touch the bounds are removed without being
+        // evaluated. The test is nested so their descendants are removed on the finer levels.
+        auto parent_resolution = resolution(level + 1);
+        auto parent_corner     = glm::length(glm::vec<L, T>(parent_resolution * T(0.5)));
+
+        auto is_outside_bounds = [&](Cell const& cell) {
+            auto center = dvh::cell_center(parent_cell(cell), parent_resolution);
+            return !sdf::intersects(volume_bounds, {center - parent_corner, center + parent_corner});
+        };
+
+        for (auto iter = distance_field.begin(); iter != distance_field.end();) {
+            if (is_outside_bounds(iter->first)) {
+                iter = distance_field.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+
+        std::swap(cells, to_visit);
+
+        if (cpu_roots_.find(level) != cpu_roots_.end()) {
+            auto const& root_cells = cpu_roots_.at(level);
+            for (const auto root_cell : root_cells) {
+                cells.emplace(root_cell, State::DoesNotMatter);
+            }
+        }
+
+        auto level_resolution = resolution(level);
+        auto half_resolution  = level_resolution * T(0.5);
+        auto cell_corner_dist = glm::length(glm::vec<L, T>(half_resolution));
+
+        for (const auto& cell_and_state : cells) {
+            const auto& cell  = cell_and_state.first;
+            const auto& state = cell_and_state.second;
+
+            if (is_outside_bounds(cell)) {
+                continue;
+            }
+
+            auto const p = dvh::cell_center(cell, level_resolution);
+
+            auto min_dist = std::numeric_limits<T>::infinity();
+
+            for (auto const& cpu_geometry : cpu_geometries) {
+                min_dist = std::min(min_dist, cpu_geometry.distance_from(p));
+            }
+
+            auto iter = distance_field.find(cell);
+
+            if (min_dist > cell_corner_dist) {
+                // Entirely outside of the intersecting volume
+                if (iter != distance_field.end()) {
+                    distance_field.erase(iter);
+
+                    auto children = children_cells(cell);
+                    children_to_remove.insert(std::make_move_iterator(children.begin()),
+                                              std::make_move_iterator(children.end()));
+                }
+
+            } else if (min_dist < -cell_corner_dist) {
+                // Entirely inside so the cell and its children are kept as they are
+                if (state == State::PreviouslyInside && iter == distance_field.end()) {
+                    distance_field[cell] = glm::vec<L + 1, T>(p, min_dist);
+                }
+
+            } else {
+                State children_state = state;
+
+                if (iter != distance_field.end()) {
+                    if (iter->second[L] < 0.f) {
+                        children_state       = State::PreviouslyInside;
+                        distance_field[cell] = glm::vec<L + 1, T>(DistanceVolumeHierarchyGpu<L, T>::not_fully_inside);
+                    }
+
+                } else if (state == State::PreviouslyInside) {
+                    distance_field[cell] = glm::vec<L + 1, T>(DistanceVolumeHierarchyGpu<L, T>::not_fully_inside);
+
+                } else {
+                    continue;
+                }
+
+                auto children = children_cells(cell);
+                for (const auto& child_cell : children) {
+                    to_visit[child_cell] = children_state;
+                }
+            }
+        }
+        cells.clear();
+    }
+}
+
+} // namespace dvh
+} // namespace ltb
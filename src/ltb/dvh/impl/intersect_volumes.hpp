@@ -0,0 +1,58 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "distance_volume_hierarchy_cpu.hpp"
+#include "ltb/dvh/volume_operation.hpp"
+
+namespace ltb {
+namespace dvh {
+
+template <int L, typename T>
+template <typename Geometry>
+auto DistanceVolumeHierarchyCpu<L, T>::queue_intersect_volumes(std::vector<Geometry> geometries) -> VolumeHandle {
+    wait_for_builds();
+
+    auto operation = make_volume_operation<L, T>(VolumeOperationType::Intersect, std::move(geometries));
+    auto volume    = record_volume(operation);
+    queued_operations_.emplace_back(volume.id(), std::move(operation));
+    return volume;
+}
+
+template <int L, typename T>
+template <typename Geometry>
+auto DistanceVolumeHierarchyCpu<L, T>::intersect_volumes_async(std::vector<Geometry> geometries,
+                                                               ProgressCallback      on_progress) -> BuildHandle {
+    return apply_operation_async(make_volume_operation<L, T>(VolumeOperationType::Intersect, std::move(geometries)),
+                                 std::move(on_progress));
+}
+
+template <int L, typename T>
+template <typename Geometry>
+auto DistanceVolumeHierarchyCpu<L, T>::intersect_volumes(std::vector<Geometry> const& geometries) -> VolumeHandle {
+    return apply_operation(make_volume_operation<L, T>(VolumeOperationType::Intersect, geometries));
+}
+
+} // namespace dvh
+} // namespace ltb
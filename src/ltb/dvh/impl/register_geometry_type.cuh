@@ -24,6 +24,7 @@
 
 // project
 #include "add_volume.cuh"
+#include "intersect_volumes.cuh"
 #include "subtract_volumes.cuh"
 
 #define LTB_DVH_REGISTER_GEOMETRY_TYPE_2D(Type)                                                                        \
@@ -34,6 +35,10 @@
     template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, float>::subtract_volumes(                                  \
         const std::vector<Type<float>>& geometries);                                                                   \
     template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, double>::subtract_volumes(                                 \
+        const std::vector<Type<double>>& geometries);                                                                  \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, float>::intersect_volumes(                                 \
+        const std::vector<Type<float>>& geometries);                                                                   \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, double>::intersect_volumes(                                \
         const std::vector<Type<double>>& geometries);
 
 #define LTB_DVH_REGISTER_GEOMETRY_TYPE_3D(Type)                                                                        \
@@ -44,6 +49,10 @@
     template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, float>::subtract_volumes(                                  \
         const std::vector<Type<float>>& geometries);                                                                   \
     template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, double>::subtract_volumes(                                 \
+        const std::vector<Type<double>>& geometries);                                                                  \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, float>::intersect_volumes(                                 \
+        const std::vector<Type<float>>& geometries);                                                                   \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, double>::intersect_volumes(                                \
         const std::vector<Type<double>>& geometries);
 
 #define LTB_DVH_REGISTER_GEOMETRY_TYPE(Type)                                                                           \
@@ -78,4 +87,20 @@
     template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, double>::subtract_volumes(                                 \
         const std::vector<sdf::TransformedGeometry<Type, 2, double>>& geometries);                                     \
     template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, double>::subtract_volumes(                                 \
+        const std::vector<sdf::TransformedGeometry<Type, 3, double>>& geometries);                                     \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, float>::intersect_volumes(                                 \
+        const std::vector<Type<2, float>>& geometries);                                                                \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, float>::intersect_volumes(                                 \
+        const std::vector<Type<3, float>>& geometries);                                                                \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, double>::intersect_volumes(                                \
+        const std::vector<Type<2, double>>& geometries);                                                               \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, double>::intersect_volumes(                                \
+        const std::vector<Type<3, double>>& geometries);                                                               \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, float>::intersect_volumes(                                 \
+        const std::vector<sdf::TransformedGeometry<Type, 2, float>>& geometries);                                      \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, float>::intersect_volumes(                                 \
+        const std::vector<sdf::TransformedGeometry<Type, 3, float>>& geometries);                                      \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<2, double>::intersect_volumes(                                \
+        const std::vector<sdf::TransformedGeometry<Type, 2, double>>& geometries);                                     \
+    template void ::ltb::dvh::DistanceVolumeHierarchyGpu<3, double>::intersect_volumes(                                \
         const std::vector<sdf::TransformedGeometry<Type, 3, double>>& geometries);
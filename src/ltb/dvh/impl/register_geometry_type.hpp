@@ -24,58 +24,51 @@
 
 // project
 #include "add_volume.hpp"
+#include "intersect_volumes.hpp"
+#include "min_clearance.hpp"
 #include "subtract_volumes.hpp"
 
+// The geometry type is passed last (variadic) since it may contain commas.
+#define LTB_DVH_INSTANTIATE_OPERATIONS(L, T, ...)                                                                      \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::add_volume(                                            \
+        const std::vector<__VA_ARGS__>& geometries) -> ::ltb::dvh::VolumeHandle;                                       \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::subtract_volumes(                                      \
+        const std::vector<__VA_ARGS__>& geometries) -> ::ltb::dvh::VolumeHandle;                                       \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::add_volume_async(                                      \
+        std::vector<__VA_ARGS__> geometries,                                                                           \
+        ::ltb::dvh::ProgressCallback on_progress) -> ::ltb::dvh::BuildHandle;                                          \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::subtract_volumes_async(                                \
+        std::vector<__VA_ARGS__> geometries,                                                                           \
+        ::ltb::dvh::ProgressCallback on_progress) -> ::ltb::dvh::BuildHandle;                                          \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::queue_add_volume(                                      \
+        std::vector<__VA_ARGS__> geometries) -> ::ltb::dvh::VolumeHandle;                                              \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::queue_subtract_volumes(                                \
+        std::vector<__VA_ARGS__> geometries) -> ::ltb::dvh::VolumeHandle;                                              \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::intersect_volumes(                                     \
+        const std::vector<__VA_ARGS__>& geometries) -> ::ltb::dvh::VolumeHandle;                                       \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::intersect_volumes_async(                               \
+        std::vector<__VA_ARGS__> geometries,                                                                           \
+        ::ltb::dvh::ProgressCallback on_progress) -> ::ltb::dvh::BuildHandle;                                          \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::queue_intersect_volumes(                               \
+        std::vector<__VA_ARGS__> geometries) -> ::ltb::dvh::VolumeHandle;                                              \
+    template auto ::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::min_clearance(                                         \
+        const std::vector<__VA_ARGS__>& geometries,                                                                    \
+        T early_exit_threshold) const -> std::optional<::ltb::dvh::DistanceVolumeHierarchyCpu<L, T>::Clearance>;
+
 #define LTB_DVH_REGISTER_GEOMETRY_TYPE_2D(Type)                                                                        \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, float>::add_volume(                                        \
-        const std::vector<Type<float>>& geometries);                                                                   \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, double>::add_volume(                                       \
-        const std::vector<Type<double>>& geometries);                                                                  \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, float>::subtract_volumes(                                  \
-        const std::vector<Type<float>>& geometries);                                                                   \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, double>::subtract_volumes(                                 \
-        const std::vector<Type<double>>& geometries);
+    LTB_DVH_INSTANTIATE_OPERATIONS(2, float, Type<float>)                                                              \
+    LTB_DVH_INSTANTIATE_OPERATIONS(2, double, Type<double>)
 
 #define LTB_DVH_REGISTER_GEOMETRY_TYPE_3D(Type)                                                                        \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, float>::add_volume(                                        \
-        const std::vector<Type<float>>& geometries);                                                                   \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, double>::add_volume(                                       \
-        const std::vector<Type<double>>& geometries);                                                                  \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, float>::subtract_volumes(                                  \
-        const std::vector<Type<float>>& geometries);                                                                   \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, double>::subtract_volumes(                                 \
-        const std::vector<Type<double>>& geometries);
+    LTB_DVH_INSTANTIATE_OPERATIONS(3, float, Type<float>)                                                              \
+    LTB_DVH_INSTANTIATE_OPERATIONS(3, double, Type<double>)
 
 #define LTB_DVH_REGISTER_GEOMETRY_TYPE(Type)                                                                           \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, float>::add_volume(                                        \
-        const std::vector<Type<2, float>>& geometries);                                                                \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, float>::add_volume(                                        \
-        const std::vector<Type<3, float>>& geometries);                                                                \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, double>::add_volume(                                       \
-        const std::vector<Type<2, double>>& geometries);                                                               \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, double>::add_volume(                                       \
-        const std::vector<Type<3, double>>& geometries);                                                               \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, float>::add_volume(                                        \
-        const std::vector<sdf::TransformedGeometry<Type, 2, float>>& geometries);                                      \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, float>::add_volume(                                        \
-        const std::vector<sdf::TransformedGeometry<Type, 3, float>>& geometries);                                      \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, double>::add_volume(                                       \
-        const std::vector<sdf::TransformedGeometry<Type, 2, double>>& geometries);                                     \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, double>::add_volume(                                       \
-        const std::vector<sdf::TransformedGeometry<Type, 3, double>>& geometries);                                     \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, float>::subtract_volumes(                                  \
-        const std::vector<Type<2, float>>& geometries);                                                                \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, float>::subtract_volumes(                                  \
-        const std::vector<Type<3, float>>& geometries);                                                                \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, double>::subtract_volumes(                                 \
-        const std::vector<Type<2, double>>& geometries);                                                               \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, double>::subtract_volumes(                                 \
-        const std::vector<Type<3, double>>& geometries);                                                               \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, float>::subtract_volumes(                                  \
-        const std::vector<sdf::TransformedGeometry<Type, 2, float>>& geometries);                                      \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, float>::subtract_volumes(                                  \
-        const std::vector<sdf::TransformedGeometry<Type, 3, float>>& geometries);                                      \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<2, double>::subtract_volumes(                                 \
-        const std::vector<sdf::TransformedGeometry<Type, 2, double>>& geometries);                                     \
-    template void ::ltb::dvh::DistanceVolumeHierarchyCpu<3, double>::subtract_volumes(                                 \
-        const std::vector<sdf::TransformedGeometry<Type, 3, double>>& geometries);
+    LTB_DVH_INSTANTIATE_OPERATIONS(2, float, Type<2, float>)                                                           \
+    LTB_DVH_INSTANTIATE_OPERATIONS(3, float, Type<3, float>)                                                           \
+    LTB_DVH_INSTANTIATE_OPERATIONS(2, double, Type<2, double>)                                                         \
+    LTB_DVH_INSTANTIATE_OPERATIONS(3, double, Type<3, double>)                                                         \
+    LTB_DVH_INSTANTIATE_OPERATIONS(2, float, sdf::TransformedGeometry<Type, 2, float>)                                 \
+    LTB_DVH_INSTANTIATE_OPERATIONS(3, float, sdf::TransformedGeometry<Type, 3, float>)                                 \
+    LTB_DVH_INSTANTIATE_OPERATIONS(2, double, sdf::TransformedGeometry<Type, 2, double>)                               \
+    LTB_DVH_INSTANTIATE_OPERATIONS(3, double, sdf::TransformedGeometry<Type, 3, double>)
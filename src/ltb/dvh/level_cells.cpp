@@ -0,0 +1,434 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "level_cells.hpp"
+
+// project
+#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <limits>
+#include <stdexcept>
+
+namespace ltb::dvh {
+
+template <int L, typename T>
+LevelCells<L, T>::const_iterator::const_iterator(LevelCells const* cells, HashIterator hash_iter)
+    : cells_(cells), hash_iter_(hash_iter) {}
+
+template <int L, typename T>
+LevelCells<L, T>::const_iterator::const_iterator(LevelCells const* cells, std::size_t brick, std::size_t index)
+    : cells_(cells), brick_(brick), index_(index) {}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::operator*() const -> reference {
+    if (!cells_->bricked()) {
+        return *hash_iter_;
+    }
+    auto const& brick = cells_->bricks_[brick_];
+    return {brick_cell(brick.origin, index_), cells_->value(brick, index_)};
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::operator->() const -> pointer {
+    return {**this};
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::operator++() -> const_iterator& {
+    if (!cells_->bricked()) {
+        ++hash_iter_;
+    } else {
+        ++index_;
+        skip_inactive();
+    }
+    return *this;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::operator++(int) -> const_iterator {
+    auto previous = *this;
+    ++*this;
+    return previous;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::operator==(const_iterator const& other) const -> bool {
+    if (!cells_ || !cells_->bricked()) {
+        return hash_iter_ == other.hash_iter_;
+    }
+    return brick_ == other.brick_ && index_ == other.index_;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::operator!=(const_iterator const& other) const -> bool {
+    return !(*this == other);
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::const_iterator::skip_inactive() -> void {
+    auto const& bricks = cells_->bricks_;
+
+    while (brick_ < bricks.size()) {
+        auto const& active = bricks[brick_].active;
+
+        while (index_ < cells_per_brick && !active[index_]) {
+            ++index_;
+        }
+        if (index_ < cells_per_brick) {
+            return;
+        }
+        ++brick_;
+        index_ = 0u;
+    }
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::use_bricks(std::optional<T> resolution) -> void {
+    if (bricked() == resolution.has_value() && (!resolution || *resolution == *brick_resolution_)) {
+        return;
+    }
+
+    std::vector<value_type> values(begin(), end());
+
+    cells_.clear();
+    bricks_.clear();
+    brick_indices_.clear();
+    num_bricked_cells_ = 0u;
+    brick_resolution_  = resolution;
+
+    for (auto const& [cell, value] : values) {
+        insert_or_assign(cell, value);
+    }
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::bricked() const -> bool {
+    return brick_resolution_.has_value();
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::begin() const -> const_iterator {
+    if (!bricked()) {
+        return {this, cells_.begin()};
+    }
+    auto iter = const_iterator(this, 0u, 0u);
+    iter.skip_inactive();
+    return iter;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::end() const -> const_iterator {
+    if (!bricked()) {
+        return {this, cells_.end()};
+    }
+    return {this, bricks_.size(), 0u};
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::find(Cell const& cell) const -> const_iterator {
+    if (!bricked()) {
+        return {this, cells_.find(cell)};
+    }
+    auto iter = brick_indices_.find(brick_key(cell));
+    return (iter == brick_indices_.end() ? end() : find_in_brick(iter->second, cell));
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::find(Cell const& cell, BrickCache* cache) const -> const_iterator {
+    if (!bricked() || !cache) {
+        return find(cell);
+    }
+
+    // The cached index is checked against the brick's origin since bricks move when others are released
+    auto const origin = brick_key(cell) * brick_width;
+    if (cache->cells == this && cache->index < bricks_.size() && bricks_[cache->index].origin == origin) {
+        return find_in_brick(cache->index, cell);
+    }
+
+    auto iter = brick_indices_.find(brick_key(cell));
+    if (iter == brick_indices_.end()) {
+        return end();
+    }
+    *cache = {this, iter->second};
+    return find_in_brick(iter->second, cell);
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::at(Cell const& cell) const -> VecDist {
+    if (!bricked()) {
+        return cells_.at(cell);
+    }
+    auto iter = find(cell);
+    if (iter == end()) {
+        throw std::out_of_range("LevelCells::at");
+    }
+    return iter->second;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::count(Cell const& cell) const -> size_type {
+    return (find(cell) == end() ? 0u : 1u);
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::insert_or_assign(Cell const& cell, VecDist const& value) -> std::pair<const_iterator, bool> {
+    if (!bricked()) {
+        auto [iter, inserted] = cells_.insert_or_assign(cell, value);
+        return {const_iterator(this, iter), inserted};
+    }
+
+    auto const key = brick_key(cell);
+
+    auto [iter, inserted] = brick_indices_.try_emplace(key, static_cast<std::uint32_t>(bricks_.size()));
+    if (inserted) {
+        bricks_.emplace_back();
+        bricks_.back().origin = key * brick_width;
+    }
+
+    auto&      brick = bricks_[iter->second];
+    auto const index = brick_index(cell);
+
+    auto const added = !brick.active[index];
+    if (added) {
+        brick.active.set(index);
+        ++num_bricked_cells_;
+    }
+    brick.distances[index] = value[L];
+
+    return {const_iterator(this, iter->second, index), added};
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::emplace(Cell const& cell, VecDist const& value) -> std::pair<const_iterator, bool> {
+    if (auto iter = find(cell); iter != end()) {
+        return {iter, false};
+    }
+    return insert_or_assign(cell, value);
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::erase(Cell const& cell) -> size_type {
+    if (!bricked()) {
+        return cells_.erase(cell);
+    }
+
+    auto iter = brick_indices_.find(brick_key(cell));
+    if (iter == brick_indices_.end()) {
+        return 0u;
+    }
+
+    auto&      brick = bricks_[iter->second];
+    auto const index = brick_index(cell);
+
+    if (!brick.active[index]) {
+        return 0u;
+    }
+    brick.active.reset(index);
+    --num_bricked_cells_;
+
+    if (brick.active.none()) {
+        // Keep the bricks contiguous by moving the last brick into the empty slot
+        auto const empty_index = iter->second;
+        brick_indices_.erase(iter);
+
+        if (empty_index + 1u != bricks_.size()) {
+            std::swap(bricks_[empty_index], bricks_.back());
+            brick_indices_.at(brick_key(bricks_[empty_index].origin)) = empty_index;
+        }
+        bricks_.pop_back();
+    }
+    return 1u;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::clear() -> void {
+    cells_.clear();
+    bricks_.clear();
+    brick_indices_.clear();
+    num_bricked_cells_ = 0u;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::reserve(size_type count) -> void {
+    if (!bricked()) {
+        cells_.reserve(count);
+    }
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::size() const -> size_type {
+    return (bricked() ? num_bricked_cells_ : cells_.size());
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::empty() const -> bool {
+    return size() == 0u;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::bricks() const -> std::vector<Brick> const& {
+    return bricks_;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::operator==(LevelCells const& other) const -> bool {
+    if (size() != other.size()) {
+        return false;
+    }
+    for (auto const& [cell, value] : *this) {
+        auto iter = other.find(cell);
+        if (iter == other.end() || iter->second != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::operator!=(LevelCells const& other) const -> bool {
+    return !(*this == other);
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::brick_key(Cell const& cell) -> Cell {
+    Cell key;
+    for (int i = 0; i < L; ++i) {
+        // Rounds towards negative infinity so every brick has the same number of cells
+        key[i] = (cell[i] >= 0 ? cell[i] / brick_width : -((-cell[i] - 1) / brick_width) - 1);
+    }
+    return key;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::brick_index(Cell const& cell) -> std::size_t {
+    auto const local = cell - brick_key(cell) * brick_width;
+
+    auto index = 0ul;
+    for (int i = L - 1; i >= 0; --i) {
+        index = index * brick_width + static_cast<std::size_t>(local[i]);
+    }
+    return index;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::brick_cell(Cell const& origin, std::size_t index) -> Cell {
+    auto cell = origin;
+    for (int i = 0; i < L; ++i) {
+        cell[i] += static_cast<int>(index % brick_width);
+        index /= brick_width;
+    }
+    return cell;
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::value(Brick const& brick, std::size_t index) const -> VecDist {
+    auto const distance = brick.distances[index];
+
+    if (distance == std::numeric_limits<T>::infinity()) {
+        return VecDist(distance);
+    }
+    return VecDist(dvh::cell_center(brick_cell(brick.origin, index), *brick_resolution_), distance);
+}
+
+template <int L, typename T>
+auto LevelCells<L, T>::find_in_brick(std::size_t brick, Cell const& cell) const -> const_iterator {
+    auto const index = brick_index(cell);
+    return (bricks_[brick].active[index] ? const_iterator(this, brick, index) : end());
+}
+
+template class LevelCells<2, float>;
+template class LevelCells<3, float>;
+template class LevelCells<2, double>;
+template class LevelCells<3, double>;
+
+TEST_CASE("[dvh] bricked level cells match hashed level cells") {
+    using Cells = LevelCells<3, float>;
+
+    std::vector<glm::ivec3> cells;
+    for (int x = -9; x < 9; ++x) {
+        for (int y = -1; y < 1; ++y) {
+            for (int z = 7; z < 9; ++z) {
+                cells.emplace_back(x, y, z);
+            }
+        }
+    }
+
+    Cells hashed;
+    Cells bricked;
+    bricked.use_bricks(0.5f);
+
+    for (auto const& cell : cells) {
+        CHECK(Cells::brick_cell(Cells::brick_key(cell) * Cells::brick_width, Cells::brick_index(cell)) == cell);
+
+        auto const value = Cells::VecDist(cell_center(cell, 0.5f), float(cell.x));
+        CHECK(hashed.insert_or_assign(cell, value).second);
+        CHECK(bricked.insert_or_assign(cell, value).second);
+    }
+    hashed.insert_or_assign({0, 0, 0}, Cells::VecDist(std::numeric_limits<float>::infinity()));
+    bricked.insert_or_assign({0, 0, 0}, Cells::VecDist(std::numeric_limits<float>::infinity()));
+
+    CHECK(bricked.size() == cells.size() + 1ul);
+    CHECK(bricked.bricks().size() == 4ul * 2ul * 2ul);
+    CHECK(bricked == hashed);
+
+    auto iterated = 0ul;
+    for (auto const& [cell, value] : bricked) {
+        CHECK(hashed.at(cell) == value);
+        ++iterated;
+    }
+    CHECK(iterated == bricked.size());
+
+    // Cached lookups give the same results across brick borders
+    Cells::BrickCache cache;
+    for (auto const& cell : cells) {
+        auto iter = bricked.find(cell, &cache);
+        REQUIRE(iter != bricked.end());
+        CHECK(iter->second == hashed.at(cell));
+    }
+    CHECK(bricked.find({0, 0, 1}, &cache) == bricked.end());
+    CHECK(bricked.count({0, 0, 0}) == 1ul);
+
+    // Removing every cell of a brick releases it without disturbing the others
+    for (auto const& cell : cells) {
+        if (cell.x < 0 && cell.y < 0) {
+            CHECK(bricked.erase(cell) == 1ul);
+            hashed.erase(cell);
+        }
+    }
+    CHECK(bricked.erase({-1, -1, 7}) == 0ul);
+    CHECK(bricked.bricks().size() == 4ul * 2ul * 2ul - 2ul * 2ul);
+    CHECK(bricked == hashed);
+
+    for (auto const& cell : cells) {
+        CHECK((bricked.find(cell, &cache) != bricked.end()) == (cell.x >= 0 || cell.y >= 0));
+    }
+
+    bricked.use_bricks(std::nullopt);
+    CHECK_FALSE(bricked.bricked());
+    CHECK(bricked == hashed);
+}
+
+} // namespace ltb::dvh
@@ -0,0 +1,183 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// external
+#include <glm/gtx/hash.hpp>
+
+// standard
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ltb::dvh {
+
+/**
+ * @brief The cells of one level of a hierarchy, mapping cells to (center, distance) values.
+ *
+ * By default every cell is a separate hash map entry. Cells near large surfaces are dense though,
+ * so the cells can instead be stored in fixed size dense blocks ("bricks") of 8x8x8 (3D) or 16x16
+ * (2D) cells with a bitmask of the cells that exist (see 'use_bricks'). Looking up a cell is then
+ * one hash probe for its brick followed by an array access, and the distances of neighbouring
+ * cells share cache lines. Bricks only store distances. The point of a cell is always its center
+ * so it is recomputed from the cell and the resolution when a value is returned.
+ *
+ * The interface is the part of 'std::unordered_map' the hierarchy uses, except that values are
+ * read-only and returned by value (there is nothing to reference in a brick).
+ */
+template <int L, typename T>
+class LevelCells {
+public:
+    using Cell       = glm::vec<L, int>;
+    using VecDist    = glm::vec<L + 1, T>;
+    using value_type = std::pair<Cell, VecDist>;
+    using size_type  = std::size_t;
+
+    constexpr static int         brick_width     = (L == 3 ? 8 : 16);
+    constexpr static std::size_t cells_per_brick = (L == 3 ? 8ul * 8ul * 8ul : 16ul * 16ul);
+
+    struct Brick {
+        Cell                           origin; ///< The cell with the smallest coordinates
+        std::bitset<cells_per_brick>   active;
+        std::array<T, cells_per_brick> distances;
+    };
+
+    /**
+     * @brief The brick of the previous lookup. Consecutive lookups in the same brick reuse it
+     *        instead of probing the brick indices again.
+     */
+    struct BrickCache {
+        LevelCells const* cells = nullptr;
+        std::size_t       index = 0u;
+    };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = LevelCells::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = value_type;
+
+        /// Lets 'iter->first' and 'iter->second' work on values that are not stored anywhere
+        struct pointer {
+            value_type value;
+            auto       operator->() const -> value_type const* { return &value; }
+        };
+
+        const_iterator() = default;
+
+        auto operator*() const -> reference;
+        auto operator->() const -> pointer;
+        auto operator++() -> const_iterator&;
+        auto operator++(int) -> const_iterator;
+
+        auto operator==(const_iterator const& other) const -> bool;
+        auto operator!=(const_iterator const& other) const -> bool;
+
+    private:
+        friend class LevelCells;
+
+        using HashIterator = typename std::unordered_map<Cell, VecDist>::const_iterator;
+
+        LevelCells const* cells_ = nullptr;
+        HashIterator      hash_iter_; ///< When the cells are not in bricks
+        std::size_t       brick_ = 0u;
+        std::size_t       index_ = 0u; ///< In 'brick_'
+
+        const_iterator(LevelCells const* cells, HashIterator hash_iter);
+        const_iterator(LevelCells const* cells, std::size_t brick, std::size_t index);
+
+        /// Moves to the next active cell if the current one is not active
+        auto skip_inactive() -> void;
+    };
+
+    using iterator = const_iterator;
+
+    /**
+     * @brief Moves the cells into bricks of cells of size 'resolution', or back into a hash map
+     *        if 'resolution' is not set.
+     */
+    auto use_bricks(std::optional<T> resolution) -> void;
+    auto bricked() const -> bool;
+
+    auto begin() const -> const_iterator;
+    auto end() const -> const_iterator;
+
+    auto find(Cell const& cell) const -> const_iterator;
+
+    /**
+     * @brief 'find' that reuses 'cache' when 'cell' is in the same brick as the previous lookup
+     *        ('cache' may be nullptr).
+     */
+    auto find(Cell const& cell, BrickCache* cache) const -> const_iterator;
+
+    /**
+     * @throws std::out_of_range if 'cell' does not exist.
+     */
+    auto at(Cell const& cell) const -> VecDist;
+    auto count(Cell const& cell) const -> size_type;
+
+    auto insert_or_assign(Cell const& cell, VecDist const& value) -> std::pair<const_iterator, bool>;
+    auto emplace(Cell const& cell, VecDist const& value) -> std::pair<const_iterator, bool>;
+
+    /**
+     * @brief Removes 'cell'. Bricks without any cells are released.
+     */
+    auto erase(Cell const& cell) -> size_type;
+
+    auto clear() -> void;
+    auto reserve(size_type count) -> void;
+
+    auto size() const -> size_type;
+    auto empty() const -> bool;
+
+    /**
+     * @brief The bricks in no particular order (empty when the cells are not in bricks).
+     */
+    auto bricks() const -> std::vector<Brick> const&;
+
+    auto operator==(LevelCells const& other) const -> bool;
+    auto operator!=(LevelCells const& other) const -> bool;
+
+    static auto brick_key(Cell const& cell) -> Cell;
+    static auto brick_index(Cell const& cell) -> std::size_t;
+    static auto brick_cell(Cell const& origin, std::size_t index) -> Cell;
+
+private:
+    std::unordered_map<Cell, VecDist> cells_; ///< When the cells are not in bricks
+
+    std::optional<T>                        brick_resolution_; ///< Set when the cells are in bricks
+    std::size_t                             num_bricked_cells_ = 0u;
+    std::vector<Brick>                      bricks_; ///< Stored contiguously, in no particular order
+    std::unordered_map<Cell, std::uint32_t> brick_indices_; ///< Brick key -> index in 'bricks_'
+
+    auto value(Brick const& brick, std::size_t index) const -> VecDist;
+    auto find_in_brick(std::size_t brick, Cell const& cell) const -> const_iterator;
+};
+
+} // namespace ltb::dvh
@@ -0,0 +1,364 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "occupancy_pyramid.hpp"
+
+// project
+#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+#include "ltb/dvh/impl/distance_volume_hierarchy_cpu.hpp"
+#include "ltb/sdf/sdf.hpp"
+#include "ltb/util/thread_pool.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+namespace ltb::dvh {
+
+namespace {
+
+/// The summary bits of the children of one node
+struct ChildMasks {
+    std::uint64_t inside = 0u;
+    std::uint64_t mixed  = 0u;
+};
+
+} // namespace
+
+template <int L, typename T>
+OccupancyPyramid<L, T>::OccupancyPyramid(DistanceVolumeHierarchyCpu<L, T> const& hierarchy) {
+    static_assert(L * axis_bits == 6, "Nodes have exactly 64 children");
+
+    constexpr auto width    = 1 << axis_bits;
+    constexpr auto all_bits = ~std::uint64_t(0);
+
+    auto const& levels = hierarchy.levels();
+    if (levels.empty()) {
+        return;
+    }
+
+    auto const finest_level   = levels.rbegin()->first;
+    auto const coarsest_level = levels.begin()->first;
+    resolution_               = hierarchy.resolution(finest_level);
+
+    // Every inside cell as a block of finest cells: its smallest finest cell and log2 of its width.
+    // Only finest 'not_fully_inside' cells have the surface passing through them. Coarser ones
+    // without children were emptied by edits (or never refined) and have nothing inside.
+    std::vector<std::pair<Cell, int>> blocks;
+
+    for (auto const& [level, cells] : levels) {
+        auto const size_bits = level - finest_level;
+
+        for (auto const& [cell, value] : cells) {
+            if (value[L] != DistanceVolumeHierarchyCpu<L, T>::not_fully_inside
+                || (level == finest_level && hierarchy.child_mask(level, cell) == 0u)) {
+                blocks.emplace_back(cell * (1 << size_bits), size_bits);
+            }
+        }
+    }
+    if (blocks.empty()) {
+        return;
+    }
+
+    // Aligning the origin to the coarsest cells keeps every block aligned to its own width, so it
+    // fills whole children of a single node
+    auto const coarsest_bits = coarsest_level - finest_level;
+
+    auto min_cell = blocks.front().first;
+    for (auto const& [cell, size_bits] : blocks) {
+        min_cell = glm::min(min_cell, cell);
+    }
+    origin_ = min_cell & Cell(~((1 << coarsest_bits) - 1));
+
+    auto extent = std::int64_t(0);
+    for (auto const& [cell, size_bits] : blocks) {
+        for (int i = 0; i < L; ++i) {
+            extent = std::max(extent, std::int64_t(cell[i]) - origin_[i] + (std::int64_t(1) << size_bits));
+        }
+    }
+
+    // The children of the root have to be at least as wide as the coarsest cells
+    depth_ = std::max(2, coarsest_bits / axis_bits + 1);
+    while ((std::int64_t(1) << (axis_bits * depth_)) < extent) {
+        ++depth_;
+    }
+
+    // The summaries of every node on every level. Level zero holds the leaf words, which only use
+    // their 'inside' bits.
+    std::vector<std::unordered_map<Cell, ChildMasks>> node_levels(static_cast<std::size_t>(depth_));
+
+    auto child_bit = [](Cell const& offset) {
+        auto index = 0;
+        for (int i = 0; i < L; ++i) {
+            index |= offset[i] << (axis_bits * i);
+        }
+        return std::uint64_t(1) << index;
+    };
+
+    for (auto const& [cell, size_bits] : blocks) {
+        auto const local       = cell - origin_;
+        auto const node_level  = size_bits / axis_bits;
+        auto const span_bits   = size_bits % axis_bits;
+        auto const first_child = (local >> (axis_bits * node_level)) & (width - 1);
+
+        auto& masks = node_levels[static_cast<std::size_t>(node_level)][local >> (axis_bits * (node_level + 1))];
+
+        // Blocks between two node levels fill 2^'span_bits' children along every axis
+        for (auto i = 0; i < (1 << (span_bits * L)); ++i) {
+            auto offset = first_child;
+            for (int a = 0; a < L; ++a) {
+                offset[a] += (i >> (span_bits * a)) & ((1 << span_bits) - 1);
+            }
+            masks.inside |= child_bit(offset);
+        }
+    }
+
+    // Nodes that are entirely inside are replaced by an 'inside' bit in their parent
+    for (auto level = 0ul; level + 1u < node_levels.size(); ++level) {
+        for (auto const& [node, masks] : node_levels[level]) {
+            auto&      parent = node_levels[level + 1][node >> axis_bits];
+            auto const bit    = child_bit(node & (width - 1));
+
+            if (masks.inside == all_bits && masks.mixed == 0u) {
+                parent.inside |= bit;
+            } else {
+                parent.mixed |= bit;
+            }
+        }
+    }
+
+    // Breadth-first from the root so the children of a node are next to each other
+    std::vector<Cell> level_nodes = {Cell(0)};
+    std::vector<Cell> child_nodes;
+
+    for (auto level = depth_ - 1; level > 0; --level) {
+        auto const first_node = nodes_.size();
+        child_nodes.clear();
+
+        for (auto const& node : level_nodes) {
+            auto const& masks = node_levels[static_cast<std::size_t>(level)].at(node);
+            auto const  mixed = masks.mixed & ~masks.inside;
+
+            nodes_.push_back({masks.inside, mixed, static_cast<std::uint32_t>(child_nodes.size())});
+
+            for (auto index = 0; index < (1 << (axis_bits * L)); ++index) {
+                if (mixed & (std::uint64_t(1) << index)) {
+                    auto child = node * width;
+                    for (int a = 0; a < L; ++a) {
+                        child[a] += (index >> (axis_bits * a)) & (width - 1);
+                    }
+                    child_nodes.emplace_back(child);
+                }
+            }
+        }
+
+        // The children of the next level are stored after every node of this level
+        if (level > 1) {
+            for (auto i = first_node; i < nodes_.size(); ++i) {
+                nodes_[i].first_child += static_cast<std::uint32_t>(nodes_.size());
+            }
+        }
+        std::swap(level_nodes, child_nodes);
+    }
+
+    leaves_.reserve(level_nodes.size());
+    for (auto const& leaf : level_nodes) {
+        leaves_.emplace_back(node_levels[0].at(leaf).inside);
+    }
+
+    min_point_ = glm::vec<L, T>(origin_) * resolution_;
+    max_point_ = (glm::vec<L, T>(origin_) + T(std::int64_t(1) << (axis_bits * depth_))) * resolution_;
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::inside(glm::vec<L, T> const& point) const -> bool {
+    // Also rejects NaNs and points too far away to be converted to cells
+    if (nodes_.empty() || !glm::all(glm::greaterThanEqual(point, min_point_))
+        || !glm::all(glm::lessThan(point, max_point_))) {
+        return false;
+    }
+
+    auto const local = glm::vec<L, std::uint32_t>(get_cell(point, resolution_) - origin_);
+    if (glm::any(glm::greaterThanEqual(local, glm::vec<L, std::uint32_t>(1u << (axis_bits * depth_))))) {
+        return false; // Rounded onto the far side of the root
+    }
+
+    auto const* node = nodes_.data();
+
+    for (auto shift = axis_bits * (depth_ - 1);; shift -= axis_bits) {
+        auto const bit = std::uint64_t(1) << child_index(local, shift);
+
+        if (node->inside & bit) {
+            return true;
+        }
+        if (!(node->mixed & bit)) {
+            return false;
+        }
+
+        auto const child = node->first_child + std::bitset<64>(node->mixed & (bit - 1u)).count();
+
+        if (shift == axis_bits) {
+            return (leaves_[child] >> child_index(local, 0)) & 1u;
+        }
+        node = &nodes_[child];
+    }
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::inside(glm::vec<L, T> const* points, std::size_t count, bool* results) const -> void {
+    auto const num_chunks = (count + query_grain_size - 1u) / query_grain_size;
+
+    util::ThreadPool::shared().parallel_for(0, num_chunks, [&](std::size_t chunk) {
+        auto const begin = chunk * query_grain_size;
+        auto const end   = std::min(begin + query_grain_size, count);
+
+        for (auto i = begin; i < end; ++i) {
+            results[i] = inside(points[i]);
+        }
+    });
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::nodes() const -> std::vector<Node> const& {
+    return nodes_;
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::leaves() const -> std::vector<std::uint64_t> const& {
+    return leaves_;
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::depth() const -> int {
+    return depth_;
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::resolution() const -> T {
+    return resolution_;
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::memory_size() const -> std::size_t {
+    return sizeof(OccupancyPyramid) + nodes_.size() * sizeof(Node) + leaves_.size() * sizeof(std::uint64_t);
+}
+
+template <int L, typename T>
+auto OccupancyPyramid<L, T>::child_index(glm::vec<L, std::uint32_t> const& local, int shift) -> int {
+    auto index = 0;
+    for (int i = 0; i < L; ++i) {
+        index |= static_cast<int>((local[i] >> shift) & ((1u << axis_bits) - 1u)) << (axis_bits * i);
+    }
+    return index;
+}
+
+template class OccupancyPyramid<2, float>;
+template class OccupancyPyramid<3, float>;
+template class OccupancyPyramid<2, double>;
+template class OccupancyPyramid<3, double>;
+
+TEST_CASE("[dvh] occupancy pyramids match the inside of the volumes") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const resolution = 0.05f;
+    auto const tolerance  = glm::length(glm::vec3(resolution)); // One finest cell
+
+    std::mt19937                          generator(7u);
+    std::uniform_real_distribution<float> distribution(-1.2f, 1.2f);
+
+    std::vector<glm::vec3> points(20000);
+    for (auto& point : points) {
+        point = {distribution(generator), distribution(generator), distribution(generator)};
+    }
+
+    // Points further than a finest cell from the surface are answered exactly
+    auto check_pyramid = [&](Dvh const& dvh, auto const& true_distance) {
+        auto const pyramid = dvh.occupancy();
+
+        auto results = std::make_unique<bool[]>(points.size());
+        pyramid.inside(points.data(), points.size(), results.get());
+
+        auto num_inside  = 0ul;
+        auto num_outside = 0ul;
+
+        for (auto i = 0ul; i < points.size(); ++i) {
+            CHECK(results[i] == pyramid.inside(points[i]));
+
+            auto const distance = true_distance(points[i]);
+            if (std::abs(distance) <= tolerance) {
+                continue;
+            }
+            CHECK(pyramid.inside(points[i]) == (distance < 0.f));
+            num_inside += (distance < 0.f);
+            num_outside += (distance > 0.f);
+        }
+        CHECK(num_inside > 500ul);
+        CHECK(num_outside > 500ul);
+        CHECK_FALSE(pyramid.inside(glm::vec3(100.f)));
+        CHECK_FALSE(pyramid.inside(glm::vec3(std::numeric_limits<float>::quiet_NaN())));
+
+        return pyramid.memory_size();
+    };
+
+    SUBCASE("A box with a tunnel") {
+        auto const box  = sdf::make_box<3>({1.6f, 1.2f, 0.8f});
+        auto const line = sdf::make_offset_line<3>({-1.f, -1.f, 0.f}, {1.f, 0.5f, 0.2f}, 0.2f);
+
+        Dvh dvh(resolution);
+        dvh.add_volume(std::vector{box});
+        dvh.subtract_volumes(std::vector{line});
+
+        auto const memory_size = check_pyramid(dvh, [&](glm::vec3 const& point) {
+            return std::max(box.distance_from(point), -line.distance_from(point));
+        });
+
+        // A small fraction of the distances alone
+        auto num_cells = 0ul;
+        for (auto const& [level, cells] : dvh.levels()) {
+            num_cells += cells.size();
+        }
+        CHECK(memory_size * 10ul < num_cells * sizeof(glm::vec4));
+    }
+
+    SUBCASE("Cells emptied by a subtraction are outside") {
+        auto const box  = sdf::make_transformed_geometry(sdf::make_box<3>({2.f, 2.f, 2.f}));
+        auto const hole = sdf::make_transformed_geometry(sdf::make_box<3>({2.f, 2.f, 2.f}), {1.37f, 0.f, 0.f});
+
+        Dvh dvh(resolution);
+        dvh.add_volume(std::vector{box});
+        dvh.subtract_volumes(std::vector{hole});
+
+        check_pyramid(dvh, [&](glm::vec3 const& point) {
+            return std::max(box.distance_from(point), -hole.distance_from(point));
+        });
+    }
+
+    CHECK_FALSE(OccupancyPyramid<3, float>(Dvh(resolution)).inside(glm::vec3(0.f)));
+}
+
+} // namespace ltb::dvh
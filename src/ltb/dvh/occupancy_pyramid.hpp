@@ -0,0 +1,119 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// external
+#include <glm/glm.hpp>
+
+// standard
+#include <cstdint>
+#include <vector>
+
+namespace ltb::dvh {
+
+template <int L, typename T>
+class DistanceVolumeHierarchyCpu;
+
+/**
+ * @brief A bit-packed copy of a hierarchy that only answers whether points are inside.
+ *
+ * Every node covers a block of 64 cells (4x4x4 in 3D, 8x8 in 2D), so one node spans two levels of
+ * the hierarchy in 3D and three in 2D. Two bits per child summarize it:
+ *
+ * - 'inside' set: every point in the child is inside.
+ * - 'mixed' set: the child has a node (or leaf word) of its own below it.
+ * - neither: every point in the child is outside.
+ *
+ * Children with nodes are stored next to each other in the order of their bits, so a child is
+ * found by counting the 'mixed' bits before it instead of storing an index per child. The finest
+ * blocks only need one bit per cell and are stored as single 64-bit words.
+ *
+ * Cells that are fully inside and finest cells the surface passes through are inside, which makes
+ * the answer conservative by up to one finest cell. Coarser 'not_fully_inside' cells without
+ * children are outside. Large inside and outside regions are answered
+ * by the top nodes, which stay in cache, and most other queries touch one node and one leaf word.
+ * The whole pyramid usually takes well under a byte per cell of the hierarchy.
+ *
+ * The pyramid is a snapshot and is not updated when the hierarchy changes. It is never modified
+ * after construction, so any number of threads can query it without synchronization.
+ */
+template <int L, typename T>
+class OccupancyPyramid {
+public:
+    using Cell = glm::vec<L, int>;
+
+    /// Each node covers 2^'axis_bits' children along every axis (64 children in total)
+    constexpr static int axis_bits = (L == 3 ? 2 : 3);
+
+    /// Points per task when testing many points at once
+    constexpr static std::size_t query_grain_size = 4096u;
+
+    struct alignas(32) Node {
+        std::uint64_t inside;      ///< Children that are entirely inside
+        std::uint64_t mixed;       ///< Children with a node or leaf word below them
+        std::uint32_t first_child; ///< Index of the first child in 'nodes()' or 'leaves()' (second finest nodes)
+    };
+
+    explicit OccupancyPyramid(DistanceVolumeHierarchyCpu<L, T> const& hierarchy);
+
+    /**
+     * @brief Whether 'point' is in a fully inside cell or a finest cell the surface passes through.
+     */
+    auto inside(glm::vec<L, T> const& point) const -> bool;
+
+    /**
+     * @brief Same as 'inside' for 'count' points, evaluated in parallel.
+     */
+    auto inside(glm::vec<L, T> const* points, std::size_t count, bool* results) const -> void;
+
+    auto nodes() const -> std::vector<Node> const&; ///< Breadth-first, starting with the root
+    auto leaves() const -> std::vector<std::uint64_t> const&;
+
+    /**
+     * @brief The number of node levels above the leaf words (zero for an empty hierarchy).
+     */
+    auto depth() const -> int;
+
+    auto resolution() const -> T; ///< The width of the finest cells
+    auto memory_size() const -> std::size_t;
+
+private:
+    std::vector<Node>          nodes_;
+    std::vector<std::uint64_t> leaves_;
+
+    int  depth_      = 0;
+    T    resolution_ = T(1);
+    Cell origin_     = Cell(0); ///< The finest cell in the corner of the root
+
+    // The corners of the root in world space, checked before converting points to cells
+    glm::vec<L, T> min_point_ = glm::vec<L, T>(0);
+    glm::vec<L, T> max_point_ = glm::vec<L, T>(0);
+
+    /**
+     * @brief The child of a node containing 'local' (a finest cell relative to 'origin_') if the
+     *        children of the node are 2^'shift' finest cells wide.
+     */
+    static auto child_index(glm::vec<L, std::uint32_t> const& local, int shift) -> int;
+};
+
+} // namespace ltb::dvh
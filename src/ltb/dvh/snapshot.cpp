@@ -0,0 +1,462 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "snapshot.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace ltb::dvh::snapshot {
+namespace {
+
+auto make_crc32_table() -> std::array<std::uint32_t, 256> {
+    std::array<std::uint32_t, 256> table = {};
+    for (auto i = 0u; i < 256u; ++i) {
+        auto value = i;
+        for (auto bit = 0; bit < 8; ++bit) {
+            value = (value & 1u ? 0xEDB88320u ^ (value >> 1u) : value >> 1u);
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+// Spreads the low 'morton_bits<L>' bits of 'value' so there are 'L - 1' zero bits between them
+template <int L>
+auto spread_bits(std::uint64_t value) -> std::uint64_t;
+
+template <>
+auto spread_bits<2>(std::uint64_t value) -> std::uint64_t {
+    value &= 0xFFFFFFFFull;
+    value = (value | (value << 16u)) & 0x0000FFFF0000FFFFull;
+    value = (value | (value << 8u)) & 0x00FF00FF00FF00FFull;
+    value = (value | (value << 4u)) & 0x0F0F0F0F0F0F0F0Full;
+    value = (value | (value << 2u)) & 0x3333333333333333ull;
+    value = (value | (value << 1u)) & 0x5555555555555555ull;
+    return value;
+}
+
+template <>
+auto spread_bits<3>(std::uint64_t value) -> std::uint64_t {
+    value &= 0x1FFFFFull;
+    value = (value | (value << 32u)) & 0x1F00000000FFFFull;
+    value = (value | (value << 16u)) & 0x1F0000FF0000FFull;
+    value = (value | (value << 8u)) & 0x100F00F00F00F00Full;
+    value = (value | (value << 4u)) & 0x10C30C30C30C30C3ull;
+    value = (value | (value << 2u)) & 0x1249249249249249ull;
+    return value;
+}
+
+// The inverse of 'spread_bits'
+template <int L>
+auto compact_bits(std::uint64_t value) -> std::uint64_t;
+
+template <>
+auto compact_bits<2>(std::uint64_t value) -> std::uint64_t {
+    value &= 0x5555555555555555ull;
+    value = (value | (value >> 1u)) & 0x3333333333333333ull;
+    value = (value | (value >> 2u)) & 0x0F0F0F0F0F0F0F0Full;
+    value = (value | (value >> 4u)) & 0x00FF00FF00FF00FFull;
+    value = (value | (value >> 8u)) & 0x0000FFFF0000FFFFull;
+    value = (value | (value >> 16u)) & 0x00000000FFFFFFFFull;
+    return value;
+}
+
+template <>
+auto compact_bits<3>(std::uint64_t value) -> std::uint64_t {
+    value &= 0x1249249249249249ull;
+    value = (value | (value >> 2u)) & 0x10C30C30C30C30C3ull;
+    value = (value | (value >> 4u)) & 0x100F00F00F00F00Full;
+    value = (value | (value >> 8u)) & 0x1F0000FF0000FFull;
+    value = (value | (value >> 16u)) & 0x1F00000000FFFFull;
+    value = (value | (value >> 32u)) & 0x1FFFFFull;
+    return value;
+}
+
+// Coordinates are offset by half of their range so negative cells have unsigned codes
+template <int L>
+constexpr std::int64_t morton_offset = std::int64_t(1) << (morton_bits<L> - 1);
+
+} // namespace
+
+auto crc32(char const* data, std::size_t size) -> std::uint32_t {
+    static auto const table = make_crc32_table();
+
+    auto crc = 0xFFFFFFFFu;
+    for (auto i = 0ul; i < size; ++i) {
+        crc = table[(crc ^ static_cast<std::uint8_t>(data[i])) & 0xFFu] ^ (crc >> 8u);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+auto zigzag_encode(std::int64_t value) -> std::uint64_t {
+    return (static_cast<std::uint64_t>(value) << 1u) ^ static_cast<std::uint64_t>(value < 0 ? -1 : 0);
+}
+
+auto zigzag_decode(std::uint64_t value) -> std::int64_t {
+    return static_cast<std::int64_t>(value >> 1u) ^ -static_cast<std::int64_t>(value & 1u);
+}
+
+template <int L>
+auto morton_encode(glm::vec<L, int> const& cell) -> std::optional<std::uint64_t> {
+    constexpr auto range = std::int64_t(1) << morton_bits<L>;
+
+    auto code = std::uint64_t(0);
+    for (int i = 0; i < L; ++i) {
+        auto const biased = std::int64_t(cell[i]) + morton_offset<L>;
+        if (biased < 0 || biased >= range) {
+            return std::nullopt;
+        }
+        code |= spread_bits<L>(static_cast<std::uint64_t>(biased)) << static_cast<unsigned>(i);
+    }
+    return code;
+}
+
+template <int L>
+auto morton_decode(std::uint64_t code) -> glm::vec<L, int> {
+    glm::vec<L, int> cell;
+    for (int i = 0; i < L; ++i) {
+        auto const biased = static_cast<std::int64_t>(compact_bits<L>(code >> static_cast<unsigned>(i)));
+        cell[i]           = static_cast<int>(biased - morton_offset<L>);
+    }
+    return cell;
+}
+
+template auto morton_encode(glm::vec<2, int> const& cell) -> std::optional<std::uint64_t>;
+template auto morton_encode(glm::vec<3, int> const& cell) -> std::optional<std::uint64_t>;
+template auto morton_decode<2>(std::uint64_t code) -> glm::vec<2, int>;
+template auto morton_decode<3>(std::uint64_t code) -> glm::vec<3, int>;
+
+Writer::Writer() {
+    buffer_.append(magic, sizeof(magic));
+    write_raw(format_version);
+}
+
+auto Writer::write_varint(std::uint64_t value) -> void {
+    while (value >= 0x80u) {
+        buffer_.push_back(static_cast<char>((value & 0x7Fu) | 0x80u));
+        value >>= 7u;
+    }
+    buffer_.push_back(static_cast<char>(value));
+}
+
+auto Writer::write_sorted_codes(std::vector<std::uint64_t> const& codes) -> void {
+    write_varint(codes.size());
+
+    auto previous = std::uint64_t(0);
+    for (auto const& code : codes) {
+        write_varint(code - previous);
+        previous = code;
+    }
+}
+
+auto Writer::begin_section(std::uint32_t tag) -> void {
+    write_raw(tag);
+    section_start_ = buffer_.size();
+    write_raw(std::uint64_t(0)); // Filled in by 'end_section'
+}
+
+auto Writer::end_section() -> void {
+    auto const payload_start = section_start_ + sizeof(std::uint64_t);
+    auto const payload_size  = static_cast<std::uint64_t>(buffer_.size() - payload_start);
+
+    std::memcpy(&buffer_[section_start_], &payload_size, sizeof(payload_size));
+    write_raw(crc32(buffer_.data() + payload_start, payload_size));
+}
+
+auto Writer::buffer() const -> std::string const& {
+    return buffer_;
+}
+
+Reader::Reader(char const* data, std::size_t size) : data_(data), size_(size) {}
+
+auto Reader::read_varint() -> std::uint64_t {
+    auto value = std::uint64_t(0);
+
+    for (auto shift = 0u; shift < 64u; shift += 7u) {
+        if (!ok_ || position_ == size_) {
+            ok_ = false;
+            return 0u;
+        }
+        auto const byte = static_cast<std::uint8_t>(data_[position_++]);
+        value |= std::uint64_t(byte & 0x7Fu) << shift;
+
+        if (!(byte & 0x80u)) {
+            return value;
+        }
+    }
+    ok_ = false; // Too many bytes for a 64 bit value
+    return 0u;
+}
+
+auto Reader::read_sorted_codes(std::vector<std::uint64_t>* codes) -> void {
+    auto const count = read_varint();
+
+    // Every code takes at least one byte so larger counts can only come from corrupted data
+    if (count > size_ - position_) {
+        ok_ = false;
+        return;
+    }
+
+    codes->resize(count);
+
+    auto previous = std::uint64_t(0);
+    for (auto& code : *codes) {
+        code     = previous + read_varint();
+        previous = code;
+    }
+}
+
+auto Reader::read_section(std::uint32_t tag) -> util::Result<Reader> {
+    auto const section_tag  = read_raw<std::uint32_t>();
+    auto const payload_size = read_raw<std::uint64_t>();
+
+    if (!ok_ || section_tag != tag) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot is missing a section"));
+    }
+    if (size_ - position_ < payload_size || size_ - position_ - payload_size < sizeof(std::uint32_t)) {
+        ok_ = false;
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot is truncated"));
+    }
+
+    auto const* payload = data_ + position_;
+    position_ += payload_size;
+
+    if (read_raw<std::uint32_t>() != crc32(payload, payload_size)) {
+        ok_ = false;
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot checksum mismatch (the file is corrupted)"));
+    }
+    return Reader(payload, payload_size);
+}
+
+template <typename T>
+auto quantize_distance(T distance, T cell_width) -> std::uint64_t {
+    if (std::isinf(distance)) {
+        return 0u;
+    }
+    // Well inside the range of an int64 (and exactly representable by a double)
+    constexpr auto limit = T(std::int64_t(1) << 52);
+
+    auto const steps = std::clamp(std::round(distance / cell_width * T(delta_quantization_steps)), -limit, limit);
+    return zigzag_encode(static_cast<std::int64_t>(steps)) + 1u;
+}
+
+template <typename T>
+auto dequantize_distance(std::uint64_t value, T cell_width) -> T {
+    if (value == 0u) {
+        return std::numeric_limits<T>::infinity();
+    }
+    return T(zigzag_decode(value - 1u)) * cell_width / T(delta_quantization_steps);
+}
+
+template auto quantize_distance(float distance, float cell_width) -> std::uint64_t;
+template auto quantize_distance(double distance, double cell_width) -> std::uint64_t;
+template auto dequantize_distance(std::uint64_t value, float cell_width) -> float;
+template auto dequantize_distance(std::uint64_t value, double cell_width) -> double;
+
+auto Reader::ok() const -> bool {
+    return ok_;
+}
+
+auto Reader::at_end() const -> bool {
+    return position_ == size_;
+}
+
+StreamReader::StreamReader(std::istream& input) : input_(input) {}
+
+auto StreamReader::read_section(std::uint32_t tag) -> util::Result<Reader> {
+    auto const section_tag  = read_raw<std::uint32_t>();
+    auto const payload_size = read_raw<std::uint64_t>();
+
+    if (!ok_ || section_tag != tag) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot is missing a section"));
+    }
+    if (!read_payload(payload_size)) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot is truncated"));
+    }
+
+    auto const checksum = read_raw<std::uint32_t>();
+    if (!ok_) {
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot is truncated"));
+    }
+    if (checksum != crc32(payload_.data(), payload_.size())) {
+        ok_ = false;
+        return tl::make_unexpected(LTB_MAKE_ERROR("Snapshot checksum mismatch (the file is corrupted)"));
+    }
+    return Reader(payload_.data(), payload_.size());
+}
+
+auto StreamReader::ok() const -> bool {
+    return ok_;
+}
+
+auto StreamReader::at_end() -> bool {
+    return input_.peek() == std::istream::traits_type::eof();
+}
+
+auto StreamReader::read_payload(std::uint64_t size) -> bool {
+    constexpr auto chunk_size = std::uint64_t(1u << 20u);
+
+    payload_.clear();
+
+    while (ok_ && payload_.size() < size) {
+        auto const offset = payload_.size();
+        auto const count  = std::min(chunk_size, size - offset);
+
+        payload_.resize(offset + count);
+        if (!input_.read(payload_.data() + offset, static_cast<std::streamsize>(count))) {
+            ok_ = false;
+        }
+    }
+    return ok_;
+}
+
+TEST_CASE("[dvh] snapshot encodings round trip") {
+    CHECK(crc32("123456789", 9u) == 0xCBF43926u);
+
+    for (auto value : {std::int64_t(0),
+                       std::int64_t(-1),
+                       std::int64_t(1),
+                       std::int64_t(-1000),
+                       std::numeric_limits<std::int64_t>::min(),
+                       std::numeric_limits<std::int64_t>::max()}) {
+        CHECK(zigzag_decode(zigzag_encode(value)) == value);
+    }
+    CHECK(zigzag_encode(-1) == 1u);
+    CHECK(zigzag_encode(1) == 2u);
+
+    for (auto const& cell : {glm::ivec3(0, 0, 0), glm::ivec3(-1, 5, -7), glm::ivec3(-(1 << 20), (1 << 20) - 1, 3)}) {
+        auto code = morton_encode(cell);
+        REQUIRE(code);
+        CHECK(morton_decode<3>(*code) == cell);
+    }
+    CHECK_FALSE(morton_encode(glm::ivec3(1 << 20, 0, 0)));
+
+    auto const int_min = std::numeric_limits<int>::min();
+    auto const int_max = std::numeric_limits<int>::max();
+
+    for (auto const& cell : {glm::ivec2(0, 0), glm::ivec2(int_min, int_max), glm::ivec2(int_max, -1)}) {
+        auto code = morton_encode(cell);
+        REQUIRE(code);
+        CHECK(morton_decode<2>(*code) == cell);
+    }
+
+    // Neighbours in Morton order share high bits
+    CHECK(*morton_encode(glm::ivec3(0, 0, 0)) + 1u == *morton_encode(glm::ivec3(1, 0, 0)));
+    CHECK(*morton_encode(glm::ivec3(0, 0, 0)) + 2u == *morton_encode(glm::ivec3(0, 1, 0)));
+
+    for (auto distance : {0.f, 0.3f, -1.7f, 250.f}) {
+        CHECK(dequantize_distance(quantize_distance(distance, 0.5f), 0.5f)
+              == doctest::Approx(distance).epsilon(0.5 / delta_quantization_steps));
+    }
+    CHECK(quantize_distance(0.f, 0.5f) == 1u);
+    CHECK(std::isinf(dequantize_distance(quantize_distance(std::numeric_limits<float>::infinity(), 0.5f), 0.5f)));
+
+    std::vector<std::uint64_t> const codes = {3u, 4u, 1000u, 1u << 20u};
+
+    Writer writer;
+    writer.begin_section(7u);
+    for (auto value : {0ull, 127ull, 128ull, 300ull, ~0ull}) {
+        writer.write_varint(value);
+    }
+    writer.write_raw(2.5f);
+    writer.write_sorted_codes(codes);
+    writer.end_section();
+
+    auto const& buffer = writer.buffer();
+
+    Reader reader(buffer.data(), buffer.size());
+    reader.read_raw<std::array<char, sizeof(magic)>>();
+    CHECK(reader.read_raw<std::uint32_t>() == format_version);
+
+    auto section = reader.read_section(7u);
+    REQUIRE(section);
+    for (auto value : {0ull, 127ull, 128ull, 300ull, ~0ull}) {
+        CHECK(section->read_varint() == value);
+    }
+    CHECK(section->read_raw<float>() == 2.5f);
+
+    std::vector<std::uint64_t> read_codes;
+    section->read_sorted_codes(&read_codes);
+    CHECK(read_codes == codes);
+    CHECK(section->ok());
+    CHECK(section->at_end());
+
+    // Reading past the end fails instead of returning garbage
+    section->read_varint();
+    CHECK_FALSE(section->ok());
+    CHECK(reader.at_end());
+
+    // Any flipped bit is caught by the checksum
+    auto corrupted = buffer;
+    corrupted[corrupted.size() - 8u] ^= 0x10;
+
+    Reader corrupted_reader(corrupted.data(), corrupted.size());
+    corrupted_reader.read_raw<std::array<char, sizeof(magic)>>();
+    corrupted_reader.read_raw<std::uint32_t>();
+    CHECK_FALSE(corrupted_reader.read_section(7u));
+}
+
+TEST_CASE("[dvh] snapshot streams are read one section at a time") {
+    Writer writer;
+    for (auto tag : {1u, 2u}) {
+        writer.begin_section(tag);
+        writer.write_varint(tag * 100u);
+        writer.end_section();
+    }
+
+    std::istringstream input(writer.buffer());
+    StreamReader       reader(input);
+    reader.read_raw<std::array<char, sizeof(magic)>>();
+    CHECK(reader.read_raw<std::uint32_t>() == format_version);
+
+    for (auto tag : {1u, 2u}) {
+        auto section = reader.read_section(tag);
+        REQUIRE(section);
+        CHECK(section->read_varint() == tag * 100u);
+        CHECK(section->at_end());
+    }
+    CHECK(reader.ok());
+    CHECK(reader.at_end());
+
+    // Sizes past the end of the stream are reported as truncated instead of being allocated
+    auto truncated = writer.buffer().substr(0u, sizeof(magic) + sizeof(std::uint32_t) + sizeof(std::uint32_t));
+    auto const huge_size = std::numeric_limits<std::uint64_t>::max() / 2u;
+    truncated.append(reinterpret_cast<char const*>(&huge_size), sizeof(huge_size));
+    truncated.append("abc");
+
+    std::istringstream truncated_input(truncated);
+    StreamReader       truncated_reader(truncated_input);
+    truncated_reader.read_raw<std::array<char, sizeof(magic)>>();
+    truncated_reader.read_raw<std::uint32_t>();
+    CHECK_FALSE(truncated_reader.read_section(1u));
+    CHECK_FALSE(truncated_reader.ok());
+}
+
+} // namespace ltb::dvh::snapshot
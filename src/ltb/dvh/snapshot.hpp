@@ -0,0 +1,216 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "ltb/util/result.hpp"
+
+// external
+#include <glm/glm.hpp>
+
+// standard
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Building blocks of the binary hierarchy snapshots ('DistanceVolumeHierarchyCpu::save').
+ *
+ * A snapshot is a magic string and a version followed by sections. Every section is a tag, the
+ * payload size, the payload and a CRC-32 of the payload so corrupted files are detected before
+ * anything is loaded. Deltas ('DistanceVolumeHierarchyCpu::take_delta') use the same framing with
+ * their own sections.
+ */
+namespace ltb::dvh::snapshot {
+
+/// Incremented whenever the snapshot layout changes
+constexpr std::uint32_t format_version = 3u;
+
+constexpr char magic[8] = {'L', 'T', 'B', 'S', 'D', 'V', 'H', '\0'};
+
+// Section tags (four characters read as a little endian integer)
+constexpr std::uint32_t header_section       = 0x44414548u; // "HEAD"
+constexpr std::uint32_t roots_section        = 0x544F4F52u; // "ROOT"
+constexpr std::uint32_t level_section        = 0x4C56454Cu; // "LEVL"
+constexpr std::uint32_t band_section         = 0x444E4142u; // "BAND"
+constexpr std::uint32_t delta_header_section = 0x52444844u; // "DHDR"
+constexpr std::uint32_t delta_roots_section  = 0x544F5244u; // "DROT"
+constexpr std::uint32_t delta_band_section   = 0x444E4244u; // "DBND"
+constexpr std::uint32_t delta_level_section  = 0x41544C44u; // "DLTA"
+
+/// Distances in deltas are rounded to '1 / delta_quantization_steps' of their cell's width
+constexpr std::int64_t delta_quantization_steps = 4096;
+
+auto crc32(char const* data, std::size_t size) -> std::uint32_t;
+
+/// Maps signed integers to unsigned ones so small magnitudes have short varints
+auto zigzag_encode(std::int64_t value) -> std::uint64_t;
+auto zigzag_decode(std::uint64_t value) -> std::int64_t;
+
+/// Each coordinate gets '64 / L' bits of a Morton code
+template <int L>
+constexpr int morton_bits = 64 / L;
+
+/**
+ * @brief Interleaves the bits of the cell coordinates so sorted codes are in Morton (Z) order.
+ *
+ * @return std::nullopt if a coordinate doesn't fit in 'morton_bits<L>' bits (signed).
+ */
+template <int L>
+auto morton_encode(glm::vec<L, int> const& cell) -> std::optional<std::uint64_t>;
+
+template <int L>
+auto morton_decode(std::uint64_t code) -> glm::vec<L, int>;
+
+/**
+ * @brief A distance as a multiple of '1 / delta_quantization_steps' of 'cell_width', zigzag encoded.
+ *
+ * Infinite distances ('not_fully_inside') are 0 and every other value is shifted up by one.
+ */
+template <typename T>
+auto quantize_distance(T distance, T cell_width) -> std::uint64_t;
+
+template <typename T>
+auto dequantize_distance(std::uint64_t value, T cell_width) -> T;
+
+class Writer {
+public:
+    Writer();
+
+    auto write_varint(std::uint64_t value) -> void;
+
+    template <typename V>
+    auto write_raw(V const& value) -> void;
+
+    /**
+     * @brief Writes the number of codes and the differences between consecutive (sorted) codes.
+     */
+    auto write_sorted_codes(std::vector<std::uint64_t> const& codes) -> void;
+
+    auto begin_section(std::uint32_t tag) -> void;
+    auto end_section() -> void;
+
+    auto buffer() const -> std::string const&;
+
+private:
+    std::string buffer_;
+    std::size_t section_start_ = 0; ///< Where the payload size of the open section is written
+};
+
+/**
+ * @brief Reads values until the data runs out, after which every read returns zero and 'ok()'
+ * is false. Errors are checked once per section instead of once per value.
+ */
+class Reader {
+public:
+    Reader(char const* data, std::size_t size);
+
+    auto read_varint() -> std::uint64_t;
+
+    template <typename V>
+    auto read_raw() -> V;
+
+    auto read_sorted_codes(std::vector<std::uint64_t>* codes) -> void;
+
+    /**
+     * @brief Checks the tag and checksum of the next section and returns a reader for its payload.
+     */
+    auto read_section(std::uint32_t tag) -> util::Result<Reader>;
+
+    auto ok() const -> bool;
+    auto at_end() const -> bool;
+
+private:
+    char const* data_;
+    std::size_t size_;
+    std::size_t position_ = 0;
+    bool        ok_       = true;
+};
+
+/**
+ * @brief Reads a snapshot from a stream one section at a time, so only the section being decoded
+ * is held in memory instead of the whole file.
+ */
+class StreamReader {
+public:
+    explicit StreamReader(std::istream& input);
+
+    template <typename V>
+    auto read_raw() -> V;
+
+    /**
+     * @brief Same as 'Reader::read_section'. The returned reader is only valid until the next
+     *        section is read.
+     */
+    auto read_section(std::uint32_t tag) -> util::Result<Reader>;
+
+    auto ok() const -> bool;
+    auto at_end() -> bool;
+
+private:
+    std::istream&     input_;
+    std::vector<char> payload_; ///< Reused by every section
+    bool              ok_ = true;
+
+    /// Reads 'size' bytes into 'payload_', growing it as data arrives so corrupted sizes can't
+    /// allocate more than the stream holds.
+    auto read_payload(std::uint64_t size) -> bool;
+};
+
+template <typename V>
+auto Writer::write_raw(V const& value) -> void {
+    static_assert(std::is_trivially_copyable_v<V>, "Only trivially copyable values can be written directly");
+    buffer_.append(reinterpret_cast<char const*>(&value), sizeof(V));
+}
+
+template <typename V>
+auto Reader::read_raw() -> V {
+    static_assert(std::is_trivially_copyable_v<V>, "Only trivially copyable values can be read directly");
+
+    V value = {};
+    if (!ok_ || size_ - position_ < sizeof(V)) {
+        ok_ = false;
+        return value;
+    }
+    std::memcpy(&value, data_ + position_, sizeof(V));
+    position_ += sizeof(V);
+    return value;
+}
+
+template <typename V>
+auto StreamReader::read_raw() -> V {
+    static_assert(std::is_trivially_copyable_v<V>, "Only trivially copyable values can be read directly");
+
+    V value = {};
+    if (ok_ && !input_.read(reinterpret_cast<char*>(&value), sizeof(V))) {
+        ok_   = false;
+        value = {};
+    }
+    return value;
+}
+
+} // namespace ltb::dvh::snapshot
@@ -0,0 +1,463 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#include "tiled_hierarchy.hpp"
+
+// project
+#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+#include "ltb/dvh/snapshot.hpp"
+#include "ltb/sdf/sdf.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+
+namespace ltb::dvh {
+
+template <int L, typename T>
+TiledHierarchy<L, T>::TiledHierarchy(T           base_resolution,
+                                     int         tile_level,
+                                     std::size_t resident_byte_budget,
+                                     std::string backing_directory)
+    : base_resolution_(base_resolution),
+      tile_level_(tile_level),
+      resident_byte_budget_(resident_byte_budget),
+      backing_directory_(std::move(backing_directory)) {}
+
+template <int L, typename T>
+TiledHierarchy<L, T>::~TiledHierarchy() {
+    for (auto const& [key, tile] : tiles_) {
+        if (tile.on_disk) {
+            std::error_code ignored;
+            std::filesystem::remove(tile_filename(key), ignored);
+        }
+    }
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::apply(EditBatch<L, T> const& batch) -> util::Result<void> {
+    auto const& operations = batch.operations();
+
+    // The operations (in order) of every tile they can change
+    std::unordered_map<Cell, std::vector<std::size_t>> tile_operations;
+
+    for (auto i = 0ul; i < operations.size(); ++i) {
+        auto const& operation = operations[i];
+        auto const  bounds    = operation.world_bounds();
+
+        switch (operation.type) {
+        case VolumeOperationType::Add:
+            if (!sdf::is_empty(bounds)) {
+                for (auto const& key : tiles_near(bounds)) {
+                    tiles_.try_emplace(key);
+                    tile_operations[key].emplace_back(i);
+                }
+            }
+            break;
+
+        case VolumeOperationType::Subtract:
+            if (!sdf::is_empty(bounds)) {
+                for (auto const& key : tiles_near(bounds)) {
+                    if (tiles_.find(key) != tiles_.end()) {
+                        tile_operations[key].emplace_back(i);
+                    }
+                }
+            }
+            break;
+
+        case VolumeOperationType::Intersect:
+            // Removes everything outside of the geometry so every tile is affected
+            for (auto const& key_and_tile : tiles_) {
+                tile_operations[key_and_tile.first].emplace_back(i);
+            }
+            break;
+        }
+    }
+
+    std::vector<std::pair<std::uint64_t, Cell>> keys;
+    for (auto const& key_and_operations : tile_operations) {
+        auto const& key = key_and_operations.first;
+        keys.emplace_back(snapshot::morton_encode(key).value_or(std::numeric_limits<std::uint64_t>::max()), key);
+    }
+
+    // Neighbouring tiles are edited one after the other so the file reads stay local. Tiles too far
+    // away for a Morton code are ordered by their coordinates.
+    std::sort(keys.begin(), keys.end(), [](auto const& lhs, auto const& rhs) {
+        if (lhs.first != rhs.first) {
+            return lhs.first < rhs.first;
+        }
+        return std::lexicographical_compare(&lhs.second[0], &lhs.second[0] + L, &rhs.second[0], &rhs.second[0] + L);
+    });
+
+    LoadedTile prefetched;
+
+    for (auto i = 0ul; i < keys.size(); ++i) {
+        auto const& key  = keys[i].second;
+        auto&       tile = tiles_.at(key);
+
+        if (!tile.hierarchy) {
+            if (auto result = make_room(tile.bytes, nullptr); !result) {
+                return result;
+            }
+            if (auto result = page_in(key, &tile, std::move(prefetched)); !result) {
+                return result;
+            }
+        }
+        lru_.splice(lru_.begin(), lru_, tile.lru_position);
+
+        // Read the next tile while this one is edited
+        prefetched = {};
+        if (i + 1ul < keys.size()) {
+            auto const& next_key  = keys[i + 1ul].second;
+            auto const& next_tile = tiles_.at(next_key);
+
+            if (!next_tile.hierarchy && next_tile.on_disk) {
+                if (auto result = make_room(next_tile.bytes, &key); !result) {
+                    return result;
+                }
+                prefetched = load_tile_async(next_key, next_tile);
+            }
+        }
+
+        // Each tile only gets (copies of) the operations that can change it
+        EditBatch<L, T> tile_batch;
+        for (auto const operation : tile_operations.at(key)) {
+            tile_batch.add_operation(operations[operation]);
+        }
+        tile.hierarchy->apply(std::move(tile_batch));
+        tile.dirty = true;
+        update_bytes(&tile);
+
+        if (tile.bytes == 0u) {
+            drop_tile(key);
+        } else if (auto result = make_room(0u, &key); !result) {
+            return result;
+        }
+    }
+
+    return util::success();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::find(int level, Cell const& cell) -> util::Result<std::optional<VecDist>> {
+    auto const key = tile_of(level, cell);
+
+    auto iter = tiles_.find(key);
+    if (iter == tiles_.end()) {
+        return std::nullopt;
+    }
+    auto& tile = iter->second;
+
+    if (!tile.hierarchy) {
+        if (auto result = make_room(tile.bytes, nullptr); !result) {
+            return tl::make_unexpected(result.error());
+        }
+        if (auto result = page_in(key, &tile); !result) {
+            return tl::make_unexpected(result.error());
+        }
+    }
+    lru_.splice(lru_.begin(), lru_, tile.lru_position);
+
+    auto const& levels = tile.hierarchy->levels();
+
+    if (auto distance_field = levels.find(level); distance_field != levels.end()) {
+        if (auto value = distance_field->second.find(cell); value != distance_field->second.end()) {
+            return value->second;
+        }
+    }
+    return std::nullopt;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::flush() -> util::Result<void> {
+    for (auto const& key : lru_) {
+        if (auto result = save_tile(key, &tiles_.at(key)); !result) {
+            return result;
+        }
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::tile_of(int level, Cell const& cell) const -> Cell {
+    auto const center = cell_center(cell, base_resolution_ * std::pow(T(2), T(level)));
+    return get_cell(center, tile_width());
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::tile_bounds(Cell const& tile) const -> sdf::AABB<L, T> {
+    auto const min_point = glm::vec<L, T>(tile) * tile_width();
+    return {min_point, min_point + tile_width()};
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::num_tiles() const -> std::size_t {
+    return tiles_.size();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::num_resident_tiles() const -> std::size_t {
+    return lru_.size();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::resident_bytes() const -> std::size_t {
+    return resident_bytes_;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::resident_byte_budget() const -> std::size_t {
+    return resident_byte_budget_;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::peak_resident_bytes() const -> std::size_t {
+    return peak_resident_bytes_;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::base_resolution() const -> T {
+    return base_resolution_;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::tile_level() const -> int {
+    return tile_level_;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::estimated_bytes(Hierarchy const& hierarchy) -> std::size_t {
+    // A hash map node (key, value, next pointer and cached hash) plus its bucket
+    constexpr auto cell_bytes = sizeof(Cell) + sizeof(VecDist) + 3ul * sizeof(void*);
+
+    // Roughly one child mask per parent, shared by up to '2^L' children
+    constexpr auto mask_bytes = (sizeof(Cell) + sizeof(std::uint64_t) + 3ul * sizeof(void*)) / 2ul;
+
+    auto num_cells = 0ul;
+    for (auto const& level : hierarchy.levels()) {
+        num_cells += level.second.size();
+    }
+    return num_cells * (cell_bytes + mask_bytes);
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::tile_width() const -> T {
+    return base_resolution_ * std::pow(T(2), T(tile_level_));
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::tile_filename(Cell const& tile) const -> std::string {
+    auto name = std::string("tile");
+    for (int i = 0; i < L; ++i) {
+        name += "_" + std::to_string(tile[i]);
+    }
+    return (std::filesystem::path(backing_directory_) / (name + ".dvh")).string();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::tiles_near(sdf::AABB<L, T> const& bounds) const -> std::vector<Cell> {
+    std::vector<Cell> keys;
+    iterate(get_cell(bounds.min_point - tile_width(), tile_width()),
+            get_cell(bounds.max_point + tile_width(), tile_width()),
+            [&keys](Cell const& key) { keys.emplace_back(key); });
+    return keys;
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::load_tile_async(Cell const& key, Tile const& tile) const -> LoadedTile {
+    // Only copies are captured since the tiles can change while the file is read. New tiles
+    // don't need another thread.
+    return std::async(tile.on_disk ? std::launch::async : std::launch::deferred,
+                      [base_resolution = base_resolution_,
+                       bounds          = tile_bounds(key),
+                       filename        = tile.on_disk ? tile_filename(key) : std::string()]()
+                          -> util::Result<std::unique_ptr<Hierarchy>> {
+                          auto hierarchy = std::make_unique<Hierarchy>(base_resolution);
+                          hierarchy->set_domain(bounds);
+
+                          if (!filename.empty()) {
+                              if (auto result = hierarchy->load(filename); !result) {
+                                  return tl::make_unexpected(result.error());
+                              }
+                          }
+                          return hierarchy;
+                      });
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::page_in(Cell const& key, Tile* tile, LoadedTile loaded) -> util::Result<void> {
+    if (!loaded.valid()) {
+        loaded = load_tile_async(key, *tile);
+    }
+
+    auto hierarchy = loaded.get();
+    if (!hierarchy) {
+        return tl::make_unexpected(hierarchy.error());
+    }
+
+    tile->hierarchy = std::move(*hierarchy);
+    lru_.emplace_front(key);
+    tile->lru_position = lru_.begin();
+
+    resident_bytes_ += tile->bytes;
+    peak_resident_bytes_ = std::max(peak_resident_bytes_, resident_bytes_);
+    return util::success();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::page_out(Cell const& key, Tile* tile) -> util::Result<void> {
+    if (auto result = save_tile(key, tile); !result) {
+        return result;
+    }
+
+    tile->hierarchy = nullptr;
+    lru_.erase(tile->lru_position);
+    resident_bytes_ -= tile->bytes;
+    return util::success();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::save_tile(Cell const& key, Tile* tile) -> util::Result<void> {
+    if (!tile->dirty) {
+        return util::success();
+    }
+    if (auto result = tile->hierarchy->save(tile_filename(key)); !result) {
+        return result;
+    }
+    tile->on_disk = true;
+    tile->dirty   = false;
+    return util::success();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::drop_tile(Cell const& key) -> void {
+    auto& tile = tiles_.at(key);
+
+    if (tile.hierarchy) {
+        lru_.erase(tile.lru_position);
+        resident_bytes_ -= tile.bytes;
+    }
+    if (tile.on_disk) {
+        std::error_code ignored;
+        std::filesystem::remove(tile_filename(key), ignored);
+    }
+    tiles_.erase(key);
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::make_room(std::size_t incoming_bytes, Cell const* keep) -> util::Result<void> {
+    while (resident_bytes_ + incoming_bytes > resident_byte_budget_) {
+        auto victim = std::find_if(lru_.rbegin(), lru_.rend(), [keep](Cell const& key) {
+            return keep == nullptr || key != *keep;
+        });
+
+        // A single tile larger than the budget is still kept in memory
+        if (victim == lru_.rend()) {
+            break;
+        }
+
+        auto const key = *victim;
+        if (auto result = page_out(key, &tiles_.at(key)); !result) {
+            return result;
+        }
+    }
+    return util::success();
+}
+
+template <int L, typename T>
+auto TiledHierarchy<L, T>::update_bytes(Tile* tile) -> void {
+    resident_bytes_ -= tile->bytes;
+    tile->bytes = estimated_bytes(*tile->hierarchy);
+    resident_bytes_ += tile->bytes;
+    peak_resident_bytes_ = std::max(peak_resident_bytes_, resident_bytes_);
+}
+
+template class TiledHierarchy<2, float>;
+template class TiledHierarchy<3, float>;
+template class TiledHierarchy<2, double>;
+template class TiledHierarchy<3, double>;
+
+TEST_CASE("[dvh] tiled hierarchies match a regular hierarchy") {
+    using Dvh = DistanceVolumeHierarchyCpu<3, float>;
+
+    auto const directory = std::filesystem::temp_directory_path() / "ltb_dvh_tiled_test";
+    std::filesystem::create_directories(directory);
+
+    auto boxes = std::vector{
+        sdf::make_transformed_geometry(sdf::make_box<3>({2.5f, 1.2f, 1.f}), {0.5f, -0.75f, 1.f}),
+        sdf::make_transformed_geometry(sdf::make_box<3>({0.25f, 1.1f, 3.f}), {3.7f, 2.f, -1.f}),
+    };
+    auto lines = std::vector{
+        sdf::make_offset_line<3>({4.5f, 3.25f, 0.3f}, {0.5f, -0.75f, 0.f}, 0.1f),
+        sdf::make_offset_line<3>({0.5f, -0.75f, 0.f}, {0.5f, -0.75f, 5.f}, 0.1f),
+    };
+
+    Dvh dvh(0.1f);
+    dvh.add_volume(boxes);
+    dvh.subtract_volumes(lines);
+
+    constexpr auto tile_level = 4;
+
+    // The memory needed to keep every tile resident
+    auto all_tiles_bytes = std::size_t(0u);
+    {
+        auto const no_limit = std::numeric_limits<std::size_t>::max();
+
+        TiledHierarchy<3, float> unlimited(0.1f, tile_level, no_limit, directory.string());
+        REQUIRE(unlimited.add_volume(boxes));
+        REQUIRE(unlimited.subtract_volumes(lines));
+        CHECK(unlimited.num_resident_tiles() == unlimited.num_tiles());
+        all_tiles_bytes = unlimited.peak_resident_bytes();
+    }
+
+    TiledHierarchy<3, float> tiled(0.1f, tile_level, all_tiles_bytes / 3ul, directory.string());
+
+    EditBatch<3, float> batch;
+    batch.add_volume(boxes).subtract_volumes(lines);
+    REQUIRE(tiled.apply(batch));
+
+    CHECK(tiled.num_resident_tiles() < tiled.num_tiles());
+    CHECK(tiled.resident_bytes() <= tiled.resident_byte_budget());
+
+    for (auto const& [level, cells] : dvh.levels()) {
+        if (level >= tile_level) {
+            continue;
+        }
+        for (auto const& [cell, value] : cells) {
+            auto tiled_value = tiled.find(level, cell);
+            REQUIRE(tiled_value);
+            REQUIRE(tiled_value->has_value());
+            CHECK(tiled_value->value() == value);
+        }
+    }
+    CHECK(tiled.peak_resident_bytes() < all_tiles_bytes);
+    CHECK(tiled.flush());
+
+    std::filesystem::remove_all(directory);
+}
+
+} // namespace ltb::dvh
@@ -0,0 +1,220 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "ltb/dvh/edit_batch.hpp"
+#include "ltb/dvh/impl/distance_volume_hierarchy_cpu.hpp"
+#include "ltb/util/result.hpp"
+
+// external
+#include <glm/gtx/hash.hpp>
+
+// standard
+#include <future>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ltb::dvh {
+
+/**
+ * @brief A hierarchy split into fixed tiles that are paged to disk when they don't fit in memory.
+ *
+ * Tiles are the cells of 'tile_level'. Each tile is an independent hierarchy restricted to its
+ * own domain (see 'DistanceVolumeHierarchyCpu::set_domain') so it can be built, saved and loaded
+ * without the others. The least recently used tiles are written to a snapshot file in the backing
+ * directory and released whenever the resident tiles use more than the byte budget, so a build of
+ * any size completes as long as a couple of tiles fit in the budget.
+ *
+ * Edits visit the affected tiles in Morton order and read the next tile from disk while the
+ * current one is being edited.
+ *
+ * Cells below 'tile_level' match a regular hierarchy built from the same edits. Coarser cells
+ * are only kept by the tiles near an added volume. The volumes are not recorded once a tile is
+ * paged out so they can't be moved or removed.
+ *
+ * Example:
+ *
+ *     ltb::dvh::TiledHierarchy<3> tiled(0.05f, 6, 512ul << 20ul, "/tmp/tiles");
+ *     if (auto result = tiled.add_volume(boxes); !result) {
+ *         ...
+ *     }
+ */
+template <int L, typename T = float>
+class TiledHierarchy {
+public:
+    using Cell      = glm::vec<L, int>;
+    using VecDist   = glm::vec<L + 1, T>;
+    using Hierarchy = DistanceVolumeHierarchyCpu<L, T>;
+
+    /**
+     * @param tile_level - Tiles are '2^tile_level' finest cells wide.
+     * @param resident_byte_budget - The (estimated) memory the resident tiles may use.
+     * @param backing_directory - Where paged out tiles are written. It must exist and shouldn't be
+     *                            shared with another tiled hierarchy.
+     */
+    TiledHierarchy(T base_resolution, int tile_level, std::size_t resident_byte_budget, std::string backing_directory);
+
+    /**
+     * @brief Removes the backing files.
+     */
+    ~TiledHierarchy();
+
+    TiledHierarchy(TiledHierarchy const&) = delete;
+    auto operator=(TiledHierarchy const&) -> TiledHierarchy& = delete;
+
+    /**
+     * @brief Applies 'batch' to every tile it can change, one tile at a time. Each tile is only
+     *        given the operations near it.
+     *
+     * If a tile can't be read or written the tiles before it keep the edit.
+     */
+    auto apply(EditBatch<L, T> const& batch) -> util::Result<void>;
+
+    template <typename Geometry>
+    auto add_volume(std::vector<Geometry> geometries) -> util::Result<void>;
+
+    template <typename Geometry>
+    auto subtract_volumes(std::vector<Geometry> geometries) -> util::Result<void>;
+
+    template <typename Geometry>
+    auto intersect_volumes(std::vector<Geometry> geometries) -> util::Result<void>;
+
+    /**
+     * @brief The value of 'cell', read from the tile containing its center (paged in if needed).
+     */
+    auto find(int level, Cell const& cell) -> util::Result<std::optional<VecDist>>;
+
+    /**
+     * @brief Writes every modified resident tile so the backing files are up to date.
+     */
+    auto flush() -> util::Result<void>;
+
+    /**
+     * @brief The tile containing the center of 'cell'.
+     */
+    auto tile_of(int level, Cell const& cell) const -> Cell;
+
+    auto tile_bounds(Cell const& tile) const -> sdf::AABB<L, T>;
+
+    auto num_tiles() const -> std::size_t;
+    auto num_resident_tiles() const -> std::size_t;
+
+    auto resident_bytes() const -> std::size_t;
+    auto resident_byte_budget() const -> std::size_t;
+
+    /**
+     * @brief The most memory the resident tiles have used so far.
+     */
+    auto peak_resident_bytes() const -> std::size_t;
+
+    auto base_resolution() const -> T;
+    auto tile_level() const -> int;
+
+    /**
+     * @brief The approximate memory used by the cells and child masks of 'hierarchy'.
+     */
+    static auto estimated_bytes(Hierarchy const& hierarchy) -> std::size_t;
+
+private:
+    struct Tile {
+        std::unique_ptr<Hierarchy>         hierarchy = nullptr; ///< nullptr while paged out
+        std::size_t                        bytes     = 0u;      ///< Estimated size, kept when paged out
+        bool                               on_disk   = false;   ///< A backing file exists
+        bool                               dirty     = false;   ///< Resident changes that aren't on disk
+        typename std::list<Cell>::iterator lru_position;        ///< Only valid while resident
+    };
+
+    using LoadedTile = std::future<util::Result<std::unique_ptr<Hierarchy>>>;
+
+    T           base_resolution_;
+    int         tile_level_;
+    std::size_t resident_byte_budget_;
+    std::string backing_directory_;
+
+    std::unordered_map<Cell, Tile> tiles_;
+    std::list<Cell>                lru_; ///< Resident tiles, most recently used first
+
+    std::size_t resident_bytes_      = 0u;
+    std::size_t peak_resident_bytes_ = 0u;
+
+    auto tile_width() const -> T;
+    auto tile_filename(Cell const& tile) const -> std::string;
+
+    /**
+     * @brief Every tile within one tile width of 'bounds' (cells can be affected by geometry that
+     *        is up to their parent's bounding sphere away).
+     */
+    auto tiles_near(sdf::AABB<L, T> const& bounds) const -> std::vector<Cell>;
+
+    /**
+     * @brief Starts reading a paged out tile on another thread.
+     */
+    auto load_tile_async(Cell const& key, Tile const& tile) const -> LoadedTile;
+
+    /**
+     * @brief Makes 'tile' resident, using 'loaded' if it has already been read.
+     */
+    auto page_in(Cell const& key, Tile* tile, LoadedTile loaded = {}) -> util::Result<void>;
+    auto page_out(Cell const& key, Tile* tile) -> util::Result<void>;
+    auto save_tile(Cell const& key, Tile* tile) -> util::Result<void>;
+    auto drop_tile(Cell const& key) -> void;
+
+    /**
+     * @brief Pages out the least recently used tiles (except 'keep') until 'incoming_bytes' more fit
+     *        in the budget.
+     */
+    auto make_room(std::size_t incoming_bytes, Cell const* keep) -> util::Result<void>;
+
+    auto update_bytes(Tile* tile) -> void;
+};
+
+template <int L, typename T>
+template <typename Geometry>
+auto TiledHierarchy<L, T>::add_volume(std::vector<Geometry> geometries) -> util::Result<void> {
+    EditBatch<L, T> batch;
+    batch.add_volume(std::move(geometries));
+    return apply(batch);
+}
+
+template <int L, typename T>
+template <typename Geometry>
+auto TiledHierarchy<L, T>::subtract_volumes(std::vector<Geometry> geometries) -> util::Result<void> {
+    EditBatch<L, T> batch;
+    batch.subtract_volumes(std::move(geometries));
+    return apply(batch);
+}
+
+template <int L, typename T>
+template <typename Geometry>
+auto TiledHierarchy<L, T>::intersect_volumes(std::vector<Geometry> geometries) -> util::Result<void> {
+    EditBatch<L, T> batch;
+    batch.intersect_volumes(std::move(geometries));
+    return apply(batch);
+}
+
+} // namespace ltb::dvh
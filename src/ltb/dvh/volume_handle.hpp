@@ -0,0 +1,54 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// standard
+#include <cstdint>
+
+namespace ltb::dvh {
+
+/**
+ * @brief Refers to a volume that was added to (or subtracted from) a hierarchy.
+ *
+ * Handles are only meaningful for the hierarchy that created them.
+ */
+class VolumeHandle {
+public:
+    VolumeHandle() = default;
+    explicit VolumeHandle(std::uint64_t id) : id_(id) {}
+
+    /**
+     * @brief False for default constructed handles.
+     */
+    auto valid() const -> bool { return id_ != 0u; }
+
+    auto id() const -> std::uint64_t { return id_; }
+
+    auto operator==(VolumeHandle const& other) const -> bool { return id_ == other.id_; }
+    auto operator!=(VolumeHandle const& other) const -> bool { return id_ != other.id_; }
+
+private:
+    std::uint64_t id_ = 0u;
+};
+
+} // namespace ltb::dvh
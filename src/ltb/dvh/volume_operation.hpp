@@ -0,0 +1,148 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "ltb/dvh/distance_volume_hierarchy_util.hpp"
+#include "ltb/sdf/aabb.hpp"
+#include "ltb/sdf/csg.hpp"
+
+// standard
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ltb::dvh {
+
+enum class VolumeOperationType {
+    Add,
+    Subtract,
+    Intersect,
+};
+
+/**
+ * @brief A type erased set of geometries and the way they modify a hierarchy.
+ *
+ * The geometry type is only known when the operation is created so the traversal code does not
+ * need to be instantiated per geometry type. Distances are requested for whole batches of points
+ * so the (inlined) geometry loop is only dispatched through std::function once per batch.
+ */
+template <int L, typename T>
+struct VolumeOperation {
+    using Point = glm::vec<L, T>;
+
+    /// Writes the combined signed distance of all geometries to 'distances' for each point.
+    using Evaluator = std::function<void(Point const* points, std::size_t count, T* distances)>;
+
+    VolumeOperationType type = VolumeOperationType::Add;
+    sdf::AABB<L, T>     bounds; ///< Before 'translation' is applied
+    Evaluator           evaluate;
+
+    /// Applied to every geometry (points are moved by '-translation' before they are evaluated)
+    glm::vec<L, T> translation = glm::vec<L, T>(0);
+
+    auto world_bounds() const -> sdf::AABB<L, T> {
+        if (sdf::is_empty(bounds)) {
+            return bounds;
+        }
+        return {bounds.min_point + translation, bounds.max_point + translation};
+    }
+};
+
+/**
+ * @brief Creates an operation that owns a copy of 'geometries'.
+ * @tparam Geometry - Must be derived from sdf::Geometry<L, T>.
+ */
+template <int L, typename T, typename Geometry>
+auto make_volume_operation(VolumeOperationType type, std::vector<Geometry> geometries) -> VolumeOperation<L, T> {
+    auto shared_geometries = std::make_shared<std::vector<Geometry> const>(std::move(geometries));
+
+    VolumeOperation<L, T> operation;
+    operation.type = type;
+
+    for (auto const& geometry : *shared_geometries) {
+        auto aabb        = geometry.bounding_box();
+        operation.bounds = sdf::expand(operation.bounds, aabb.min_point);
+        operation.bounds = sdf::expand(operation.bounds, aabb.max_point);
+    }
+
+    if (type == VolumeOperationType::Add) {
+        // Keep the closest surface, preferring the outside on ties
+        operation.evaluate = [shared_geometries](glm::vec<L, T> const* points, std::size_t count, T* distances) {
+            for (auto i = 0ul; i < count; ++i) {
+                auto min_dist     = std::numeric_limits<T>::infinity();
+                auto min_abs_dist = min_dist;
+
+                for (auto const& geometry : *shared_geometries) {
+                    auto const dist     = geometry.distance_from(points[i]);
+                    auto const abs_dist = std::abs(dist);
+
+                    if (should_replace_with(min_abs_dist, abs_dist, dist)) {
+                        min_dist     = dist;
+                        min_abs_dist = abs_dist;
+                    }
+                }
+                distances[i] = min_dist;
+            }
+        };
+    } else {
+        // Union of all the subtracted (or intersected) geometries
+        operation.evaluate = [shared_geometries](glm::vec<L, T> const* points, std::size_t count, T* distances) {
+            for (auto i = 0ul; i < count; ++i) {
+                auto min_dist = std::numeric_limits<T>::infinity();
+
+                for (auto const& geometry : *shared_geometries) {
+                    min_dist = std::min(min_dist, geometry.distance_from(points[i]));
+                }
+                distances[i] = min_dist;
+            }
+        };
+    }
+
+    return operation;
+}
+
+/**
+ * @brief Creates an operation that evaluates a whole CSG tree per cell.
+ *
+ * Only the final distance of the tree is used by the hierarchy so no intermediate volumes are
+ * built, and sub-expressions far from a cell are skipped by their bounding boxes.
+ */
+template <int L, typename T>
+auto make_volume_operation(VolumeOperationType type, sdf::csg::Expression<L, T> expression) -> VolumeOperation<L, T> {
+    VolumeOperation<L, T> operation;
+    operation.type   = type;
+    operation.bounds = expression.bounding_box();
+
+    operation.evaluate = [expression = std::move(expression)](glm::vec<L, T> const* points,
+                                                              std::size_t           count,
+                                                              T*                    distances) {
+        for (auto i = 0ul; i < count; ++i) {
+            distances[i] = expression.distance_from(points[i]);
+        }
+    };
+
+    return operation;
+}
+
+} // namespace ltb::dvh
@@ -24,6 +24,7 @@
 
 // external
 #include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
 
 namespace ltb {
 namespace sdf {
@@ -39,5 +40,35 @@ auto expand(AABB<L, T> const& aabb, glm::vec<L, T> const& point) -> AABB<L, T> {
     return {glm::min(aabb.min_point, point), glm::max(aabb.max_point, point)};
 }
 
+template <int L, typename T = float>
+auto expand(AABB<L, T> const& aabb, AABB<L, T> const& other) -> AABB<L, T> {
+    return {glm::min(aabb.min_point, other.min_point), glm::max(aabb.max_point, other.max_point)};
+}
+
+/**
+ * @brief The part of space inside both boxes (empty if they don't overlap).
+ */
+template <int L, typename T = float>
+auto intersection(AABB<L, T> const& lhs, AABB<L, T> const& rhs) -> AABB<L, T> {
+    return {glm::max(lhs.min_point, rhs.min_point), glm::min(lhs.max_point, rhs.max_point)};
+}
+
+/**
+ * @brief True if the boxes overlap (touching counts as overlapping).
+ */
+template <int L, typename T = float>
+auto intersects(AABB<L, T> const& lhs, AABB<L, T> const& rhs) -> bool {
+    return glm::all(glm::lessThanEqual(lhs.min_point, rhs.max_point))
+        && glm::all(glm::lessThanEqual(rhs.min_point, lhs.max_point));
+}
+
+/**
+ * @brief True for default constructed boxes that have not been expanded by any points.
+ */
+template <int L, typename T = float>
+auto is_empty(AABB<L, T> const& aabb) -> bool {
+    return glm::any(glm::greaterThan(aabb.min_point, aabb.max_point));
+}
+
 } // namespace sdf
 } // namespace ltb
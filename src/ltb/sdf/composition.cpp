@@ -0,0 +1,85 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+// project
+#include "composition.hpp"
+#include "sdf.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <random>
+
+namespace {
+using namespace ltb;
+
+TEST_CASE("[sdf] composed scenes match their individual geometries") {
+    auto make_box = [](glm::vec3 const& dimensions, glm::vec3 const& center) {
+        return sdf::make_transformed_geometry(sdf::make_box<3, float>(dimensions), center);
+    };
+
+    auto boxes   = std::vector{make_box({2.f, 1.f, 1.f}, {-1.f, 0.f, 0.f}), make_box({1.f, 3.f, 1.f}, {4.f, 1.f, 0.f})};
+    auto lines   = std::vector{sdf::make_offset_line<3, float>({0.f, 0.f, 0.f}, {3.f, 2.f, 0.f}, 0.25f)};
+    auto cutters = std::vector{make_box({1.f, 1.f, 1.f}, {-1.5f, 0.f, 0.5f})};
+
+    auto scene = sdf::union_of(boxes, lines);
+    auto part  = sdf::subtract(scene, cutters);
+
+    static_assert(decltype(scene)::L == 3);
+    static_assert(std::is_same_v<decltype(part)::T, float>);
+
+    CHECK(scene.bounding_box().min_point == glm::vec3(-2.f, -0.5f, -0.5f));
+    CHECK(scene.bounding_box().max_point == glm::vec3(4.5f, 2.5f, 0.5f));
+    CHECK(part.bounding_box().max_point == scene.bounding_box().max_point);
+
+    std::mt19937                          generator(0);
+    std::uniform_real_distribution<float> coordinate(-4.f, 6.f);
+
+    for (auto i = 0; i < 1000; ++i) {
+        auto point = glm::vec3(coordinate(generator), coordinate(generator), coordinate(generator));
+
+        auto union_dist = std::min({boxes[0].distance_from(point),
+                                    boxes[1].distance_from(point),
+                                    lines[0].distance_from(point)});
+        auto part_dist  = std::max(union_dist, -cutters[0].distance_from(point));
+
+        CHECK(scene.distance_from(point) == doctest::Approx(union_dist));
+        CHECK(part.distance_from(point) == doctest::Approx(part_dist));
+
+        // Unions are only exact outside of the volume
+        auto box_dist = std::min(
+            {boxes[0].distance_from(point), boxes[1].distance_from(point), cutters[0].distance_from(point)});
+        if (box_dist > 0.f) {
+            CHECK(glm::length(sdf::union_of(boxes, cutters).vector_from(point)) == doctest::Approx(box_dist));
+        }
+    }
+}
+
+TEST_CASE("[sdf] composing empty vectors gives an empty volume") {
+    auto scene = sdf::union_of(std::vector<sdf::Box<3, float>>{}, std::vector<sdf::Line<3, float>>{});
+
+    CHECK(sdf::is_empty(scene.bounding_box()));
+    CHECK(scene.distance_from(glm::vec3(0.f)) == std::numeric_limits<float>::infinity());
+}
+
+} // namespace
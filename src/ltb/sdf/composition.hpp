@@ -0,0 +1,243 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "aabb.hpp"
+
+// external
+#include <glm/geometric.hpp>
+
+// standard
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Compile-time scene composition.
+ *
+ * 'union_of' and 'subtract' combine geometry vectors of different types into one concrete
+ * geometry type so a whole scene can be added with a single 'add_volume' call. Every geometry
+ * type is known to the compiler, so the distance loops are inlined into one evaluation without
+ * type erasure. Use 'sdf::csg' instead when the scene is only known at runtime.
+ *
+ * Example:
+ *
+ *     auto part = sdf::subtract(sdf::union_of(boxes, lines), cutters);
+ *     dvh.add_volume(std::vector{part});
+ *
+ * Like any other geometry type, the composed type has to be instantiated once for the hierarchy:
+ *
+ *     LTB_DVH_INSTANTIATE_OPERATIONS(3, float, decltype(part))
+ */
+
+namespace ltb::sdf {
+namespace detail {
+
+template <typename Bounds>
+struct BoundsTraits;
+
+template <int L, typename T>
+struct BoundsTraits<AABB<L, T>> {
+    static constexpr int dimensions = L;
+    using ValueType                 = T;
+};
+
+template <typename Geometry>
+using BoundsOf = std::decay_t<decltype(std::declval<Geometry const&>().bounding_box())>;
+
+} // namespace detail
+
+/**
+ * @brief The union of several (possibly empty) vectors of geometries of different types.
+ */
+template <typename Geometry, typename... Geometries>
+class UnionOf {
+public:
+    using Bounds = detail::BoundsOf<Geometry>;
+
+    static constexpr int L = detail::BoundsTraits<Bounds>::dimensions;
+    using T                = typename detail::BoundsTraits<Bounds>::ValueType;
+
+    static_assert((std::is_same_v<Bounds, detail::BoundsOf<Geometries>> && ...),
+                  "Every geometry must have the same dimensions and value type");
+
+    UnionOf() = default;
+    explicit UnionOf(std::vector<Geometry> geometries, std::vector<Geometries>... other_geometries);
+
+    auto vector_from(glm::vec<L, T> const& point) const -> glm::vec<L, T>;
+    auto distance_from(glm::vec<L, T> const& point) const -> T;
+    auto bounding_box() const -> AABB<L, T>;
+
+private:
+    std::tuple<std::vector<Geometry>, std::vector<Geometries>...> groups_;
+    AABB<L, T>                                                    bounds_; ///< Cached so it isn't recomputed per cell
+};
+
+/**
+ * @brief Removes 'Tools' from 'Stock'.
+ */
+template <typename Stock, typename Tools>
+class Subtraction {
+public:
+    using Bounds = detail::BoundsOf<Stock>;
+
+    static constexpr int L = detail::BoundsTraits<Bounds>::dimensions;
+    using T                = typename detail::BoundsTraits<Bounds>::ValueType;
+
+    static_assert(std::is_same_v<Bounds, detail::BoundsOf<Tools>>,
+                  "The stock and tools must have the same dimensions and value type");
+
+    Subtraction() = default;
+    Subtraction(Stock stock, Tools tools);
+
+    auto vector_from(glm::vec<L, T> const& point) const -> glm::vec<L, T>;
+    auto distance_from(glm::vec<L, T> const& point) const -> T;
+    auto bounding_box() const -> AABB<L, T>;
+
+private:
+    Stock stock_;
+    Tools tools_;
+};
+
+namespace detail {
+
+template <typename Geometry>
+auto as_geometry(Geometry geometry) -> Geometry {
+    return geometry;
+}
+
+template <typename Geometry>
+auto as_geometry(std::vector<Geometry> geometries) -> UnionOf<Geometry> {
+    return UnionOf<Geometry>(std::move(geometries));
+}
+
+} // namespace detail
+
+template <typename Geometry, typename... Geometries>
+auto union_of(std::vector<Geometry> geometries, std::vector<Geometries>... other_geometries)
+    -> UnionOf<Geometry, Geometries...> {
+    return UnionOf<Geometry, Geometries...>(std::move(geometries), std::move(other_geometries)...);
+}
+
+/**
+ * @param stock - a geometry or a vector of geometries.
+ * @param tools - a geometry or a vector of geometries (vectors are combined with 'union_of').
+ */
+template <typename Stock, typename Tools>
+auto subtract(Stock stock, Tools tools) {
+    using StockGeometry = decltype(detail::as_geometry(std::move(stock)));
+    using ToolsGeometry = decltype(detail::as_geometry(std::move(tools)));
+
+    return Subtraction<StockGeometry, ToolsGeometry>(detail::as_geometry(std::move(stock)),
+                                                     detail::as_geometry(std::move(tools)));
+}
+
+template <typename Geometry, typename... Geometries>
+UnionOf<Geometry, Geometries...>::UnionOf(std::vector<Geometry> geometries, std::vector<Geometries>... other_geometries)
+    : groups_(std::move(geometries), std::move(other_geometries)...) {
+
+    std::apply(
+        [this](auto const&... groups) {
+            auto expand_by = [this](auto const& group) {
+                for (auto const& geometry : group) {
+                    bounds_ = expand(bounds_, geometry.bounding_box());
+                }
+            };
+            (expand_by(groups), ...);
+        },
+        groups_);
+}
+
+template <typename Geometry, typename... Geometries>
+auto UnionOf<Geometry, Geometries...>::vector_from(glm::vec<L, T> const& point) const -> glm::vec<L, T> {
+    auto min_dist   = std::numeric_limits<T>::infinity();
+    auto min_vector = glm::vec<L, T>(std::numeric_limits<T>::infinity());
+
+    std::apply(
+        [&](auto const&... groups) {
+            auto closest_in = [&](auto const& group) {
+                for (auto const& geometry : group) {
+                    auto const dist = geometry.distance_from(point);
+                    if (dist < min_dist) {
+                        min_dist   = dist;
+                        min_vector = geometry.vector_from(point);
+                    }
+                }
+            };
+            (closest_in(groups), ...);
+        },
+        groups_);
+
+    return min_vector;
+}
+
+template <typename Geometry, typename... Geometries>
+auto UnionOf<Geometry, Geometries...>::distance_from(glm::vec<L, T> const& point) const -> T {
+    auto min_dist = std::numeric_limits<T>::infinity();
+
+    // One loop per geometry type, all expanded in place
+    std::apply(
+        [&](auto const&... groups) {
+            auto closest_in = [&](auto const& group) {
+                for (auto const& geometry : group) {
+                    min_dist = std::min(min_dist, geometry.distance_from(point));
+                }
+            };
+            (closest_in(groups), ...);
+        },
+        groups_);
+
+    return min_dist;
+}
+
+template <typename Geometry, typename... Geometries>
+auto UnionOf<Geometry, Geometries...>::bounding_box() const -> AABB<L, T> {
+    return bounds_;
+}
+
+template <typename Stock, typename Tools>
+Subtraction<Stock, Tools>::Subtraction(Stock stock, Tools tools) : stock_(std::move(stock)), tools_(std::move(tools)) {}
+
+template <typename Stock, typename Tools>
+auto Subtraction<Stock, Tools>::vector_from(glm::vec<L, T> const& point) const -> glm::vec<L, T> {
+    // The closest surface belongs to whichever side determines the distance
+    if (-tools_.distance_from(point) > stock_.distance_from(point)) {
+        return tools_.vector_from(point);
+    }
+    return stock_.vector_from(point);
+}
+
+template <typename Stock, typename Tools>
+auto Subtraction<Stock, Tools>::distance_from(glm::vec<L, T> const& point) const -> T {
+    return std::max(stock_.distance_from(point), -tools_.distance_from(point));
+}
+
+template <typename Stock, typename Tools>
+auto Subtraction<Stock, Tools>::bounding_box() const -> AABB<L, T> {
+    return stock_.bounding_box();
+}
+
+} // namespace ltb::sdf
@@ -0,0 +1,109 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+// project
+#include "csg.hpp"
+#include "sdf.hpp"
+
+// external
+#include <doctest/doctest.h>
+
+// standard
+#include <random>
+
+namespace {
+using namespace ltb;
+
+template <typename Geometry>
+auto make_leaf(Geometry geometry) {
+    return sdf::csg::make_geometry<3, float>(std::vector{geometry});
+}
+
+TEST_CASE("[sdf] pruned CSG distances match the unpruned combination") {
+    auto box_a = sdf::make_transformed_geometry(sdf::make_box<3, float>({2.f, 1.f, 1.f}), {-1.f, 0.f, 0.f});
+    auto box_b = sdf::make_transformed_geometry(sdf::make_box<3, float>({1.f, 3.f, 1.f}), {4.f, 1.f, 0.f});
+    auto box_c = sdf::make_transformed_geometry(sdf::make_box<3, float>({1.f, 1.f, 1.f}), {-1.5f, 0.f, 0.5f});
+
+    auto a = make_leaf(box_a);
+    auto b = make_leaf(box_b);
+    auto c = make_leaf(box_c);
+
+    auto const smoothing = 0.5f;
+
+    auto unite     = sdf::csg::make_union(a, b);
+    auto subtract  = sdf::csg::make_subtraction(unite, c);
+    auto intersect = sdf::csg::make_intersection(a, c);
+    auto smooth    = sdf::csg::make_smooth_union(a, b, smoothing);
+
+    auto smooth_min = [smoothing](float lhs, float rhs) {
+        auto h = std::max(smoothing - std::abs(lhs - rhs), 0.f) / smoothing;
+        return std::min(lhs, rhs) - h * h * smoothing * 0.25f;
+    };
+
+    std::mt19937                          generator(0);
+    std::uniform_real_distribution<float> coordinate(-6.f, 8.f);
+
+    for (auto i = 0; i < 1000; ++i) {
+        auto point = glm::vec3(coordinate(generator), coordinate(generator), coordinate(generator));
+
+        auto dist_a = box_a.distance_from(point);
+        auto dist_b = box_b.distance_from(point);
+        auto dist_c = box_c.distance_from(point);
+
+        CHECK(unite.distance_from(point) == doctest::Approx(std::min(dist_a, dist_b)));
+        CHECK(subtract.distance_from(point) == doctest::Approx(std::max(std::min(dist_a, dist_b), -dist_c)));
+        CHECK(intersect.distance_from(point) >= std::max(dist_a, dist_c));
+        CHECK(smooth.distance_from(point) == doctest::Approx(smooth_min(dist_a, dist_b)));
+
+        for (auto const* expression : {&unite, &subtract, &intersect, &smooth}) {
+            // Allow for rounding differences between the box and geometry distances
+            CHECK(expression->lower_bound(point) <= expression->distance_from(point) + 1e-5f);
+        }
+    }
+}
+
+TEST_CASE("[sdf] CSG nodes cache their bounding boxes") {
+    auto a = make_leaf(sdf::make_box<3, float>({2.f, 2.f, 2.f}));
+    auto b = make_leaf(sdf::make_transformed_geometry(sdf::make_box<3, float>({2.f, 2.f, 2.f}), {1.f, 0.f, 0.f}));
+
+    auto unite = sdf::csg::make_union(a, b);
+    CHECK(unite.bounding_box().min_point == glm::vec3(-1.f));
+    CHECK(unite.bounding_box().max_point == glm::vec3(2.f, 1.f, 1.f));
+
+    auto intersect = sdf::csg::make_intersection(a, b);
+    CHECK(intersect.bounding_box().min_point == glm::vec3(0.f, -1.f, -1.f));
+    CHECK(intersect.bounding_box().max_point == glm::vec3(1.f));
+
+    auto subtract = sdf::csg::make_subtraction(a, b);
+    CHECK(subtract.bounding_box().max_point == glm::vec3(1.f));
+
+    auto smooth = sdf::csg::make_smooth_union(a, b, 0.4f);
+    CHECK(smooth.bounding_box().min_point == glm::vec3(-1.1f));
+
+    auto far  = make_leaf(sdf::make_transformed_geometry(sdf::make_box<3, float>({1.f, 1.f, 1.f}), {10.f, 0.f, 0.f}));
+    auto none = sdf::csg::make_intersection(a, far);
+    CHECK(sdf::is_empty(none.bounding_box()));
+    CHECK(none.distance_from(glm::vec3(0.f)) == std::numeric_limits<float>::infinity());
+    CHECK(sdf::csg::Expression<3, float>().distance_from(glm::vec3(0.f)) == std::numeric_limits<float>::infinity());
+}
+
+} // namespace
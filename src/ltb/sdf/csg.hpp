@@ -0,0 +1,337 @@
+// ///////////////////////////////////////////////////////////////////////////////////////
+// LTB Distance Volume Hierarchy
+// Copyright (c) 2020 Logan Barnes - All Rights Reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ///////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// project
+#include "aabb.hpp"
+
+// external
+#include <glm/geometric.hpp>
+
+// standard
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace ltb::sdf::csg {
+
+enum class NodeType {
+    Geometry,
+    Union,
+    Subtraction,
+    Intersection,
+    SmoothUnion,
+};
+
+/**
+ * @brief An immutable tree of CSG operations that is only evaluated one point at a time.
+ *
+ * No intermediate volumes are created. Each node caches a bounding box and, when a point is
+ * evaluated, sub-expressions whose box proves they can't change the result are skipped.
+ *
+ * Nodes are shared so expressions are cheap to copy and can be reused in several trees.
+ *
+ * Example:
+ *
+ *     using namespace ltb::sdf;
+ *
+ *     auto walls = csg::make_geometry<3, float>(boxes);
+ *     auto doors = csg::make_geometry<3, float>(door_boxes);
+ *     auto house = csg::make_subtraction(walls, doors);
+ *
+ *     dvh.add_volume(house);
+ */
+template <int L, typename T = float>
+class Expression {
+public:
+    using Point     = glm::vec<L, T>;
+    using Evaluator = std::function<T(Point const& point)>;
+
+    /// An empty expression (+infinity everywhere)
+    Expression();
+
+    auto type() const -> NodeType;
+
+    /**
+     * @brief Contains the whole volume. 'distance_from' is never smaller than the distance to this
+     * box so it is used to skip sub-expressions. Smooth unions are expanded to contain the blend.
+     */
+    auto bounding_box() const -> AABB<L, T> const&;
+
+    auto distance_from(Point const& point) const -> T;
+
+    /**
+     * @brief A value that is never larger than 'distance_from(point)' (up to rounding).
+     */
+    auto lower_bound(Point const& point) const -> T;
+
+    template <int L2, typename T2, typename Geometry>
+    friend auto make_geometry(std::vector<Geometry> geometries) -> Expression<L2, T2>;
+
+    template <int L2, typename T2>
+    friend auto make_union(Expression<L2, T2> lhs, Expression<L2, T2> rhs) -> Expression<L2, T2>;
+
+    template <int L2, typename T2>
+    friend auto make_subtraction(Expression<L2, T2> lhs, Expression<L2, T2> rhs) -> Expression<L2, T2>;
+
+    template <int L2, typename T2>
+    friend auto make_intersection(Expression<L2, T2> lhs, Expression<L2, T2> rhs) -> Expression<L2, T2>;
+
+    template <int L2, typename T2>
+    friend auto make_smooth_union(Expression<L2, T2> lhs, Expression<L2, T2> rhs, T2 smoothing)
+        -> Expression<L2, T2>;
+
+private:
+    struct Node {
+        NodeType   type = NodeType::Geometry;
+        AABB<L, T> bounds;
+
+        Evaluator             evaluate; ///< Only used by 'NodeType::Geometry' nodes
+        std::shared_ptr<Node> lhs;
+        std::shared_ptr<Node> rhs;
+        T                     smoothing = T(0); ///< Only used by 'NodeType::SmoothUnion' nodes
+    };
+
+    explicit Expression(std::shared_ptr<Node const> node);
+
+    static auto distance_from(Node const& node, Point const& point) -> T;
+    static auto lower_bound(Node const& node, Point const& point) -> T;
+    static auto make_node(NodeType type, Expression lhs, Expression rhs) -> std::shared_ptr<Node>;
+
+    std::shared_ptr<Node const> node_;
+};
+
+/**
+ * @brief The union of 'geometries'.
+ * @tparam Geometry - Must be derived from sdf::Geometry<L, T>.
+ */
+template <int L, typename T, typename Geometry>
+auto make_geometry(std::vector<Geometry> geometries) -> Expression<L, T>;
+
+template <int L, typename T>
+auto make_union(Expression<L, T> lhs, Expression<L, T> rhs) -> Expression<L, T>;
+
+/**
+ * @brief Removes 'rhs' from 'lhs'.
+ */
+template <int L, typename T>
+auto make_subtraction(Expression<L, T> lhs, Expression<L, T> rhs) -> Expression<L, T>;
+
+template <int L, typename T>
+auto make_intersection(Expression<L, T> lhs, Expression<L, T> rhs) -> Expression<L, T>;
+
+/**
+ * @brief A union that blends the surfaces of 'lhs' and 'rhs' wherever they are closer than 'smoothing'.
+ *
+ * Uses the polynomial smooth minimum so the blended surface grows by at most 'smoothing / 4'.
+ */
+template <int L, typename T>
+auto make_smooth_union(Expression<L, T> lhs, Expression<L, T> rhs, T smoothing) -> Expression<L, T>;
+
+template <int L, typename T>
+Expression<L, T>::Expression() : Expression(std::make_shared<Node const>()) {}
+
+template <int L, typename T>
+Expression<L, T>::Expression(std::shared_ptr<Node const> node) : node_(std::move(node)) {}
+
+template <int L, typename T>
+auto Expression<L, T>::type() const -> NodeType {
+    return node_->type;
+}
+
+template <int L, typename T>
+auto Expression<L, T>::bounding_box() const -> AABB<L, T> const& {
+    return node_->bounds;
+}
+
+template <int L, typename T>
+auto Expression<L, T>::distance_from(Point const& point) const -> T {
+    return distance_from(*node_, point);
+}
+
+template <int L, typename T>
+auto Expression<L, T>::lower_bound(Point const& point) const -> T {
+    return lower_bound(*node_, point);
+}
+
+template <int L, typename T>
+auto Expression<L, T>::distance_from(Node const& node, Point const& point) -> T {
+    switch (node.type) {
+    case NodeType::Geometry:
+        return node.evaluate ? node.evaluate(point) : std::numeric_limits<T>::infinity();
+
+    case NodeType::Union:
+    case NodeType::SmoothUnion: {
+        auto const* near = node.lhs.get();
+        auto const* far  = node.rhs.get();
+
+        auto near_bound = lower_bound(*near, point);
+        auto far_bound  = lower_bound(*far, point);
+
+        if (far_bound < near_bound) {
+            std::swap(near, far);
+            std::swap(near_bound, far_bound);
+        }
+
+        auto const near_dist = distance_from(*near, point);
+
+        // The far side can't be closer (or close enough to blend)
+        if (near_dist + node.smoothing <= far_bound) {
+            return near_dist;
+        }
+
+        auto const far_dist = distance_from(*far, point);
+
+        if (node.type == NodeType::Union) {
+            return std::min(near_dist, far_dist);
+        }
+
+        auto const h = std::max(node.smoothing - std::abs(near_dist - far_dist), T(0)) / node.smoothing;
+        return std::min(near_dist, far_dist) - h * h * node.smoothing * T(0.25);
+    }
+
+    case NodeType::Subtraction: {
+        auto const lhs_dist = distance_from(*node.lhs, point);
+
+        // max(lhs, -rhs) == lhs since -rhs <= -lower_bound(rhs) <= lhs
+        if (-lower_bound(*node.rhs, point) <= lhs_dist) {
+            return lhs_dist;
+        }
+        return std::max(lhs_dist, -distance_from(*node.rhs, point));
+    }
+
+    case NodeType::Intersection:
+        if (is_empty(node.bounds)) {
+            return std::numeric_limits<T>::infinity();
+        }
+        // The distance to the box is also a lower bound of the true distance so it is used to
+        // keep the box invariant (max(lhs, rhs) alone may be smaller).
+        return std::max({distance_from(*node.lhs, point),
+                         distance_from(*node.rhs, point),
+                         lower_bound(node, point)});
+    }
+    return std::numeric_limits<T>::infinity();
+}
+
+template <int L, typename T>
+auto Expression<L, T>::lower_bound(Node const& node, Point const& point) -> T {
+    if (is_empty(node.bounds)) {
+        return std::numeric_limits<T>::infinity();
+    }
+
+    auto const outside = glm::max(glm::max(node.bounds.min_point - point, point - node.bounds.max_point), T(0));
+    auto const dist    = glm::length(outside);
+
+    // Points inside the box may also be inside the volume
+    return dist > T(0) ? dist : -std::numeric_limits<T>::infinity();
+}
+
+template <int L, typename T>
+auto Expression<L, T>::make_node(NodeType type, Expression lhs, Expression rhs) -> std::shared_ptr<Node> {
+    auto node  = std::make_shared<Node>();
+    node->type = type;
+    // The children are never modified so sharing them between trees is safe
+    node->lhs = std::const_pointer_cast<Node>(std::move(lhs.node_));
+    node->rhs = std::const_pointer_cast<Node>(std::move(rhs.node_));
+    return node;
+}
+
+template <int L, typename T, typename Geometry>
+auto make_geometry(std::vector<Geometry> geometries) -> Expression<L, T> {
+    using Node = typename Expression<L, T>::Node;
+
+    auto node = std::make_shared<Node>();
+
+    for (auto const& geometry : geometries) {
+        node->bounds = expand(node->bounds, geometry.bounding_box());
+    }
+
+    if (!geometries.empty()) {
+        node->evaluate = [geometries = std::move(geometries)](glm::vec<L, T> const& point) {
+            auto min_dist = std::numeric_limits<T>::infinity();
+
+            for (auto const& geometry : geometries) {
+                min_dist = std::min(min_dist, geometry.distance_from(point));
+            }
+            return min_dist;
+        };
+    }
+
+    return Expression<L, T>(std::move(node));
+}
+
+template <int L, typename T>
+auto make_union(Expression<L, T> lhs, Expression<L, T> rhs) -> Expression<L, T> {
+    auto bounds = expand(lhs.bounding_box(), rhs.bounding_box());
+
+    auto node    = Expression<L, T>::make_node(NodeType::Union, std::move(lhs), std::move(rhs));
+    node->bounds = bounds;
+    return Expression<L, T>(std::move(node));
+}
+
+template <int L, typename T>
+auto make_subtraction(Expression<L, T> lhs, Expression<L, T> rhs) -> Expression<L, T> {
+    auto bounds = lhs.bounding_box();
+
+    auto node    = Expression<L, T>::make_node(NodeType::Subtraction, std::move(lhs), std::move(rhs));
+    node->bounds = bounds;
+    return Expression<L, T>(std::move(node));
+}
+
+template <int L, typename T>
+auto make_intersection(Expression<L, T> lhs, Expression<L, T> rhs) -> Expression<L, T> {
+    auto const& lhs_bounds = lhs.bounding_box();
+    auto const& rhs_bounds = rhs.bounding_box();
+
+    auto bounds = AABB<L, T>{};
+    if (intersects(lhs_bounds, rhs_bounds)) {
+        bounds = {glm::max(lhs_bounds.min_point, rhs_bounds.min_point),
+                  glm::min(lhs_bounds.max_point, rhs_bounds.max_point)};
+    }
+
+    auto node    = Expression<L, T>::make_node(NodeType::Intersection, std::move(lhs), std::move(rhs));
+    node->bounds = bounds;
+    return Expression<L, T>(std::move(node));
+}
+
+template <int L, typename T>
+auto make_smooth_union(Expression<L, T> lhs, Expression<L, T> rhs, T smoothing) -> Expression<L, T> {
+    if (smoothing <= T(0)) {
+        return make_union(std::move(lhs), std::move(rhs));
+    }
+
+    auto bounds = expand(lhs.bounding_box(), rhs.bounding_box());
+    if (!is_empty(bounds)) {
+        bounds.min_point -= smoothing * T(0.25);
+        bounds.max_point += smoothing * T(0.25);
+    }
+
+    auto node       = Expression<L, T>::make_node(NodeType::SmoothUnion, std::move(lhs), std::move(rhs));
+    node->bounds    = bounds;
+    node->smoothing = smoothing;
+    return Expression<L, T>(std::move(node));
+}
+
+} // namespace ltb::sdf::csg
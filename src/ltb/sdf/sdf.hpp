@@ -23,6 +23,7 @@
 #pragma once
 
 #include "box.hpp"
+#include "composition.hpp"
 #include "line.hpp"
 #include "offset.hpp"
 #include "offset_line.hpp"